@@ -35,7 +35,7 @@ protected:
 
 public:
     /** Type of an identifier for an outcome. It is ignored for the simple action. */
-    typedef long OutcomeId;
+    typedef idx_t OutcomeId;
 
     /** Creates an empty action. */
     RegularAction(){};
@@ -75,6 +75,12 @@ public:
         return make_pair(0, value(valuefunction, discount));
     };
 
+    /** Computes the value of maximal without the outcome */
+    prec_t maximal_value(const numvec& valuefunction, prec_t discount) const { return value(valuefunction, discount); };
+
+    /** Computes the value of minimal without the outcome */
+    prec_t minimal_value(const numvec& valuefunction, prec_t discount) const { return value(valuefunction, discount); };
+
     /**
     Computes a value of the action: see RegularAction::value. The
     purpose of this method is for the general robust MDP setting.
@@ -263,7 +269,7 @@ Actions are constructed as valid by default.
 class DiscreteOutcomeAction : public OutcomeManagement {
 public:
     /** Type of an identifier for an outcome. It is ignored for the simple action. */
-    typedef long OutcomeId;
+    typedef idx_t OutcomeId;
 
     /** Creates an empty action. */
     DiscreteOutcomeAction(){};
@@ -289,6 +295,16 @@ public:
     */
     pair<DiscreteOutcomeAction::OutcomeId, prec_t> minimal(numvec const& valuefunction, prec_t discount) const;
 
+    /** Computes the value of maximal without the outcome */
+    prec_t maximal_value(numvec const& valuefunction, prec_t discount) const {
+        return maximal(valuefunction, discount).second;
+    };
+
+    /** Computes the value of minimal without the outcome */
+    prec_t minimal_value(numvec const& valuefunction, prec_t discount) const {
+        return minimal(valuefunction, discount).second;
+    };
+
     /**
     Computes the average outcome using a uniform distribution.
     \param valuefunction Updated value function
@@ -354,17 +370,21 @@ protected:
     prec_t threshold;
     /** Weights used in computing the worst/best case */
     numvec distribution;
+    /** Whether to reuse the order of the outcomes between computations of the worst/best case */
+    bool order_cache;
+    /** Order of the outcomes from the last computation of the worst/best case (see order_cache) */
+    mutable vector<size_t> outcome_order;
 
 public:
     /** Type of the outcome identification */
     typedef numvec OutcomeId;
 
     /** Creates an empty action. */
-    WeightedOutcomeAction() : OutcomeManagement(), threshold(0), distribution(0){};
+    WeightedOutcomeAction() : OutcomeManagement(), threshold(0), distribution(0), order_cache(false){};
 
     /** Initializes outcomes to the provided vector */
     WeightedOutcomeAction(const vector<Transition>& outcomes)
-            : OutcomeManagement(outcomes), threshold(0), distribution(0){};
+            : OutcomeManagement(outcomes), threshold(0), distribution(0), order_cache(false){};
 
     /**
     Computes the maximal outcome distribution constraints on the nature's distribution.
@@ -388,6 +408,26 @@ public:
      */
     pair<OutcomeId, prec_t> minimal(numvec const& valuefunction, prec_t discount) const;
 
+    /**
+    Computes nature's response in the memory provided by the caller.
+    \param maximize Whether nature maximizes the value rather than minimizes it
+    \param result Output of the outcome distribution (one element for each outcome)
+    \returns Value of the action for the distribution
+    */
+    prec_t nature_response(numvec const& valuefunction, prec_t discount, bool maximize, prec_t* result) const;
+
+    /**
+    Computes the value of maximal without the outcome distribution, which is
+    computed in the scratch memory of the thread and does not allocate memory.
+    */
+    prec_t maximal_value(numvec const& valuefunction, prec_t discount) const;
+
+    /**
+    Computes the value of minimal without the outcome distribution, which is
+    computed in the scratch memory of the thread and does not allocate memory.
+    */
+    prec_t minimal_value(numvec const& valuefunction, prec_t discount) const;
+
     /**
     Computes the average outcome using a uniform distribution.
     \param valuefunction Updated value function
@@ -493,6 +533,24 @@ public:
     /** Sets threshold value */
     void set_threshold(prec_t threshold) { this->threshold = threshold; }
 
+    /** Whether the order of the outcomes is cached between computations */
+    bool get_order_cache() const { return order_cache; };
+
+    /**
+    Enables caching the order of the outcomes by their values between the
+    computations of the worst/best case. Value iteration changes the values little
+    between iterations, and the natures that sort the outcomes (such as worstcase_l1)
+    then restore the order in nearly linear time.
+
+    The cache is modified by the const methods maximal and minimal, which then must not
+    be called concurrently for the same action; this holds for the solvers in RMDP,
+    which compute the value of each state on one thread.
+    */
+    void set_order_cache(bool enable) {
+        order_cache = enable;
+        outcome_order.clear();
+    }
+
     /** Appends a string representation to the argument */
     void to_string(string& result) const {
         result.append(std::to_string(get_outcomes().size()));
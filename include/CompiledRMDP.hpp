@@ -0,0 +1,379 @@
+#pragma once
+
+#include "RMDP.hpp"
+#include "definitions.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace craam {
+
+using namespace std;
+
+// **************************************************************************************
+//  Array view
+// **************************************************************************************
+
+/**
+A read-only view of a contiguous array. The view does not own the memory, which
+must be kept alive by the owner of the view.
+*/
+template <class T>
+class ArrayView {
+public:
+    /** Constructs an empty view */
+    ArrayView() : first(nullptr), count(0){};
+    /** Constructs a view of the array */
+    ArrayView(const T* data, size_t size) : first(data), count(size){};
+    /** Constructs a view of the vector; the vector must not be resized afterwards */
+    ArrayView(const vector<T>& v) : first(v.data()), count(v.size()){};
+
+    /** Pointer to the first element */
+    const T* data() const { return first; };
+    /** Number of elements */
+    size_t size() const { return count; };
+    /** Whether there are no elements */
+    bool empty() const { return count == 0; };
+
+    /** Returns an element */
+    const T& operator[](size_t i) const {
+        assert(i < count);
+        return first[i];
+    };
+
+    /** Returns the last element */
+    const T& back() const {
+        assert(count > 0);
+        return first[count - 1];
+    };
+
+    const T* begin() const { return first; };
+    const T* end() const { return first + count; };
+
+protected:
+    /** First element */
+    const T* first;
+    /** Number of elements */
+    size_t count;
+};
+
+// **************************************************************************************
+//  Compiled (flat) MDP Class
+// **************************************************************************************
+
+/**
+An immutable representation of a GRMDP that is optimized for solving.
+
+The model is stored in a compressed sparse row (CSR) format. All states, actions,
+outcomes, and transitions are packed in contiguous arrays that are indexed by
+offsets:
+    - state_offsets: actions of state s are state_offsets[s] ... state_offsets[s+1]-1
+    - action_offsets: outcomes of action a are action_offsets[a] ... action_offsets[a+1]-1
+    - outcome_offsets: transitions of outcome o are outcome_offsets[o] ... outcome_offsets[o+1]-1
+Actions and outcomes are indexed globally in the offset arrays, but the identifiers
+used in policies and solutions are local to each state and action, exactly as in GRMDP.
+
+The target indices, probabilities, and rewards of all transitions are stored in
+three packed arrays. This avoids the pointer chasing involved in traversing the nested
+vectors of GRMDP and makes the Bellman updates much more cache friendly.
+
+The expected immediate reward of each outcome is precomputed during compilation,
+and the Bellman updates only read the target indices and probabilities of transitions.
+The rewards of individual transitions are not needed for solving and their storage
+can be dropped during compilation to save memory (see the constructor).
+
+The compiled model cannot be modified. It should be constructed from a GRMDP
+after the GRMDP has been fully built. See GRMDP::compile.
+
+The compiled model can be saved to a binary file and loaded again with load. The loaded
+model is not parsed or copied: the file is mapped to memory and the solvers read the arrays
+directly from the mapped pages. The binary format stores all the arrays of the compiled model,
+including the outcome distributions and thresholds, with the exact double values. It is a header
+(see save) followed by the arrays, each aligned to 64 bytes. Copies of a compiled model share
+the same immutable arrays.
+
+The solution methods behave exactly as the corresponding methods in GRMDP and
+return the same solution type.
+
+The probabilities and rewards can be stored in single precision to reduce the size
+of the model and the memory traffic of each sweep. The value function and all
+the accumulations are always computed in double precision (prec_t). Single precision
+storage introduces errors of about 1e-7 relative to the largest reward, and the
+transition probabilities may not sum exactly to one.
+
+\tparam SType Type of state of the source GRMDP, determines the type of uncertainty
+\tparam Storage Scalar type used to store probabilities and rewards (prec_t or float)
+ */
+template <class SType, class Storage>
+class GCompiledRMDP {
+public:
+    /** Action identifier in a policy. Copies type from state type. */
+    typedef typename SType::ActionId ActionId;
+    /** Outcome identifier in a policy. Copies type from state type. */
+    typedef typename SType::OutcomeId OutcomeId;
+
+    /** Decision-maker's policy: Which action to take in which state.  */
+    typedef vector<ActionId> ActionPolicy;
+    /** Nature's policy: Which outcome to take in which state.  */
+    typedef vector<OutcomeId> OutcomePolicy;
+    /** Solution type */
+    typedef GSolution<ActionId, OutcomeId> SolType;
+    /** Array of stored probabilities or rewards */
+    typedef ArrayView<Storage> StorageArray;
+    /** Array of offsets */
+    typedef ArrayView<uint64_t> OffsetArray;
+
+    /** Constructs an empty compiled model. */
+    GCompiledRMDP();
+
+    /**
+    Compiles the provided model. The compiled model does not reference the
+    source model, which can be modified or destroyed afterwards.
+    \param rmdp Source model
+    \param keep_rewards Whether to store the rewards of individual transitions. They are
+            not used by the solvers, which only need the expected reward of each outcome.
+    */
+    explicit GCompiledRMDP(const GRMDP<SType>& rmdp, bool keep_rewards = true);
+
+    /** Number of states */
+    size_t state_count() const { return state_offsets.size() - 1; };
+
+    /** Number of states */
+    size_t size() const { return state_count(); };
+
+    /** Total number of actions in all states */
+    size_t action_count() const { return action_offsets.size() - 1; };
+
+    /** Number of actions in the state */
+    size_t action_count(long stateid) const {
+        assert(stateid >= 0 && size_t(stateid) < state_count());
+        return state_offsets[stateid + 1] - state_offsets[stateid];
+    };
+
+    /** Total number of outcomes in all states and actions */
+    size_t outcome_count() const { return outcome_offsets.size() - 1; };
+
+    /** Total number of transitions (non-zero transition probabilities) */
+    size_t transition_count() const { return indices.size(); };
+
+    /** True if the state is considered terminal (no actions). */
+    bool is_terminal(long stateid) const { return action_count(stateid) == 0; };
+
+    /** Offsets of the first action of each state (with the total action count at the end) */
+    const OffsetArray& get_state_offsets() const { return state_offsets; };
+    /** Offsets of the first outcome of each action (with the total outcome count at the end) */
+    const OffsetArray& get_action_offsets() const { return action_offsets; };
+    /** Offsets of the first transition of each outcome (with the total transition count at the end) */
+    const OffsetArray& get_outcome_offsets() const { return outcome_offsets; };
+    /** Target states of all transitions */
+    const ArrayView<idx_t>& get_indices() const { return indices; };
+    /** Probabilities of all transitions */
+    const StorageArray& get_probabilities() const { return probabilities; };
+    /** Rewards of all transitions (empty if the rewards were not kept) */
+    const StorageArray& get_rewards() const { return rewards; };
+    /** Whether the rewards of individual transitions are stored */
+    bool has_rewards() const { return rewards.size() == indices.size(); };
+    /** Expected immediate reward of each outcome */
+    const StorageArray& get_outcome_rewards() const { return outcome_rewards; };
+    /** Validity of each action (0 for invalid actions, which are skipped) */
+    const ArrayView<uint8_t>& get_action_validity() const { return action_valid; };
+    /** Threshold on nature's deviation for each action (0 when not applicable) */
+    const ArrayView<prec_t>& get_thresholds() const { return thresholds; };
+    /** Nominal distribution over the outcomes of each action */
+    const ArrayView<prec_t>& get_weights() const { return weights; };
+
+    // ----------------------------------------------
+    // Reading and writing files
+    // ----------------------------------------------
+
+    /**
+    Saves the model in the binary format. The file starts with a header that contains:
+        - the magic string "CRAAMBIN" and the version of the format
+        - the type of the state (regular, discrete robust, L1 robust)
+        - the size of the index type and of the storage scalar type
+        - a byte order mark
+        - the number of states, actions, outcomes, and transitions
+        - the position and the size of each array in the file
+    The arrays follow the header in the native byte order.
+    \param output Output stream (should be opened in binary mode)
+    */
+    void save(ostream& output) const;
+
+    /**
+    Saves the model in the binary format to a file. See save(ostream&).
+    \param filename Name of the file
+    */
+    void save(const string& filename) const;
+
+    /**
+    Loads a model from a binary file. The file is mapped to memory and the arrays are used
+    directly without copying. The file must be created with the same type of the model (state type,
+    storage scalar, and index type) and on a machine with the same byte order.
+
+    The header and the offsets are always checked. Checking that the target states are valid
+    requires reading the whole file and is optional.
+    \param filename Name of the file
+    \param check_indices Whether to check that the target states of all transitions are valid
+    \throws invalid_argument When the file cannot be opened or is not a valid model of this type
+    */
+    static GCompiledRMDP load(const string& filename, bool check_indices = false);
+
+    // ----------------------------------------------
+    // Solution methods
+    // ----------------------------------------------
+
+    /**
+    Gauss-Seidel variant of value iteration (not parallelized).
+    See GRMDP::vi_gs for the description of the parameters.
+     */
+    SolType vi_gs(Uncertainty uncert,
+            prec_t discount,
+            numvec valuefunction = numvec(0),
+            unsigned long iterations = MAXITER,
+            prec_t maxresidual = SOLPREC) const;
+
+    /**
+    Jacobi variant of value iteration. This method uses OpenMP to parallelize the computation.
+    See GRMDP::vi_jac for the description of the parameters.
+     */
+    SolType vi_jac(Uncertainty uncert,
+            prec_t discount,
+            const numvec& valuefunction = numvec(0),
+            unsigned long iterations = MAXITER,
+            prec_t maxresidual = SOLPREC) const;
+
+    /**
+    Modified policy iteration using Jacobi value iteration in the inner loop.
+    See GRMDP::mpi_jac for the description of the parameters.
+     */
+    SolType mpi_jac(Uncertainty uncert,
+            prec_t discount,
+            const numvec& valuefunction = numvec(0),
+            unsigned long iterations_pi = MAXITER,
+            prec_t maxresidual_pi = SOLPREC,
+            unsigned long iterations_vi = MAXITER,
+            prec_t maxresidual_vi = SOLPREC / 2,
+            bool show_progress = false) const;
+
+    /**
+    Value function evaluation using Jacobi iteration for a fixed policy and nature.
+    See GRMDP::vi_jac_fix for the description of the parameters.
+     */
+    SolType vi_jac_fix(prec_t discount,
+            const ActionPolicy& policy,
+            const OutcomePolicy& natpolicy,
+            const numvec& valuefunction = numvec(0),
+            unsigned long iterations = MAXITER,
+            prec_t maxresidual = SOLPREC) const;
+
+protected:
+    /** Owns the memory of the arrays: either the vectors of a compiled model or a mapped file */
+    shared_ptr<const void> storage;
+
+    /** Index of the first action of each state; the last element is the number of actions */
+    OffsetArray state_offsets;
+    /** Index of the first outcome of each action; the last element is the number of outcomes */
+    OffsetArray action_offsets;
+    /** Index of the first transition of each outcome; the last element is the number of transitions */
+    OffsetArray outcome_offsets;
+
+    /** Target states of transitions */
+    ArrayView<idx_t> indices;
+    /** Probabilities of transitions */
+    StorageArray probabilities;
+    /** Rewards of transitions (empty if dropped during compilation) */
+    StorageArray rewards;
+    /** Expected immediate reward of each outcome */
+    StorageArray outcome_rewards;
+
+    /** Invalid actions (0) are skipped during computation */
+    ArrayView<uint8_t> action_valid;
+    /** Threshold for each action */
+    ArrayView<prec_t> thresholds;
+    /** Nominal weight of each outcome */
+    ArrayView<prec_t> weights;
+
+    /** Value of a single outcome; see Transition::compute_value */
+    prec_t outcome_value(size_t outcome, const numvec& valuefunction, prec_t discount) const;
+
+    /**
+    Selects the best or the worst discrete outcome of an action.
+    The last parameter only selects the overload.
+    See DiscreteOutcomeAction::maximal and DiscreteOutcomeAction::minimal
+    */
+    pair<long, prec_t> select_outcome(size_t action,
+            const numvec& valuefunction,
+            prec_t discount,
+            bool maximize,
+            long) const;
+    /**
+    Selects the best or the worst distribution over the outcomes of an action.
+    The last parameter only selects the overload.
+    See WeightedOutcomeAction::maximal and WeightedOutcomeAction::minimal
+    */
+    pair<numvec, prec_t> select_outcome(size_t action,
+            const numvec& valuefunction,
+            prec_t discount,
+            bool maximize,
+            const numvec&) const;
+
+    /** Best outcome of an action */
+    pair<OutcomeId, prec_t> action_maximal(size_t action, const numvec& valuefunction, prec_t discount) const;
+    /** Worst outcome of an action */
+    pair<OutcomeId, prec_t> action_minimal(size_t action, const numvec& valuefunction, prec_t discount) const;
+    /** Value of an action with respect to the nominal distribution of outcomes */
+    prec_t action_average(size_t action, const numvec& valuefunction, prec_t discount) const;
+    /** Value of an action for a fixed discrete outcome (ignored when there is a single outcome) */
+    prec_t action_fixed(size_t action, const numvec& valuefunction, prec_t discount, long outcomeid) const;
+    /** Value of an action for a fixed distribution over outcomes */
+    prec_t action_fixed(size_t action, const numvec& valuefunction, prec_t discount, const numvec& distribution) const;
+
+    /** Optimistic Bellman update of a state; see SAState::max_max */
+    tuple<ActionId, OutcomeId, prec_t> state_max_max(long stateid, const numvec& valuefunction, prec_t discount) const;
+    /** Robust Bellman update of a state; see SAState::max_min */
+    tuple<ActionId, OutcomeId, prec_t> state_max_min(long stateid, const numvec& valuefunction, prec_t discount) const;
+    /** Average Bellman update of a state; see SAState::max_average */
+    pair<ActionId, prec_t> state_max_average(long stateid, const numvec& valuefunction, prec_t discount) const;
+    /** Value of a fixed action and outcome; see SAState::fixed_fixed */
+    prec_t state_fixed_fixed(long stateid,
+            const numvec& valuefunction,
+            prec_t discount,
+            ActionId actionid,
+            const OutcomeId& outcomeid) const;
+    /** Value of a fixed action and the nominal outcome; see SAState::fixed_average */
+    prec_t state_fixed_average(long stateid, const numvec& valuefunction, prec_t discount, ActionId actionid) const;
+
+    /** Bellman update of a state with the type of uncertainty given by uncert */
+    tuple<ActionId, OutcomeId, prec_t> state_update(long stateid,
+            Uncertainty uncert,
+            const numvec& valuefunction,
+            prec_t discount) const;
+
+    /** Returns the global index of an action or throws an exception if invalid */
+    size_t checked_action(long stateid, ActionId actionid) const;
+};
+
+// **********************************************************************
+// *********************    TEMPLATE DECLARATIONS    ********************
+// **********************************************************************
+
+/** Compiled regular MDP; see craam::MDP */
+typedef GCompiledRMDP<RegularState> CompiledMDP;
+/** Compiled uncertain MDP with discrete robustness; see craam::RMDP_D */
+typedef GCompiledRMDP<DiscreteRobustState> CompiledRMDP_D;
+/** Compiled uncertain MDP with L1 constrained robustness; see craam::RMDP_L1 */
+typedef GCompiledRMDP<L1RobustState> CompiledRMDP_L1;
+
+/** Compiled regular MDP with single precision storage */
+typedef GCompiledRMDP<RegularState, float> CompiledMDP_F;
+/** Compiled uncertain MDP with discrete robustness and single precision storage */
+typedef GCompiledRMDP<DiscreteRobustState, float> CompiledRMDP_D_F;
+/** Compiled uncertain MDP with L1 constrained robustness and single precision storage */
+typedef GCompiledRMDP<L1RobustState, float> CompiledRMDP_L1_F;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace craam {
+
+using namespace std;
+
+/**
+A read-only view of the content of a file.
+
+On POSIX systems, the file is mapped to memory and the pages are loaded by the
+operating system on demand. On other systems, the content of the file is read to
+a buffer. In either case, the content is available as a contiguous array of
+characters that is valid as long as the object exists. The content is not
+terminated by a zero.
+
+The object can be moved but not copied.
+*/
+class MappedFile {
+public:
+    /** Constructs an empty view */
+    MappedFile() : content(nullptr), length(0){};
+
+    /**
+    Opens and maps the file.
+    \param filename Name of the file
+    \throws invalid_argument When the file cannot be opened or mapped
+    */
+    explicit MappedFile(const string& filename);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other);
+    MappedFile& operator=(MappedFile&& other);
+
+    ~MappedFile() { close(); };
+
+    /** Unmaps the file; the view is empty afterwards */
+    void close();
+
+    /** First character of the content */
+    const char* data() const { return content; };
+    /** Pointer past the last character of the content */
+    const char* end() const { return content + length; };
+    /** Number of characters (bytes) of the content */
+    size_t size() const { return length; };
+    /** Whether the content is empty */
+    bool empty() const { return length == 0; };
+
+protected:
+    /** Beginning of the content */
+    const char* content;
+    /** Length of the content */
+    size_t length;
+    /** Whether the content is mapped to memory, or read to the buffer */
+    bool mapped = false;
+    /** Holds the content when the file cannot be mapped */
+    vector<char> buffer;
+};
+}
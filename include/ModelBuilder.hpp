@@ -0,0 +1,113 @@
+#pragma once
+
+#include "RMDP.hpp"
+#include "definitions.hpp"
+
+#include <vector>
+
+namespace craam {
+
+using namespace std;
+
+// **************************************************************************************
+//  Bulk model builder
+// **************************************************************************************
+
+/**
+Collects transitions in bulk and then builds the model in a single pass.
+
+Adding transitions directly to a model (see craam::add_transition) inserts each
+sample in a sorted position of the transition. When the target states do not
+arrive in an increasing order, every insertion shifts the existing elements and
+building a transition with n targets takes O(n^2) time.
+
+The builder instead stores all the transitions (from, action, outcome, to, probability, reward)
+in a flat array. When the model is built, the transitions are grouped by the originating
+state, sorted, aggregated, and added to the model. The states are processed in
+parallel (using OpenMP).
+
+The model built by the builder is the same as the one obtained by calling
+craam::add_transition for each transition:
+    - All states, actions, and outcomes involved in the transitions are created
+    - Duplicate targets are aggregated: the probabilities are summed and the rewards are
+      averaged with weights proportional to the probabilities
+    - Transitions with zero probabilities are not added (but their states, actions, and outcomes are created)
+    - Transition probabilities are not normalized
+The only difference may be in the order in which floating point values are summed.
+ */
+class ModelBuilder {
+public:
+    /** A single transition */
+    struct Entry {
+        idx_t fromid;
+        idx_t actionid;
+        idx_t outcomeid;
+        idx_t toid;
+        prec_t probability;
+        prec_t reward;
+    };
+
+    /** Constructs an empty builder */
+    ModelBuilder(){};
+
+    /** Allocates memory for the given number of transitions */
+    void reserve(size_t count) { entries.reserve(count); };
+
+    /**
+    Adds a transition probability and reward for a particular outcome.
+    The arguments are checked immediately, in the same way as in Transition::add_sample.
+    \param fromid Starting state ID
+    \param actionid Action ID
+    \param outcomeid Outcome ID
+    \param toid Destination ID
+    \param probability Probability of the transition (must be non-negative)
+    \param reward The reward associated with the transition.
+    */
+    void add_transition(long fromid, long actionid, long outcomeid, long toid, prec_t probability, prec_t reward);
+
+    /**
+    Adds a transition probability and reward for a model with no outcomes.
+    See the other version of the method for the description of the parameters.
+    */
+    void add_transition(long fromid, long actionid, long toid, prec_t probability, prec_t reward) {
+        add_transition(fromid, actionid, 0l, toid, probability, reward);
+    };
+
+    /** Appends all transitions collected by another builder */
+    void append(const ModelBuilder& other) { entries.insert(entries.end(), other.entries.begin(), other.entries.end()); };
+
+    /** Number of collected transitions */
+    size_t size() const { return entries.size(); };
+
+    /** Whether there are no transitions */
+    bool empty() const { return entries.empty(); };
+
+    /** Removes all collected transitions */
+    void clear() { entries.clear(); };
+
+    /** Collected transitions in the order in which they were added */
+    const vector<Entry>& get_entries() const { return entries; };
+
+    /**
+    Adds the collected transitions to the model. The model may already contain
+    states and transitions, in which case the new transitions are added to the existing ones.
+    The builder is not modified and can be used to build more models.
+    \param mdp Model to add the transitions to (also returned)
+    \returns The input model
+    */
+    template <class Model>
+    Model& build(Model& mdp) const;
+
+    /** Builds a new model from the collected transitions. */
+    template <class Model>
+    Model build() const {
+        Model mdp;
+        build(mdp);
+        return mdp;
+    }
+
+protected:
+    /** Collected transitions */
+    vector<Entry> entries;
+};
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "State.hpp"
+#include "krylov.hpp"
 
 #include <cassert>
 #include <fstream>
@@ -31,32 +32,171 @@ enum class Uncertainty {
     Average = 2
 };
 
+/**
+Describes how the states are partitioned into blocks by the parallel Gauss-Seidel
+value iteration (GRMDP::vi_gs_par).
+*/
+enum class BlockPartition {
+    /// Color the transition graph so that states of the same color do not depend on each other
+    Coloring = 0,
+    /// Split the states into contiguous ranges
+    Ranges = 1
+};
+
+/**
+Describes how modified policy iteration (GRMDP::mpi_jac) evaluates the fixed policy
+in its inner loop.
+*/
+enum class PolicyEvaluation {
+    /// Jacobi value iteration with the fixed policy
+    ValueIteration = 0,
+    /// BiCGSTAB with the diagonal (Jacobi) preconditioner
+    KrylovJacobi = 1,
+    /// BiCGSTAB with the incomplete LU preconditioner
+    KrylovILU0 = 2
+};
+
+/**
+Describes when value iteration terminates.
+*/
+enum class StoppingRule {
+    /// Stop when the maximal absolute change of the value function is small
+    Residual = 0,
+    /// Stop when the span seminorm of the change (maximal minus minimal change) is
+    /// small, and return the value function corrected by MacQueen's bounds. The span
+    /// stops vi_jac and mpi_jac earlier than the residual; vi_gs only computes the
+    /// bounds (see vi_gs).
+    Span = 1
+};
+
 // **************************************************************************************
 //  Generic MDP Class
 // **************************************************************************************
 
+template <class SType, class Storage = prec_t>
+class GCompiledRMDP;
+
+/**
+Distributions of different lengths stored in one contiguous array: distribution i
+is values[offsets[i]], ..., values[offsets[i+1]-1]. It stores randomized policies
+of nature without an allocation for each state, and the distributions are copied
+or saved by copying the two arrays.
+
+Accessing a distribution returns a read-only view, which is converted to numvec
+when it is passed to the methods of the actions.
+*/
+class DistributionArray {
+public:
+    /** Read-only view of a single distribution */
+    class View {
+    public:
+        View(const prec_t* first, const prec_t* last) : first(first), last(last){};
+
+        const prec_t* begin() const { return first; };
+        const prec_t* end() const { return last; };
+        size_t size() const { return size_t(last - first); };
+        bool empty() const { return first == last; };
+        prec_t operator[](size_t index) const { return first[index]; };
+
+        /** Copies the distribution */
+        operator numvec() const { return numvec(first, last); };
+
+    protected:
+        const prec_t* first;
+        const prec_t* last;
+    };
+
+    /** Creates an array with no distributions */
+    DistributionArray() : offsets(1, 0), values(0){};
+
+    /** Creates an array with count empty distributions */
+    explicit DistributionArray(size_t count) : offsets(count + 1, 0), values(0){};
+
+    /**
+    Copies the distributions. The conversion is implicit so that the array can be
+    used in place of a vector of distributions.
+    */
+    DistributionArray(const vector<numvec>& distributions);
+
+    /**
+    Constructs the array from its contiguous representation.
+    \param offsets Index of the first element of each distribution; the last
+            element is the total number of values
+    \param values Values of all the distributions
+    */
+    DistributionArray(vector<size_t> offsets, numvec values);
+
+    /** Number of the distributions */
+    size_t size() const { return offsets.size() - 1; };
+
+    /** Whether there are no distributions */
+    bool empty() const { return size() == 0; };
+
+    /** Distribution with the given index */
+    View operator[](size_t index) const {
+        assert(index < size());
+        return View(values.data() + offsets[index], values.data() + offsets[index + 1]);
+    };
+
+    /** Modifiable values of the distribution with the given index */
+    prec_t* data(size_t index) { return values.data() + offsets[index]; };
+
+    /** Index of the first element of each distribution, and the total size */
+    const vector<size_t>& get_offsets() const { return offsets; };
+
+    /** Values of all the distributions */
+    const numvec& get_values() const { return values; };
+
+    /** Copies the distributions to separate vectors */
+    vector<numvec> to_vectors() const;
+
+    /** Copies the distributions to separate vectors */
+    operator vector<numvec>() const { return to_vectors(); };
+
+protected:
+    vector<size_t> offsets;
+    numvec values;
+};
+
+/** Storage of nature's policy in a solution: a vector, except that distributions are stored contiguously */
+template <typename OutcomeId>
+struct OutcomeArray {
+    typedef vector<OutcomeId> type;
+};
+template <>
+struct OutcomeArray<numvec> {
+    typedef DistributionArray type;
+};
+
 /** A solution to a robust MDP.  */
 template <typename ActionId, typename OutcomeId>
 class GSolution {
 public:
     numvec valuefunction;
     vector<ActionId> policy; // index of the actions for each states
-    vector<OutcomeId> outcomes; // index of the outcome for each state
+    typename OutcomeArray<OutcomeId>::type outcomes; // index of the outcome for each state
     prec_t residual;
     long iterations;
+    /// Lower bound on the optimal value function; empty when not computed
+    numvec lowerbound;
+    /// Upper bound on the optimal value function; empty when not computed
+    numvec upperbound;
+    /// Maximal difference between the upper and lower bounds; -1 when not computed
+    prec_t gap;
 
-    GSolution() : valuefunction(0), policy(0), outcomes(0), residual(-1), iterations(-1){};
+    GSolution() : valuefunction(0), policy(0), outcomes(0), residual(-1), iterations(-1), gap(-1){};
 
     GSolution(numvec const& valuefunction,
             const vector<ActionId>& policy,
-            const vector<OutcomeId>& outcomes,
+            typename OutcomeArray<OutcomeId>::type outcomes,
             prec_t residual = -1,
             long iterations = -1)
             : valuefunction(valuefunction),
               policy(policy),
-              outcomes(outcomes),
+              outcomes(move(outcomes)),
               residual(residual),
-              iterations(iterations){};
+              iterations(iterations),
+              gap(-1){};
 
     /**
     Computes the total return of the solution given the initial
@@ -73,6 +213,85 @@ public:
     };
 };
 
+/**
+A solution to a finite-horizon robust MDP with a policy that depends on the time.
+The decisions are made at times 0, ..., horizon-1, and the decisions of all
+states at time t are stored together.
+*/
+template <typename ActionId, typename OutcomeId>
+class GFiniteSolution {
+public:
+    /// Value function at time 0
+    numvec valuefunction;
+    /// Actions of all times: the action of state s at time t is at t * states + s
+    vector<ActionId> policy;
+    /// Outcomes of all times in the same layout as the policy (see OutcomeArray)
+    typename OutcomeArray<OutcomeId>::type outcomes;
+    /// Value functions at times 0, ..., horizon in the same layout; empty unless requested
+    numvec stagevalues;
+    /// Number of decision times
+    size_t horizon;
+    /// Number of states
+    size_t states;
+
+    GFiniteSolution() : valuefunction(0), policy(0), outcomes(0), stagevalues(0), horizon(0), states(0){};
+
+    GFiniteSolution(size_t horizon, size_t states)
+            : valuefunction(0),
+              policy(horizon * states),
+              outcomes(horizon * states),
+              stagevalues(0),
+              horizon(horizon),
+              states(states){};
+
+    /** Action taken in the state at the time */
+    ActionId action(size_t time, size_t stateid) const { return policy[time * states + stateid]; };
+
+    /** Outcome chosen by nature in the state at the time; a view of a distribution */
+    auto outcome(size_t time, size_t stateid) const -> decltype(outcomes[0]) {
+        return outcomes[time * states + stateid];
+    };
+
+    /** Value of the state at the time; requires the stage values */
+    prec_t value(size_t time, size_t stateid) const {
+        if (stagevalues.empty())
+            throw invalid_argument("The values of the stages were not stored.");
+        return stagevalues[time * states + stateid];
+    };
+};
+
+/**
+Sparse adjacency of states in the compressed sparse row format. The neighbors of
+state s are indices[offsets[s]], ..., indices[offsets[s+1]-1]; they are sorted and
+contain no duplicates.
+*/
+struct StateAdjacency {
+    /// Position of the first neighbor of each state; has one more element than states
+    vector<size_t> offsets;
+    /// Neighbors of all states
+    indvec indices;
+
+    /** Number of states */
+    size_t state_count() const { return offsets.empty() ? 0 : offsets.size() - 1; };
+    /** First neighbor of the state */
+    const idx_t* begin(size_t stateid) const { return indices.data() + offsets[stateid]; };
+    /** Pointer past the last neighbor of the state */
+    const idx_t* end(size_t stateid) const { return indices.data() + offsets[stateid + 1]; };
+};
+
+/**
+Computes the strongly connected components of a graph with Tarjan's algorithm
+(without recursion).
+
+The components are numbered in reverse topological order: there is no edge
+from a component to a component with a larger number. In particular, component
+0 has no edges to other components.
+
+\param graph Edges of the graph
+\returns Component of each state
+*/
+indvec strong_components(const StateAdjacency& graph);
+
 /**
 A general robust Markov decision process. Contains methods for constructing and solving RMDPs.
 
@@ -88,6 +307,10 @@ Some general assumptions (may depend on the state and action classes):
     - Invalid actions are ignored
     - Behavior for a state with all invalid actions is not defined
 
+The sweeps of value iteration (vi_gs, vi_gs_par, vi_jac, vi_scc) compute only the
+values of nature's responses. The outcomes in the solution are computed in one pass
+after the last sweep, as the responses to the final policy for the final value function.
+
 \tparam SType Type of state, determines s-rectangularity or s,a-rectangularity and
         also the type of the outcome and action constraints
  */
@@ -97,6 +320,12 @@ protected:
     /** Internal list of states */
     vector<SType> states;
 
+    /**
+    Whether each state may have been modified since the last incremental solve. Bytes
+    rather than bits, so that states can be marked concurrently.
+    */
+    vector<uint8_t> dirty;
+
 public:
     /** Action identifier in a policy. Copies type from state type. */
     typedef typename SType::ActionId ActionId;
@@ -105,10 +334,12 @@ public:
 
     /** Decision-maker's policy: Which action to take in which state.  */
     typedef vector<ActionId> ActionPolicy;
-    /** Nature's policy: Which outcome to take in which state.  */
-    typedef vector<OutcomeId> OutcomePolicy;
+    /** Nature's policy: Which outcome to take in which state (see OutcomeArray).  */
+    typedef typename OutcomeArray<OutcomeId>::type OutcomePolicy;
     /** Solution type */
     typedef GSolution<typename SType::ActionId, typename SType::OutcomeId> SolType;
+    /** Finite-horizon solution type */
+    typedef GFiniteSolution<typename SType::ActionId, typename SType::OutcomeId> FiniteSolType;
 
     /**
     Constructs the RMDP with a pre-allocated number of states. All
@@ -117,14 +348,14 @@ public:
                         increases as more transitions are added. All initial
                         states are terminal.
     */
-    GRMDP(long state_count) : states(state_count){};
+    GRMDP(long state_count) : states(state_count), dirty(state_count, 1){};
 
     /** Constructs an empty RMDP. */
     GRMDP(){};
 
     /**
     Assures that the MDP state exists and if it does not, then it is created.
-    States with intermediate ids are also created
+    States with intermediate ids are also created. The state is marked as dirty.
     \return The new state
     */
     SType& create_state(long stateid);
@@ -150,18 +381,33 @@ public:
     /** Retrieves an existing state */
     const SType& operator[](long stateid) const { return get_state(stateid); };
 
-    /** Retrieves an existing state */
+    /**
+    Retrieves an existing state for modification; the state is marked as dirty
+    (see vi_incremental).
+    */
     SType& get_state(long stateid) {
         assert(stateid >= 0 && size_t(stateid) < state_count());
+        dirty[stateid] = 1;
         return states[stateid];
     };
 
-    /** Retrieves an existing state */
+    /** Retrieves an existing state for modification; see get_state */
     SType& operator[](long stateid) { return get_state(stateid); };
 
     /** \returns list of all states */
     const vector<SType>& get_states() const { return states; };
 
+    /**
+    States that may have been modified since the last call to vi_incremental or
+    clear_dirty. A state is marked as dirty when it is created or accessed through a
+    non-const method, such as when adding a transition or changing a reward.
+    \returns Sorted list of dirty states
+    */
+    indvec dirty_states() const;
+
+    /** Marks all states as unmodified, for example after computing a solution from scratch */
+    void clear_dirty() { fill(dirty.begin(), dirty.end(), 0); };
+
     /**
     Check if all transitions in the process sum to one.
     Note that if there are no actions, or no outcomes for a state,
@@ -186,6 +432,26 @@ public:
             const ActionPolicy& policy,
             const OutcomePolicy& nature) const;
 
+    /**
+    Computes occupancy frequencies by solving the sparse linear system
+    (I - discount P^T) d = alpha with the BiCGSTAB method preconditioned by the
+    incomplete LU factorization. The memory and the time of each iteration are linear
+    in the number of transitions, so this method scales to large state spaces.
+    The result is the same as of ofreq_mat.
+    \param init Initial distribution (alpha)
+    \param discount Discount factor (gamma)
+    \param policy Policy of the decision maker
+    \param nature Policy of nature
+    \param iterations Maximal number of Krylov iterations
+    \param maxresidual Stop when the maximal residual of the equations drops below this value
+    */
+    numvec ofreq_sparse(const Transition& init,
+            prec_t discount,
+            const ActionPolicy& policy,
+            const OutcomePolicy& nature,
+            unsigned long iterations = MAXITER,
+            prec_t maxresidual = 1e-10) const;
+
     /**
     Constructs the rewards vector for each state for the RMDP.
     \param policy Policy of the decision maker
@@ -193,6 +459,18 @@ public:
      */
     numvec rewards_state(const ActionPolicy& policy, const OutcomePolicy& nature) const;
 
+    /**
+    Constructs the states that can be reached from each state in one step with
+    any action and outcome (including transitions with zero probability).
+    */
+    StateAdjacency successors() const;
+
+    /**
+    Constructs the states from which each state can be reached in one step with
+    any action and outcome; the reverse of successors.
+    */
+    StateAdjacency predecessors() const;
+
     /**
     Checks if the policy and nature's policy are both correct.
     Action and outcome can be arbitrary for terminal states.
@@ -215,13 +493,156 @@ public:
 
     Because this function updates the array value during the iteration, it may be
     difficult to paralelize easily.
+
+    When a mask of eliminated actions is provided, actions that provably cannot be
+    optimal are eliminated after each sweep and skipped afterwards. An action is
+    eliminated when its value computed with an upper bound on the optimal value function
+    is below a lower bound on the optimal value of the state. The bounds follow from
+    the contraction of the Bellman operator (see vi_jac). The elimination is only
+    performed when the transition probabilities are normalized and the discount is
+    less than 1.
+
+    With the span stopping rule, let d be the change of the value function in the last
+    sweep. Because a sweep is monotone and a contraction, the optimal value function
+    is bounded by
+        v + discount/(1-discount) min(d,0) <= v* <= v + discount/(1-discount) max(d,0).
+    The computation stops when max(d,0) - min(d,0) falls below maxresidual, and the
+    returned value function is the midpoint of the bounds. Unlike in vi_jac, the bounds
+    must include 0, because the states updated earlier in a sweep change the values of
+    the later ones. The span is therefore at least the residual, and the span rule never
+    saves sweeps in vi_gs; it only adds the bounds and the gap to the solution.
+
     \param uncert Type of realization of the uncertainty
     \param discount Discount factor.
     \param valuefunction Initial value function. Passed by value, because it is modified.
     \param iterations Maximal number of iterations to run
-    \param maxresidual Stop when the maximal residual falls below this value.
+    \param maxresidual Stop when the maximal residual (or the span) falls below this value.
+    \param eliminated Actions that have been eliminated (updated), or nullptr to consider all
+            actions. An empty mask is initialized for the model. The mask may be reused in
+            later computations with the same model, discount, and type of uncertainty.
+    \param stopping Stopping rule; the span rule also computes the bounds and the gap
+            of the solution and requires normalized transition probabilities and a
+            discount less than 1
      */
     SolType vi_gs(Uncertainty uncert,
+            prec_t discount,
+            numvec valuefunction = numvec(0),
+            unsigned long iterations = MAXITER,
+            prec_t maxresidual = SOLPREC,
+            ActionMask* eliminated = nullptr,
+            StoppingRule stopping = StoppingRule::Residual) const;
+
+    /**
+    Parallel block Gauss-Seidel variant of value iteration. This method uses OpenMP to
+    parallelize the computation.
+
+    The states are partitioned into blocks and the blocks are colored so that no two
+    blocks with the same color have transitions to each other's states. Each sweep
+    processes the colors one after another; the blocks of one color are updated in
+    parallel and each block is swept in place using the latest values, like in vi_gs.
+    Updates from other blocks become visible once their color has been processed.
+
+    With BlockPartition::Coloring, the blocks consist of states of the same color, so the
+    method is a multicolor Gauss-Seidel iteration. With BlockPartition::Ranges, the blocks
+    are contiguous ranges of states, which preserves the ordering of states within
+    each block and works well for models with mostly local transitions (e.g. chains).
+    When many blocks depend on each other, the number of colors grows and the
+    computation becomes more sequential.
+
+    The result does not depend on the number of threads, unless block_size is 0 and
+    the partition is BlockPartition::Ranges.
+
+    \param uncert Type of realization of the uncertainty
+    \param discount Discount factor.
+    \param valuefunction Initial value function. Passed by value, because it is modified.
+    \param iterations Maximal number of iterations to run
+    \param maxresidual Stop when the maximal residual falls below this value.
+    \param partition How to partition the states into blocks
+    \param block_size Maximal number of states in a block; 0 selects the size automatically
+     */
+    SolType vi_gs_par(Uncertainty uncert,
+            prec_t discount,
+            numvec valuefunction = numvec(0),
+            unsigned long iterations = MAXITER,
+            prec_t maxresidual = SOLPREC,
+            BlockPartition partition = BlockPartition::Coloring,
+            size_t block_size = 0) const;
+
+    /**
+    Asynchronous value iteration with prioritized sweeping.
+
+    The method backs up one state at a time, always the one with the largest bound
+    on its Bellman residual. When the value of a state changes by delta, the bounds of
+    its predecessors increase by discount * |delta|, because the Bellman operator is a
+    contraction. The computation stops when all the bounds drop below maxresidual.
+    States in regions that have already converged are therefore not backed up again.
+
+    After the computation, the policy and the residual are computed for all states
+    from the final value function.
+
+    \param uncert Type of realization of the uncertainty
+    \param discount Discount factor.
+    \param valuefunction Initial value function. Passed by value, because it is modified.
+    \param backups Maximal number of backups of individual states (unlimited by default)
+    \param maxresidual Stop when the bounds on all residuals fall below this value.
+    \returns Solution; the number of iterations is the number of state backups
+     */
+    SolType vi_prioritized(Uncertainty uncert,
+            prec_t discount,
+            numvec valuefunction = numvec(0),
+            unsigned long backups = numeric_limits<unsigned long>::max(),
+            prec_t maxresidual = SOLPREC) const;
+
+    /**
+    Incrementally updates a solution after the model has been modified.
+
+    The values of the previous solution are used as the initial values. Only the states
+    that have been modified since the last incremental solve (see dirty_states) and
+    their predecessors are backed up initially; the changes are then propagated to the
+    predecessors by prioritized sweeping as in vi_prioritized. The residuals of the
+    other states are assumed to be bounded by the residual of the previous solution.
+    States that have been added since the previous solution start with the value 0.
+
+    The dirty states are cleared after the computation. When the previous solution is
+    computed from scratch, call clear_dirty beforehand so that the next incremental solve
+    only processes subsequent modifications.
+
+    \param uncert Type of realization of the uncertainty
+    \param discount Discount factor
+    \param previous Previous solution; when its residual is unknown (negative) or larger
+            than maxresidual, or when its values were corrected by the span stopping
+            rule, all states are backed up initially
+    \param backups Maximal number of backups of individual states (unlimited by default)
+    \param maxresidual Stop when the bounds on all residuals fall below this value
+    \returns Solution; the number of iterations is the number of state backups
+    */
+    SolType vi_incremental(Uncertainty uncert,
+            prec_t discount,
+            const SolType& previous,
+            unsigned long backups = numeric_limits<unsigned long>::max(),
+            prec_t maxresidual = SOLPREC);
+
+    /**
+    Value iteration that decomposes the model into strongly connected components.
+
+    The components of the graph induced by all actions and outcomes are solved in
+    reverse topological order, so that the values of all states that a component
+    can reach are final when it is being solved. Components that do not depend on
+    each other (the same distance from the sinks) are solved in parallel. Each
+    component is solved by Gauss-Seidel value iteration until the residual drops
+    below maxresidual; a state without a self-loop, which forms its own component,
+    requires only a single backup. Acyclic models are therefore solved exactly with
+    one backup per state.
+
+    \param uncert Type of realization of the uncertainty
+    \param discount Discount factor.
+    \param valuefunction Initial value function. Passed by value, because it is modified.
+    \param iterations Maximal number of iterations to run for each component
+    \param maxresidual Stop when the maximal residual in a component falls below this value.
+    \returns Solution; the number of iterations is the largest number of iterations
+            of any component
+     */
+    SolType vi_scc(Uncertainty uncert,
             prec_t discount,
             numvec valuefunction = numvec(0),
             unsigned long iterations = MAXITER,
@@ -229,23 +650,125 @@ public:
 
     /**
     Jacobi variant of value iteration. This method uses OpenMP to parallelize the computation.
+
+    When a mask of eliminated actions is provided, actions that provably cannot be
+    optimal are eliminated after each iteration and skipped afterwards. With v the
+    value function and Tv its Bellman update, MacQueen's bounds on the optimal value
+    function are
+        Tv + discount/(1-discount) min(Tv - v) <= v* <= v + 1/(1-discount) max(Tv - v).
+    An action is eliminated when its value computed with the upper bound is smaller
+    than the lower bound of the state. The elimination is only performed when the
+    transition probabilities are normalized and the discount is less than 1.
+
+    With the span stopping rule, the computation stops when the span seminorm
+    max(Tv - v) - min(Tv - v) falls below maxresidual. The greedy policy depends only
+    on the span, which is often much smaller than the residual. The bounds
+        Tv + discount/(1-discount) min(Tv - v) <= v* <= Tv + discount/(1-discount) max(Tv - v)
+    are stored in the solution, and the returned value function is their midpoint.
+    In models with terminal states, the minimum and maximum also include 0.
+
     \param uncert Type of realization of the uncertainty
     \param valuefunction Initial value function.
     \param discount Discount factor.
     \param iterations Maximal number of iterations to run
-    \param maxresidual Stop when the maximal residual falls below this value.
+    \param maxresidual Stop when the maximal residual (or the span) falls below this value.
+    \param eliminated Actions that have been eliminated (updated), or nullptr to consider all
+            actions. An empty mask is initialized for the model. The mask may be reused in
+            later computations with the same model, discount, and type of uncertainty.
+    \param stopping Stopping rule; the span rule also computes the bounds and the gap
+            of the solution and requires normalized transition probabilities and a
+            discount less than 1
      */
     SolType vi_jac(Uncertainty uncert,
             prec_t discount,
             const numvec& valuefunction = numvec(0),
             unsigned long iterations = MAXITER,
+            prec_t maxresidual = SOLPREC,
+            ActionMask* eliminated = nullptr,
+            StoppingRule stopping = StoppingRule::Residual) const;
+
+    /**
+    Jacobi value iteration for several configurations of the parameters at once. This
+    method uses OpenMP to parallelize the computation.
+
+    The value functions of all configurations are stored side by side for each state,
+    so that a single pass over the indices, probabilities, and rewards of each
+    transition updates all of them. Each configuration stops independently when its
+    residual drops below maxresidual, and the remaining configurations continue.
+    The result of each configuration is the same as of vi_jac with its parameters.
+
+    \param uncert Type of realization of the uncertainty
+    \param discounts Discount factor of each configuration
+    \param thresholds Threshold of each configuration, which replaces the thresholds
+            of all actions (see set_outcome_thresholds); empty to use the thresholds of
+            the actions. Only models with thresholds (such as RMDP_L1) support them.
+    \param iterations Maximal number of iterations to run
+    \param maxresidual Stop when the maximal residual falls below this value.
+    \returns Solution of each configuration
+     */
+    vector<SolType> vi_jac_sweep(Uncertainty uncert,
+            const numvec& discounts,
+            const numvec& thresholds = numvec(0),
+            unsigned long iterations = MAXITER,
             prec_t maxresidual = SOLPREC) const;
 
+    /**
+    Solves a finite-horizon problem by backward induction. This method uses OpenMP to
+    parallelize the computation.
+
+    The method computes exactly horizon Bellman updates of all states, starting from
+    the terminal value function at time horizon, and records the decisions at each
+    time. Only two value functions are kept in memory unless the values of all stages
+    are requested.
+
+    \param uncert Type of realization of the uncertainty
+    \param discount Discount factor (may be 1)
+    \param horizon Number of decision times
+    \param terminalvalue Value function at time horizon; empty to use zeros
+    \param store_values Whether to store the value functions of all times
+    \returns Solution with a policy that depends on the time
+     */
+    FiniteSolType finite_horizon(Uncertainty uncert,
+            prec_t discount,
+            size_t horizon,
+            const numvec& terminalvalue = numvec(0),
+            bool store_values = false) const;
+
+    /**
+    Jacobi value iteration with Anderson acceleration. This method uses OpenMP to
+    parallelize the computation.
+
+    The method keeps the differences of the last `memory` iterates and their Bellman
+    updates. Each step extrapolates from the Bellman updates with the weights that
+    minimize the (L2 norm of the) combined residual. When an extrapolated step
+    increases the Bellman residual, the method falls back to a plain Bellman step and
+    discards the history. With memory 0, the method is the same as vi_jac.
+
+    \param uncert Type of realization of the uncertainty
+    \param discount Discount factor.
+    \param valuefunction Initial value function.
+    \param iterations Maximal number of iterations (Bellman updates of all states) to run
+    \param maxresidual Stop when the maximal residual falls below this value.
+    \param memory Number of the previous iterates used to extrapolate
+     */
+    SolType vi_anderson(Uncertainty uncert,
+            prec_t discount,
+            const numvec& valuefunction = numvec(0),
+            unsigned long iterations = MAXITER,
+            prec_t maxresidual = SOLPREC,
+            unsigned int memory = 5) const;
+
     /**
     Modified policy iteration using Jacobi value iteration in the inner loop.
     This method generalizes modified policy iteration to robust MDPs.
     In the value iteration step, both the action *and* the outcome are fixed.
 
+    The fixed policy is evaluated either by Jacobi value iteration, which converges
+    at the rate of the discount factor, or by solving the linear system
+    (I - discount P) v = r with a preconditioned Krylov method (see policy_system),
+    which is preferable when the discount factor is close to 1. The Krylov methods
+    stop when the Bellman residual of the fixed policy drops below maxresidual_vi.
+
     Note that the total number of iterations will be bounded by iterations_pi * iterations_vi
     \param uncert Type of realization of the uncertainty
     \param discount Discount factor
@@ -256,6 +779,11 @@ public:
     \param maxresidual_vi Stop the inner policy iteration when the residual drops below this threshold.
                 This value should be smaller than maxresidual_pi
     \param show_progress Whether to report on progress during the computation
+    \param evaluation Method used to evaluate the policy in the inner loop
+    \param eliminated Actions that have been eliminated (updated), or nullptr to consider all
+            actions in the policy improvement step; see vi_jac.
+    \param stopping Stopping rule of the outer loop, applied to the policy improvement
+            step as in vi_jac
     \return Computed (approximate) solution
      */
     SolType mpi_jac(Uncertainty uncert,
@@ -265,7 +793,10 @@ public:
             prec_t maxresidual_pi = SOLPREC,
             unsigned long iterations_vi = MAXITER,
             prec_t maxresidual_vi = SOLPREC / 2,
-            bool show_progress = false) const;
+            bool show_progress = false,
+            PolicyEvaluation evaluation = PolicyEvaluation::ValueIteration,
+            ActionMask* eliminated = nullptr,
+            StoppingRule stopping = StoppingRule::Residual) const;
 
     /**
     Value function evaluation using Jacobi iteration for a fixed policy.
@@ -286,6 +817,46 @@ public:
             unsigned long iterations = MAXITER,
             prec_t maxresidual = SOLPREC) const;
 
+    /**
+    Value function evaluation for a fixed policy and nature by solving the linear
+    system (I - discount P) v = r with the preconditioned BiCGSTAB method. This is an
+    alternative to vi_jac_fix that converges much faster when the discount factor is
+    close to 1.
+    \param discount Discount factor
+    \param policy Decision-maker's policy
+    \param natpolicy Nature's policy
+    \param valuefunction Initial value function
+    \param iterations Maximal number of Krylov iterations
+    \param maxresidual Stop when the Bellman residual of the policy drops below this threshold.
+    \param preconditioner Preconditioner of the linear system
+    \return Computed (approximate) solution (value function)
+     */
+    SolType krylov_fix(prec_t discount,
+            const ActionPolicy& policy,
+            const OutcomePolicy& natpolicy,
+            const numvec& valuefunction = numvec(0),
+            unsigned long iterations = MAXITER,
+            prec_t maxresidual = SOLPREC,
+            Preconditioner preconditioner = Preconditioner::ILU0) const;
+
+    /**
+    Constructs the sparse linear system (I - discount P) v = r whose solution is the
+    value function of the policy. Here P and r are the transition probabilities and
+    the expected rewards of the policy and nature. Terminal states have a zero value.
+    \param discount Discount factor
+    \param policy Decision-maker's policy
+    \param natpolicy Nature's policy; ignored when averaging
+    \param rewards Output of the expected rewards r
+    \param average Whether to average over the outcomes (like fixed_average) instead of
+                using the nature's policy
+    \return The matrix I - discount P
+    */
+    SparseMatrix policy_system(prec_t discount,
+            const ActionPolicy& policy,
+            const OutcomePolicy& natpolicy,
+            numvec& rewards,
+            bool average = false) const;
+
     // TODO: a function like this could be useful
     /*
     Value function evaluation using Jacobi iteration for a fixed policy
@@ -320,6 +891,15 @@ public:
     */
     unique_ptr<ublas::matrix<prec_t>> transition_mat_t(const ActionPolicy& policy, const OutcomePolicy& nature) const;
 
+    /**
+    Compiles the model to a flat representation that is faster to solve.
+    The compiled model is a copy and does not reflect subsequent changes to this model.
+    See GCompiledRMDP.
+    \param keep_rewards Whether to store the rewards of individual transitions
+            in the compiled model; the solvers only need the expected rewards
+    */
+    GCompiledRMDP<SType> compile(bool keep_rewards = true) const;
+
     // ----------------------------------------------
     // Reading and writing files
     // ----------------------------------------------
@@ -391,8 +971,21 @@ An uncertain MDP with L1 constrained robustness. See craam::L1RobustState.
 */
 typedef GRMDP<L1RobustState> RMDP_L1;
 
+/**
+An uncertain MDP with s-rectangular L1 constrained robustness, in which the actions
+of a state share the threshold. See craam::L1SRobustState.
+
+    ActionId = numvec (distribution over the actions)
+    OutcomeId = numvec (outcome distributions of all the actions)
+
+The model cannot be compiled, and vi_jac_sweep is not supported.
+*/
+typedef GRMDP<L1SRobustState> RMDP_SL1;
+
 /// Solution with discrete action and outcome policies
-typedef GSolution<long, long> SolutionDscDsc;
+typedef GSolution<idx_t, idx_t> SolutionDscDsc;
 /// Solution with discrete action and randomized outcome policy
-typedef GSolution<long, numvec> SolutionDscProb;
+typedef GSolution<idx_t, numvec> SolutionDscProb;
+/// Solution with randomized action and outcome policies
+typedef GSolution<numvec, numvec> SolutionProbProb;
 }
@@ -191,9 +191,9 @@ Samples<typename Sim::State, typename Sim::Action> make_samples(U&&... u) {
 // **********************************************************************
 
 /** Samples in which the states and actions are identified by integers. */
-using DiscreteSamples = Samples<long, long>;
+using DiscreteSamples = Samples<idx_t, idx_t>;
 /** Integral expectation sample */
-using DiscreteSample = Sample<long, long>;
+using DiscreteSample = Sample<idx_t, idx_t>;
 
 /**
 Turns arbitrary samples to discrete ones assuming that actions are
@@ -255,11 +255,11 @@ public:
     }
 
     /** Returns a state index, and creates a new one if it does not exists */
-    long add_state(const State& dstate) {
+    idx_t add_state(const State& dstate) {
         auto iter = state_map.find(dstate);
-        long index;
+        idx_t index;
         if (iter == state_map.end()) {
-            index = state_map.size();
+            index = checked_index(state_map.size());
             state_map[dstate] = index;
         } else {
             index = iter->second;
@@ -268,11 +268,11 @@ public:
     }
 
     /** Returns a action index, and creates a new one if it does not exists */
-    long add_action(const Action& action) {
+    idx_t add_action(const Action& action) {
         auto iter = action_map.find(action);
-        long index;
+        idx_t index;
         if (iter == action_map.end()) {
-            index = action_map.size();
+            index = checked_index(action_map.size());
             action_map[action] = index;
         } else {
             index = iter->second;
@@ -286,8 +286,8 @@ public:
 protected:
     shared_ptr<DiscreteSamples> discretesamples;
 
-    unordered_map<Action, long, AHash> action_map;
-    unordered_map<State, long, SHash> state_map;
+    unordered_map<Action, idx_t, AHash> action_map;
+    unordered_map<State, idx_t, SHash> state_map;
 };
 
 /**
@@ -351,11 +351,11 @@ public:
     }
 
     /** Returns a state index, and creates a new one if it does not exists */
-    long add_state(const State& dstate) {
+    idx_t add_state(const State& dstate) {
         auto iter = state_map.find(dstate);
-        long index;
+        idx_t index;
         if (iter == state_map.end()) {
-            index = state_map.size();
+            index = checked_index(state_map.size());
             state_map[dstate] = index;
         } else {
             index = iter->second;
@@ -364,10 +364,10 @@ public:
     }
 
     /** Returns an action index, and creates a new one if it does not exists */
-    long add_action(const State& dstate, const Action& action) {
+    idx_t add_action(const State& dstate, const Action& action) {
         auto da = make_pair(dstate, action);
         auto iter = action_map.find(da);
-        long index;
+        idx_t index;
         if (iter == action_map.end()) {
             index = (action_count[dstate]++);
             action_map[da] = index;
@@ -383,11 +383,11 @@ public:
 protected:
     shared_ptr<DiscreteSamples> discretesamples;
 
-    unordered_map<pair<State, Action>, long, SAHash> action_map;
+    unordered_map<pair<State, Action>, idx_t, SAHash> action_map;
 
     /** keeps the number of actions for each state */
-    unordered_map<State, long, SHash> action_count;
-    unordered_map<State, long, SHash> state_map;
+    unordered_map<State, idx_t, SHash> action_count;
+    unordered_map<State, idx_t, SHash> state_map;
 };
 
 /**
@@ -365,9 +365,9 @@ Any state with an index higher or equal to the number of states is considered to
 class ModelSimulator {
 public:
     /// Type of states
-    typedef long State;
+    typedef idx_t State;
     /// Type of actions
-    typedef long Action;
+    typedef idx_t Action;
 
     /**
     Build a model simulator and share and MDP
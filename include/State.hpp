@@ -2,6 +2,7 @@
 
 #include "Action.hpp"
 
+#include <cstdint>
 #include <stdexcept>
 #include <tuple>
 #include <utility>
@@ -11,6 +12,69 @@ using namespace std;
 
 namespace craam {
 
+// **************************************************************************************
+//  Action mask
+// **************************************************************************************
+
+/**
+A compact set of eliminated actions for all states of a model, used to skip actions
+that cannot be optimal (see GRMDP::vi_jac). Each state has its own words of bits,
+so that states can be updated in parallel.
+*/
+class ActionMask {
+public:
+    /** Type of the words that store the bits */
+    typedef uint64_t Word;
+
+    /** Constructs an empty mask */
+    ActionMask(){};
+
+    /**
+    Constructs a mask in which no action is eliminated.
+    \param action_counts Number of actions in each state
+    */
+    explicit ActionMask(const vector<size_t>& action_counts) : offsets(action_counts.size() + 1, 0) {
+        for (size_t s = 0; s < action_counts.size(); s++)
+            offsets[s + 1] = offsets[s] + (action_counts[s] + bits - 1) / bits;
+        words.assign(offsets.back(), 0);
+    };
+
+    /** Number of states */
+    size_t state_count() const { return offsets.empty() ? 0 : offsets.size() - 1; };
+
+    /** Whether the action is eliminated */
+    bool is_eliminated(size_t stateid, size_t actionid) const {
+        return (words[offsets[stateid] + actionid / bits] >> (actionid % bits)) & 1;
+    };
+
+    /** Eliminates the action; states can be updated concurrently */
+    void eliminate(size_t stateid, size_t actionid) {
+        words[offsets[stateid] + actionid / bits] |= Word(1) << (actionid % bits);
+    };
+
+    /** Bits of the eliminated actions of the state */
+    const Word* state_words(size_t stateid) const { return words.data() + offsets[stateid]; };
+
+    /** Total number of eliminated actions */
+    size_t eliminated_count() const {
+        size_t count = 0;
+        for (Word w : words) {
+            for (; w != 0; w &= w - 1)
+                count++;
+        }
+        return count;
+    };
+
+    /** Number of bits in a word */
+    static constexpr size_t bits = 64;
+
+protected:
+    /** Position of the first word of each state */
+    vector<size_t> offsets;
+    /** Bits of the eliminated actions */
+    vector<Word> words;
+};
+
 // **************************************************************************************
 //  SA State (SA rectangular, also used for a regular MDP)
 // **************************************************************************************
@@ -28,7 +92,7 @@ protected:
 
 public:
     /** An identifier for an action for a fixed solution */
-    typedef long ActionId;
+    typedef idx_t ActionId;
     /** OutcomeId which comes from outcome*/
     typedef typename AType::OutcomeId OutcomeId;
 
@@ -91,23 +155,59 @@ public:
     /**
     Finds the maximal optimistic action.
     When there are no action then the return is assumed to be 0.
+    \param eliminated Bits of the actions to skip (see ActionMask), or nullptr
+    \param actionvalues Output of the values of all actions that are not skipped, or nullptr
     \return (Action index, outcome index, value), 0 if it's terminal regardless of the action index
     */
-    tuple<ActionId, OutcomeId, prec_t> max_max(const numvec& valuefunction, prec_t discount) const;
+    tuple<ActionId, OutcomeId, prec_t> max_max(const numvec& valuefunction,
+            prec_t discount,
+            const ActionMask::Word* eliminated = nullptr,
+            prec_t* actionvalues = nullptr) const;
 
     /**
     Finds the maximal pessimistic action
     When there are no action then the return is assumed to be 0
+    \param eliminated Bits of the actions to skip (see ActionMask), or nullptr
+    \param actionvalues Output of the values of all actions that are not skipped, or nullptr
     \return (Action index, outcome index, value), 0 if it's terminal regardless of the action index
     */
-    tuple<ActionId, OutcomeId, prec_t> max_min(const numvec& valuefunction, prec_t discount) const;
+    tuple<ActionId, OutcomeId, prec_t> max_min(const numvec& valuefunction,
+            prec_t discount,
+            const ActionMask::Word* eliminated = nullptr,
+            prec_t* actionvalues = nullptr) const;
+
+    /**
+    Finds the maximal optimistic action without constructing nature's response;
+    see max_max. The value iteration uses it in all sweeps and constructs the
+    outcomes only for the final policy.
+    \return (Action index, value), 0 if it's terminal regardless of the action index
+    */
+    pair<ActionId, prec_t> max_max_value(const numvec& valuefunction,
+            prec_t discount,
+            const ActionMask::Word* eliminated = nullptr,
+            prec_t* actionvalues = nullptr) const;
+
+    /**
+    Finds the maximal pessimistic action without constructing nature's response;
+    see max_min.
+    \return (Action index, value), 0 if it's terminal regardless of the action index
+    */
+    pair<ActionId, prec_t> max_min_value(const numvec& valuefunction,
+            prec_t discount,
+            const ActionMask::Word* eliminated = nullptr,
+            prec_t* actionvalues = nullptr) const;
 
     /**
     Finds the action with the maximal average return
     When there are no actions then the return is assumed to be 0.
+    \param eliminated Bits of the actions to skip (see ActionMask), or nullptr
+    \param actionvalues Output of the values of all actions that are not skipped, or nullptr
     \return (Action index, outcome index, value), 0 if it's terminal regardless of the action index
     */
-    pair<ActionId, prec_t> max_average(const numvec& valuefunction, prec_t discount) const;
+    pair<ActionId, prec_t> max_average(const numvec& valuefunction,
+            prec_t discount,
+            const ActionMask::Word* eliminated = nullptr,
+            prec_t* actionvalues = nullptr) const;
 
     /**
     Computes the value of a fixed action
@@ -126,6 +226,194 @@ public:
     string to_json(long stateid = -1) const;
 };
 
+// **************************************************************************************
+//  S State (S rectangular with L1 constraints)
+// **************************************************************************************
+
+/**
+State for s-rectangular uncertainty with L1 constraints. Nature distributes the
+threshold of the state among the actions, and the decision maker may randomize over
+the actions; see worstcase_srect_l1. The thresholds of the individual actions are
+ignored.
+
+The optimal robust decision is generally randomized, and therefore the action is
+identified by a distribution over the actions. The outcome is identified by the
+outcome distributions of all the actions concatenated in the order of the actions.
+
+The optimistic and average decisions are deterministic: nature's budget is best
+spent on the single best action, and the decision is a distribution with a single
+non-zero element. The actions cannot be eliminated, and the parameters for the
+elimination are ignored.
+*/
+class L1SRobustState {
+protected:
+    vector<L1OutcomeAction> actions;
+    /** Threshold shared by all actions */
+    prec_t threshold;
+
+public:
+    /** Distribution over the actions; empty for a terminal state */
+    typedef numvec ActionId;
+    /** Outcome distributions of all actions concatenated */
+    typedef numvec OutcomeId;
+
+    L1SRobustState() : actions(0), threshold(0){};
+    L1SRobustState(const vector<L1OutcomeAction>& actions, prec_t threshold = 0)
+            : actions(actions), threshold(threshold){};
+
+    /** Number of actions */
+    size_t action_count() const { return actions.size(); };
+
+    /** Number of actions */
+    size_t size() const { return action_count(); };
+
+    /** Total number of outcomes of all actions; the size of OutcomeId */
+    size_t outcome_count() const;
+
+    /** Creates an action given by actionid if it does not exists.
+    Otherwise returns the existing one. */
+    L1OutcomeAction& create_action(long actionid);
+
+    /** Creates an action at the last position of the state */
+    L1OutcomeAction& create_action() { return create_action(actions.size()); };
+
+    /** Returns an existing action */
+    const L1OutcomeAction& get_action(long actionid) const {
+        assert(actionid >= 0 && size_t(actionid) < action_count());
+        return actions[actionid];
+    };
+
+    /** Returns an existing action */
+    const L1OutcomeAction& operator[](long actionid) const { return get_action(actionid); }
+
+    /** Returns an existing action */
+    L1OutcomeAction& get_action(long actionid) {
+        assert(actionid >= 0 && size_t(actionid) < action_count());
+        return actions[actionid];
+    };
+
+    /** Returns an existing action */
+    L1OutcomeAction& operator[](long actionid) { return get_action(actionid); }
+
+    /** Returns set of all actions */
+    const vector<L1OutcomeAction>& get_actions() const { return actions; };
+
+    /** True if the state is considered terminal (no actions). */
+    bool is_terminal() const { return actions.empty(); };
+
+    /** Normalizes transition probabilities to sum to one. */
+    void normalize();
+
+    /** Returns the threshold shared by the actions */
+    prec_t get_threshold() const { return threshold; };
+
+    /** Sets the threshold shared by the actions */
+    void set_threshold(prec_t threshold) { this->threshold = threshold; };
+
+    /** Checks whether the prescribed action and outcome are correct */
+    bool is_action_outcome_correct(const ActionId& aid, const OutcomeId& oid) const;
+
+    /** Returns the mean reward following the action (and outcome). */
+    prec_t mean_reward(const ActionId& actionid, const OutcomeId& outcomeid) const;
+
+    /** Returns the mean transition probabilities following the action and outcome. */
+    Transition mean_transition(const ActionId& actionid, const OutcomeId& outcomeid) const;
+
+    /**
+    Finds the maximal optimistic action, which is deterministic.
+    When there are no action then the return is assumed to be 0.
+    \return (Action distribution, outcomes, value), 0 if it's terminal
+    */
+    tuple<ActionId, OutcomeId, prec_t> max_max(const numvec& valuefunction,
+            prec_t discount,
+            const ActionMask::Word* eliminated = nullptr,
+            prec_t* actionvalues = nullptr) const;
+
+    /**
+    Finds the maximal pessimistic randomized action; see worstcase_srect_l1.
+    When there are no action then the return is assumed to be 0.
+    \return (Action distribution, outcomes, value), 0 if it's terminal
+    */
+    tuple<ActionId, OutcomeId, prec_t> max_min(const numvec& valuefunction,
+            prec_t discount,
+            const ActionMask::Word* eliminated = nullptr,
+            prec_t* actionvalues = nullptr) const;
+
+    /**
+    Finds the maximal optimistic action without constructing nature's response;
+    see max_max.
+    \return (Action distribution, value), 0 if it's terminal
+    */
+    pair<ActionId, prec_t> max_max_value(const numvec& valuefunction,
+            prec_t discount,
+            const ActionMask::Word* eliminated = nullptr,
+            prec_t* actionvalues = nullptr) const;
+
+    /**
+    Finds the maximal pessimistic action without constructing nature's response;
+    see max_min.
+    \return (Action distribution, value), 0 if it's terminal
+    */
+    pair<ActionId, prec_t> max_min_value(const numvec& valuefunction,
+            prec_t discount,
+            const ActionMask::Word* eliminated = nullptr,
+            prec_t* actionvalues = nullptr) const;
+
+    /**
+    Finds the action with the maximal average return, which is deterministic.
+    When there are no actions then the return is assumed to be 0.
+    \return (Action distribution, value), 0 if it's terminal
+    */
+    pair<ActionId, prec_t> max_average(const numvec& valuefunction,
+            prec_t discount,
+            const ActionMask::Word* eliminated = nullptr,
+            prec_t* actionvalues = nullptr) const;
+
+    /**
+    Computes the average value of a randomized action
+    \return Value of state, 0 if it's terminal regardless of the action
+    */
+    prec_t fixed_average(numvec const& valuefunction, prec_t discount, const ActionId& actionid) const;
+
+    /**
+    Computes the value of a randomized action and fixed outcomes.
+    \return Value of state, 0 if it's terminal regardless of the action
+    */
+    prec_t fixed_fixed(numvec const& valuefunction,
+            prec_t discount,
+            const ActionId& actionid,
+            const OutcomeId& outcomeid) const;
+
+    /**
+    Computes nature's response to a randomized action in the memory provided by the
+    caller; see response_srect_l1.
+    \param maximize Whether nature maximizes the value rather than minimizes it
+    \param result Output of the outcomes (outcome_count elements)
+    \returns Value of the state for the outcomes
+    */
+    prec_t nature_response(numvec const& valuefunction,
+            prec_t discount,
+            bool maximize,
+            const ActionId& actionid,
+            prec_t* result) const;
+
+    /** Returns json representation of the state
+    \param stateid Includes also state id*/
+    string to_json(long stateid = -1) const;
+
+protected:
+    /**
+    Computes the values of the outcomes of the valid actions in the workspace: the
+    values, distributions, offsets, and actions, which are the valid actions. The
+    decision and the thresholds are sized for the valid actions.
+    \param sign Multiplies the values; -1 to maximize with nature that minimizes
+    */
+    void outcome_values(numvec const& valuefunction, prec_t discount, prec_t sign, SRectWorkspace& workspace) const;
+
+    /** Sets the outcomes of the actions to their nominal distributions */
+    void nominal_outcomes(prec_t* result) const;
+};
+
 // **********************************************************************
 // *********************    SPECIFIC STATE DEFINITIONS    ***************
 // **********************************************************************
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "RMDP.hpp"
+#include "definitions.hpp"
+
+#include <vector>
+
+namespace craam {
+
+using namespace std;
+
+/**
+Parameters of the solution of a single model in a batch; see GRMDP::mpi_jac for
+their meaning.
+*/
+class BatchParameters {
+public:
+    Uncertainty uncertainty;
+    prec_t discount;
+    /// Initial value function; empty to start from zeros
+    numvec valuefunction;
+    unsigned long iterations_pi;
+    prec_t maxresidual_pi;
+    unsigned long iterations_vi;
+    prec_t maxresidual_vi;
+    PolicyEvaluation evaluation;
+
+    BatchParameters(Uncertainty uncertainty = Uncertainty::Robust,
+            prec_t discount = 0.9,
+            unsigned long iterations_pi = MAXITER,
+            prec_t maxresidual_pi = SOLPREC,
+            unsigned long iterations_vi = MAXITER,
+            prec_t maxresidual_vi = SOLPREC / 2,
+            PolicyEvaluation evaluation = PolicyEvaluation::ValueIteration)
+            : uncertainty(uncertainty),
+              discount(discount),
+              valuefunction(0),
+              iterations_pi(iterations_pi),
+              maxresidual_pi(maxresidual_pi),
+              iterations_vi(iterations_vi),
+              maxresidual_vi(maxresidual_vi),
+              evaluation(evaluation){};
+};
+
+/**
+Solves many independent models using modified policy iteration (GRMDP::mpi_jac).
+
+Parallelizing a single small model does not pay off, because the overhead of
+starting the parallel loops dominates the computation. Models with fewer than
+large_states states are therefore solved in parallel with each other, one model
+per thread, and the parallel loops inside each solution run on that thread only
+(as long as nested parallelism is disabled in OpenMP, which is the default). The
+threads take the models dynamically, the largest ones first, to balance the load.
+The large models are solved one after another, each using all the threads.
+
+\param models Models to solve
+\param parameters Parameters of each model (one for each model)
+\param large_states Models with at least this many states are solved using
+        the parallelism within the model
+\returns Solutions in the same order as the models
+\throws invalid_argument When the numbers of models and parameters differ; also
+        rethrows the first exception thrown by a solution
+*/
+template <class Model>
+vector<typename Model::SolType> solve_batch(const vector<Model>& models,
+        const vector<BatchParameters>& parameters,
+        size_t large_states = 10000);
+
+/**
+Solves many independent models with the same parameters; see the version with
+parameters for each model.
+*/
+template <class Model>
+vector<typename Model::SolType> solve_batch(const vector<Model>& models,
+        const BatchParameters& parameters,
+        size_t large_states = 10000) {
+    return solve_batch(models, vector<BatchParameters>(models.size(), parameters), large_states);
+}
+}
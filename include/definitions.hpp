@@ -1,5 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
 #include <vector>
 #include "config.hpp"
 
@@ -19,8 +26,33 @@ typedef double prec_t;
 /** Default numericalk vector */
 typedef vector<prec_t> numvec; // TODO: switch to valarray or an atlas array
 
+/**
+Type used to store indices of states, actions, and outcomes. It is a 32-bit integer
+by default, which halves the memory and bandwidth needed for indices on the hot path
+of the solvers. Define CRAAM_INDEX_64 (CMake option INDEX_64) to use 64-bit indices
+for models with more than 2^31 - 1 states.
+*/
+#ifdef CRAAM_INDEX_64
+typedef int64_t idx_t;
+#else
+typedef int32_t idx_t;
+#endif
+
 /** Default index vector */
-typedef vector<long> indvec;
+typedef vector<idx_t> indvec;
+
+/**
+Converts a value to the index type and checks that it is not out of range.
+\param value Index to convert
+\throws overflow_error When the value does not fit in idx_t
+*/
+template <typename T>
+inline idx_t checked_index(T value) {
+    if (value > T(numeric_limits<idx_t>::max()))
+        throw overflow_error("Index " + to_string(value) +
+                             " exceeds the maximal index; configure with INDEX_64 to use 64-bit indices.");
+    return idx_t(value);
+}
 
 /** Default solution precision */
 const prec_t SOLPREC = 0.0001;
@@ -32,6 +64,28 @@ const unsigned long MAXITER = 100000;
     The function returns the worst-case solution and the objective value. */
 typedef pair<numvec, prec_t> (*NatureConstr)(numvec const& z, numvec const& q, prec_t t);
 
+/**
+Scratch memory reused across the computations of nature's response, so that the
+computations do not allocate memory once the buffers are large enough. Each thread
+has its own workspace, which persists for the lifetime of the thread (the threads
+of OpenMP are reused by all parallel loops of a solver).
+
+The nature constraints (see NatureSpan) may only use the indices; the values and the
+distribution are left to their callers.
+*/
+class NatureWorkspace {
+public:
+    /// Values of the outcomes
+    numvec values;
+    /// Distribution of the outcomes
+    numvec distribution;
+    /// Ordering of the outcomes
+    vector<size_t> indices;
+
+    /** Workspace of the calling thread */
+    static NatureWorkspace& local();
+};
+
 template <typename T>
 vector<size_t> sort_indexes(vector<T> const& v);
 template <typename T>
@@ -39,6 +93,194 @@ vector<size_t> sort_indexes_desc(vector<T> const& v);
 
 pair<numvec, prec_t> worstcase_l1(numvec const& z, numvec const& q, prec_t t);
 
+/**
+Computes the worst-case distribution with an L1 constraint (see worstcase_l1) in the
+memory provided by the caller, without allocating memory.
+
+Small outcome sets are ordered on the stack and large ones are processed by a
+quickselect, which does not sort the values.
+\param z Values of the outcomes (n elements)
+\param q Reference distribution (n elements)
+\param n Number of outcomes
+\param t Threshold
+\param p Output of the worst-case distribution (n elements); must not overlap z or q
+\param workspace Scratch memory; only the indices are used
+\returns Objective value p^T z
+*/
+prec_t worstcase_l1(const prec_t* z, const prec_t* q, size_t n, prec_t t, prec_t* p, NatureWorkspace& workspace);
+
+/**
+Computes the worst-case distribution with an L1 constraint (see worstcase_l1), starting
+from the order of the outcomes from the previous computation. The values of the
+outcomes usually change little between iterations of value iteration, and the
+order is restored by insertion sort in nearly linear time.
+\param z Values of the outcomes (n elements)
+\param q Reference distribution (n elements)
+\param n Number of outcomes
+\param t Threshold
+\param p Output of the worst-case distribution (n elements); must not overlap z or q
+\param order Indices of the outcomes ordered by the values in the previous call;
+        it is updated to the current order, and initialized when its size is not n
+\returns Objective value p^T z
+*/
+prec_t worstcase_l1_warm(const prec_t* z, const prec_t* q, size_t n, prec_t t, prec_t* p, vector<size_t>& order);
+
+/**
+Computes nature's response in the memory provided by the caller. The arguments are
+the same as of the overload of worstcase_l1 with pointers.
+
+The generic version calls the nature constraint and copies its result; the
+constraints provided by the library are specialized to avoid the allocation.
+The optional order is the order of the outcomes cached from the previous call
+(see worstcase_l1_warm); the generic version ignores it.
+*/
+template <NatureConstr nature>
+struct NatureSpan {
+    static prec_t compute(const prec_t* z,
+            const prec_t* q,
+            size_t n,
+            prec_t t,
+            prec_t* p,
+            NatureWorkspace&,
+            vector<size_t>* = nullptr) {
+        const auto result = nature(numvec(z, z + n), numvec(q, q + n), t);
+        copy(result.first.begin(), result.first.end(), p);
+        return result.second;
+    }
+};
+
+template <>
+struct NatureSpan<worstcase_l1> {
+    static prec_t compute(const prec_t* z,
+            const prec_t* q,
+            size_t n,
+            prec_t t,
+            prec_t* p,
+            NatureWorkspace& workspace,
+            vector<size_t>* order = nullptr) {
+        return order ? worstcase_l1_warm(z, q, n, t, p, *order) : worstcase_l1(z, q, n, t, p, workspace);
+    }
+};
+
+/**
+Computes the worst case of an s-rectangular uncertainty set with an L1 constraint, in
+which nature distributes the threshold t among the actions of a state and the decision
+maker randomizes over the actions:
+
+    max_{d in simplex} min_{p_a : sum_a ||p_a - q_a||_1 <= t}  sum_a d_a p_a^T z_a
+
+The worst-case value of each action (see worstcase_l1) is a piecewise linear, convex,
+and non-increasing function of its threshold. The value of the problem is the smallest
+u for which the thresholds that reduce the values of all actions to u sum to at most t.
+The value is found exactly by a bisection over the sorted breakpoints of the functions,
+in O(N log N) time for N outcomes of all the actions together.
+
+\param z Values of the outcomes of each action
+\param q Nominal distributions of the outcomes of each action
+\param t Threshold shared by the actions
+\returns Randomized decision (distribution over the actions), thresholds of the
+        actions used by nature (for worstcase_l1), and the value
+*/
+tuple<numvec, numvec, prec_t> worstcase_srect_l1(const vector<numvec>& z, const vector<numvec>& q, prec_t t);
+
+/**
+Scratch memory of the s-rectangular computations (see worstcase_srect_l1), reused
+in the same way as NatureWorkspace. The values, distributions, and offsets are filled
+by the callers; the computations only use the remaining buffers.
+*/
+class SRectWorkspace {
+public:
+    /// Values of the outcomes of all actions
+    numvec values;
+    /// Nominal distributions of the outcomes of all actions
+    numvec distributions;
+    /// Position of the first outcome of each action; one more element than actions
+    vector<size_t> offsets;
+    /// Actions of the outcomes (such as the valid actions of a state)
+    vector<size_t> actions;
+    /// Randomized decision over the actions
+    numvec decision;
+    /// Thresholds of the actions
+    numvec thresholds;
+
+    /// Position of the first breakpoint of each action
+    vector<size_t> breakpoint_offsets;
+    /// Thresholds of the breakpoints of the worst-case values
+    numvec breakpoint_thresholds;
+    /// Worst-case values at the breakpoints
+    numvec breakpoint_values;
+    /// Values at which the total threshold is evaluated
+    numvec candidates;
+    /// Orderings of the outcomes or of the pieces
+    vector<size_t> order;
+    /// Action of each linear piece of the worst-case values
+    vector<size_t> pieces;
+    /// Threshold length of each piece
+    numvec lengths;
+    /// Decrease of the weighted value for a unit of threshold on each piece
+    numvec rates;
+
+    /** Workspace of the calling thread */
+    static SRectWorkspace& local();
+};
+
+/**
+Computes the s-rectangular worst case (see worstcase_srect_l1) with the outcomes of
+all actions stored contiguously, without allocating memory once the workspace is
+large enough.
+\param z Values of the outcomes of all actions
+\param q Nominal distributions of the outcomes of all actions
+\param outcomes Position of the first outcome of each action in z and q; one more
+        element than actions
+\param actions Number of actions
+\param t Threshold shared by the actions
+\param decision Output of the randomized decision (one element for each action)
+\param thresholds Output of the thresholds of the actions (one element for each action)
+\returns Value of the worst case
+*/
+prec_t worstcase_srect_l1(const prec_t* z,
+        const prec_t* q,
+        const size_t* outcomes,
+        size_t actions,
+        prec_t t,
+        prec_t* decision,
+        prec_t* thresholds,
+        SRectWorkspace& workspace);
+
+/**
+Computes nature's response to a fixed randomized decision for the s-rectangular
+uncertainty set of worstcase_srect_l1:
+
+    min_{p_a : sum_a ||p_a - q_a||_1 <= t}  sum_a d_a p_a^T z_a
+
+The threshold is allocated greedily to the linear pieces of the worst-case values
+of the actions with the largest decrease, in O(N log N) time.
+
+\param z Values of the outcomes of each action
+\param q Nominal distributions of the outcomes of each action
+\param t Threshold shared by the actions
+\param d Probabilities of the actions
+\returns Thresholds of the actions used by nature (for worstcase_l1), and the value
+*/
+pair<numvec, prec_t> response_srect_l1(const vector<numvec>& z, const vector<numvec>& q, prec_t t, const numvec& d);
+
+/**
+Computes nature's response to a fixed randomized decision (see response_srect_l1)
+with the outcomes stored contiguously as in the version of worstcase_srect_l1 with
+pointers.
+\param d Probabilities of the actions
+\param thresholds Output of the thresholds of the actions (one element for each action)
+\returns Value of the response
+*/
+prec_t response_srect_l1(const prec_t* z,
+        const prec_t* q,
+        const size_t* outcomes,
+        size_t actions,
+        prec_t t,
+        const prec_t* d,
+        prec_t* thresholds,
+        SRectWorkspace& workspace);
+
 /*template<class T>
 void print_vector(vector<T> vec){
     for(auto&& p : vec){
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "definitions.hpp"
+
+#include <cstddef>
+
+namespace craam {
+
+/**
+Computational kernels for the innermost loops of the solvers.
+
+The kernels compute sparse (gather) dot products over the packed arrays of
+target indices, probabilities, and rewards. Several implementations are available
+and the fastest one supported by the CPU is selected once at startup:
+    - Portable: plain C++ code (always available)
+    - AVX2: 256-bit vectors with FMA and gather instructions
+    - AVX512: 512-bit vectors with gather instructions
+
+The vectorized kernels sum the terms in a different order than the portable
+kernel, which may cause differences of the order of the machine precision.
+*/
+namespace kernels {
+
+/** Instruction sets that may be used by the kernels */
+enum class SimdIsa {
+    /// Plain C++ implementation
+    Portable = 0,
+    /// AVX2 and FMA instructions
+    AVX2 = 1,
+    /// AVX-512 foundation instructions
+    AVX512 = 2
+};
+
+/**
+Computes the value of a sparse transition:
+\f[ \sum_{c=0}^{n-1} p_c (r_c + \gamma v_{i_c}) \f]
+\param indices Target indices \f$ i \f$
+\param probabilities Transition probabilities \f$ p \f$
+\param rewards Transition rewards \f$ r \f$
+\param n Number of transitions
+\param valuefunction Value function \f$ v \f$
+\param discount Discount factor \f$ \gamma \f$
+*/
+typedef prec_t (*ValueKernel)(const idx_t* indices,
+        const prec_t* probabilities,
+        const prec_t* rewards,
+        size_t n,
+        const prec_t* valuefunction,
+        prec_t discount);
+
+/**
+Computes a dense dot product:
+\f[ \sum_{c=0}^{n-1} p_c r_c \f]
+*/
+typedef prec_t (*DotKernel)(const prec_t* probabilities, const prec_t* rewards, size_t n);
+
+/**
+Computes a sparse (gather) dot product:
+\f[ \sum_{c=0}^{n-1} p_c v_{i_c} \f]
+This kernel is used when the expected rewards are precomputed and
+the rewards of individual transitions do not need to be read.
+\param indices Target indices \f$ i \f$
+\param probabilities Transition probabilities \f$ p \f$
+\param n Number of transitions
+\param valuefunction Value function \f$ v \f$
+*/
+typedef prec_t (*SparseDotKernel)(const idx_t* indices, const prec_t* probabilities, size_t n, const prec_t* valuefunction);
+
+/** Sparse dot product with probabilities stored in single precision. See SparseDotKernel. */
+typedef prec_t (*SparseDotKernelF)(const idx_t* indices, const float* probabilities, size_t n, const prec_t* valuefunction);
+
+/// Currently selected value kernel; do not modify directly, use select_isa
+extern ValueKernel value_kernel;
+/// Currently selected dot product kernel; do not modify directly, use select_isa
+extern DotKernel dot_kernel;
+/// Currently selected sparse dot product kernel; do not modify directly, use select_isa
+extern SparseDotKernel sparse_dot_kernel;
+/// Currently selected single precision sparse dot product kernel; do not modify directly, use select_isa
+extern SparseDotKernelF sparse_dot_kernel_f;
+
+/** Returns the instruction set that is currently used by the kernels */
+SimdIsa active_isa();
+
+/** Returns the best instruction set that is supported by the CPU */
+SimdIsa best_isa();
+
+/** Checks whether the CPU (and the compiler) supports the instruction set */
+bool is_isa_supported(SimdIsa isa);
+
+/**
+Selects the kernels for the instruction set. This is done automatically at startup,
+and is only useful for testing and benchmarking. It is not thread safe and must not be
+called while any computation is running.
+\returns False if the instruction set is not supported (the kernels are then unchanged)
+*/
+bool select_isa(SimdIsa isa);
+
+/** Name of the instruction set */
+const char* isa_name(SimdIsa isa);
+
+/** Computes the value of a transition with the selected kernel. See ValueKernel. */
+inline prec_t transition_value(const idx_t* indices,
+        const prec_t* probabilities,
+        const prec_t* rewards,
+        size_t n,
+        const prec_t* valuefunction,
+        prec_t discount) {
+    return value_kernel(indices, probabilities, rewards, n, valuefunction, discount);
+}
+
+/** Computes a dot product with the selected kernel. See DotKernel. */
+inline prec_t dot(const prec_t* probabilities, const prec_t* rewards, size_t n) {
+    return dot_kernel(probabilities, rewards, n);
+}
+
+/** Computes a sparse dot product with the selected kernel. See SparseDotKernel. */
+inline prec_t sparse_dot(const idx_t* indices, const prec_t* probabilities, size_t n, const prec_t* valuefunction) {
+    return sparse_dot_kernel(indices, probabilities, n, valuefunction);
+}
+
+/**
+Computes a sparse dot product with probabilities in single precision with the selected kernel.
+The products are accumulated in double precision. See SparseDotKernel.
+*/
+inline prec_t sparse_dot(const idx_t* indices, const float* probabilities, size_t n, const prec_t* valuefunction) {
+    return sparse_dot_kernel_f(indices, probabilities, n, valuefunction);
+}
+}
+}
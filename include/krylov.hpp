@@ -0,0 +1,102 @@
+#pragma once
+
+#include "definitions.hpp"
+
+#include <vector>
+
+namespace craam {
+
+using namespace std;
+
+/**
+A square sparse matrix in the compressed sparse row format. The entries of row i
+are columns[offsets[i]], ..., columns[offsets[i+1]-1] with the corresponding values.
+The columns in each row must be sorted and unique.
+*/
+class SparseMatrix {
+public:
+    /// Position of the first entry of each row; has one more element than rows
+    vector<size_t> offsets;
+    /// Columns of the entries
+    indvec columns;
+    /// Values of the entries
+    numvec values;
+
+    /** Constructs an empty matrix */
+    SparseMatrix() : offsets(1, 0){};
+
+    /** Number of rows (and columns) */
+    size_t size() const { return offsets.size() - 1; };
+
+    /** Number of stored entries */
+    size_t nonzeros() const { return values.size(); };
+
+    /**
+    Appends a row to the matrix. The columns must be sorted and unique.
+    \param rowcolumns Columns of the entries
+    \param rowvalues Values of the entries
+    */
+    void add_row(const indvec& rowcolumns, const numvec& rowvalues);
+
+    /** Constructs the transposed matrix */
+    SparseMatrix transpose() const;
+
+    /**
+    Computes the product y = A x (in parallel).
+    \param x Input vector
+    \param y Output vector; resized when necessary
+    */
+    void multiply(const numvec& x, numvec& y) const;
+};
+
+/** Preconditioner for the Krylov solver */
+enum class Preconditioner {
+    /// No preconditioning
+    None = 0,
+    /// Diagonal (Jacobi) preconditioner
+    Jacobi = 1,
+    /// Incomplete LU factorization with no fill-in; requires diagonal entries
+    ILU0 = 2
+};
+
+/** Solution of a linear system */
+class LinearSolution {
+public:
+    /// The computed solution
+    numvec solution;
+    /// Maximal absolute residual of the equations |b - A x|
+    prec_t residual;
+    /// Number of iterations
+    long iterations;
+
+    LinearSolution() : solution(0), residual(-1), iterations(-1){};
+
+    LinearSolution(const numvec& solution, prec_t residual, long iterations)
+            : solution(solution), residual(residual), iterations(iterations){};
+};
+
+/**
+Solves the linear system A x = b using the stabilized bi-conjugate gradient method
+(BiCGSTAB) with right preconditioning.
+
+The vector operations and the matrix multiplication use OpenMP. The computation
+stops when the maximal absolute residual |b - A x| drops below the tolerance, or
+when the method breaks down.
+
+\param A Square matrix with sorted columns in each row
+\param b Right-hand side
+\param x Initial solution; use an empty vector to start from zeros
+\param preconditioner Preconditioner to use
+\param iterations Maximal number of iterations
+\param tolerance Stop when the maximal absolute residual falls below this value
+\returns Solution, the final residual, and the number of iterations
+\throws invalid_argument When the dimensions do not match or the preconditioner
+        cannot be constructed (a zero on the diagonal)
+*/
+LinearSolution bicgstab(const SparseMatrix& A,
+        const numvec& b,
+        numvec x,
+        Preconditioner preconditioner = Preconditioner::ILU0,
+        unsigned long iterations = MAXITER,
+        prec_t tolerance = SOLPREC);
+}
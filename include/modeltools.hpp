@@ -77,19 +77,35 @@ template <class Model>
 Model& from_csv(Model& mdp, istream& input, bool header = true);
 
 /**
-Loads the transition probabilities and rewards from a CSV file.
+Loads the transition probabilities and rewards from a CSV file. The format
+is the same as in from_csv.
+
+The file is mapped to memory, split into chunks at line boundaries, and the chunks are
+parsed in parallel. The numbers are parsed with full double precision. The transitions
+are then added to the model using ModelBuilder.
+
 \param mdp Model output (also returned)
 \param filename Name of the file
-\param header Whether to create a header of the file too
+\param header Whether the first line of the file represents the header
 \returns The input model
+\throws invalid_argument When the file cannot be opened or is not formatted correctly
  */
 template <class Model>
-Model& from_csv_file(Model& mdp, const string& filename, bool header = true) {
-    ifstream ifs(filename);
-    from_csv(mdp, ifs, header);
-    ifs.close();
-    return mdp;
-}
+Model& from_csv_file(Model& mdp, const string& filename, bool header = true);
+
+/**
+Loads the transition probabilities and rewards from CSV data in memory. The format
+is the same as in from_csv. The data is parsed in parallel; see from_csv_file.
+
+\param mdp Model output (also returned)
+\param begin First character of the data
+\param end Pointer past the last character of the data
+\param header Whether the first line of the data represents the header
+\returns The input model
+\throws invalid_argument When the data is not formatted correctly
+ */
+template <class Model>
+Model& from_csv_buffer(Model& mdp, const char* begin, const char* end, bool header = true);
 
 /**
 Uniformly sets the thresholds to the provided value for all states and actions.
@@ -104,6 +120,30 @@ This function only applies to models that have thresholds, such as ones using
 template <class Model>
 void set_outcome_thresholds(Model& mdp, prec_t threshold);
 
+/**
+Uniformly sets the thresholds shared by the actions of each state to the provided value.
+
+This function only applies to models with s-rectangular uncertainty sets, such as
+craam::RMDP_SL1.
+
+\param model Model to set thresholds for
+\param threshold New thresholds value
+*/
+template <class Model>
+void set_state_thresholds(Model& mdp, prec_t threshold);
+
+/**
+Enables or disables caching the order of the outcomes between the computations of
+the worst/best case for all states and actions (see WeightedOutcomeAction::set_order_cache).
+
+This function only applies to models that use "WeightedOutcomeAction" or its derivatives.
+
+\param model Model to set the cache for
+\param enable Whether the cache is used
+*/
+template <class Model>
+void set_outcome_order_cache(Model& mdp, bool enable);
+
 /**
 Sets the distribution for outcomes for each state and
 action to be uniform.
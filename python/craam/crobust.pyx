@@ -48,7 +48,9 @@ cdef extern from "../include/RMDP.hpp" namespace 'craam' nogil:
                                             
     ctypedef double prec_t
     ctypedef vector[double] numvec
-    ctypedef vector[long] indvec
+    # 32-bit or 64-bit depending on the library configuration
+    ctypedef long idx_t
+    ctypedef vector[idx_t] indvec
     ctypedef unsigned long size_t
                                             
     cdef cppclass Uncertainty:
@@ -636,18 +638,18 @@ cdef extern from "../include/Samples.hpp" namespace 'craam::msen':
 
         CDiscreteSamples();
 
-        void add_initial(const long& decstate);
-        void add_sample(const long& state_from, const long& action, const long& state_to, double reward, double weight, long step, long run);
+        void add_initial(const idx_t& decstate);
+        void add_sample(const idx_t& state_from, const idx_t& action, const idx_t& state_to, double reward, double weight, long step, long run);
         double mean_return(double discount);
 
-        const vector[long]& get_states_from() const;
-        const vector[long]& get_actions() const;
-        const vector[long]& get_states_to() const;
+        const vector[idx_t]& get_states_from() const;
+        const vector[idx_t]& get_actions() const;
+        const vector[idx_t]& get_states_to() const;
         const vector[double]& get_rewards() const;
         const vector[double]& get_weights() const;
         const vector[long]& get_runs() const;
         const vector[long]& get_steps() const;
-        const vector[long]& get_initial() const;
+        const vector[idx_t]& get_initial() const;
 
 
 cdef class DiscreteSamples:
@@ -1004,10 +1006,16 @@ cpdef cworstcase_l1(np.ndarray[double] z, np.ndarray[double] q, double t):
 
 cdef extern from "../include/RMDP.hpp" namespace 'craam' nogil:
 
+    cdef cppclass DistributionArray:
+        size_t size()
+        const vector[size_t]& get_offsets()
+        const numvec& get_values()
+        vector[numvec] to_vectors()
+
     cdef cppclass SolutionDscProb:
         numvec valuefunction
         indvec policy
-        vector[numvec] outcomes
+        DistributionArray outcomes
         prec_t residual
         long iterations
 
@@ -1062,6 +1070,19 @@ cdef extern from "../include/modeltools.hpp" namespace 'craam' nogil:
     void set_outcome_dst[Model](Model& mdp, size_t stateid, size_t actionid, const numvec& dist)
     RMDP_L1 robustify_l1(const CMDP& mdp, bool allowzeros)
 
+cdef _outcome_arrays(DistributionArray& outcomes, bool flat):
+    """
+    Returns the outcomes of a solution as a list of arrays, or, when flat is true,
+    as the pair (offsets, values) copied from the contiguous storage: the outcomes
+    of state s are values[offsets[s]:offsets[s+1]].
+    """
+    if not flat:
+        return outcomes.to_vectors()
+    offsets = np.array(<size_t[:outcomes.get_offsets().size()]> <size_t*> outcomes.get_offsets().data())
+    if outcomes.get_values().empty():
+        return offsets, np.empty(0)
+    return offsets, np.array(<double[:outcomes.get_values().size()]> <double*> outcomes.get_values().data())
+
 
 cdef class RMDP:
     """
@@ -1395,7 +1416,7 @@ cdef class RMDP:
 
         
     cpdef vi_gs(self, long iterations=DEFAULT_ITERS, valuefunction = np.empty(0), \
-                            double maxresidual=0, int stype=0):
+                            double maxresidual=0, int stype=0, bool flat=False):
         """
         Runs value iteration using the worst case (simplex) distribution for the 
         outcomes.
@@ -1417,6 +1438,9 @@ cdef class RMDP:
         stype : int  {0, 1, 2}, optional
             Robust (0) or optimistic (1) solution or (2) average solution. One
             can use e.g. UncertainSet.Robust.value.
+        flat : bool, optional
+            Whether to return the outcomes as two arrays copied from the contiguous
+            storage rather than as a list of arrays
             
         Returns
         -------
@@ -1428,8 +1452,9 @@ cdef class RMDP:
             Residual for the value function
         iterations : int
             Number of iterations taken
-        outcomes : np.ndarray
-            Outcomes selected
+        outcomes : list of np.ndarray, or (np.ndarray, np.ndarray)
+            Outcomes selected; with flat, the pair (offsets, values) such that the
+            outcomes of state s are values[offsets[s]:offsets[s+1]]
         """
         
         self._check_value(valuefunction)
@@ -1439,11 +1464,11 @@ cdef class RMDP:
                     valuefunction,iterations,maxresidual)
 
         return np.array(sol.valuefunction), np.array(sol.policy), sol.residual, \
-                sol.iterations, sol.outcomes
+                sol.iterations, _outcome_arrays(sol.outcomes, flat)
 
 
     cpdef vi_jac(self, int iterations=DEFAULT_ITERS,valuefunction = np.empty(0), \
-                                    double maxresidual=0, int stype=0):
+                                    double maxresidual=0, int stype=0, bool flat=False):
         """
         Runs value iteration using the worst case (simplex) distribution for the 
         outcomes.
@@ -1463,6 +1488,9 @@ cdef class RMDP:
         stype : int  (0, 1, 2}
             Robust (0) or optimistic (1) solution or (2) average. One
             can use e.g. UncertainSet.Robust.value.
+        flat : bool, optional
+            Whether to return the outcomes as two arrays copied from the contiguous
+            storage rather than as a list of arrays
             
         Returns
         -------
@@ -1474,8 +1502,9 @@ cdef class RMDP:
             Residual for the value function
         iterations : int
             Number of iterations taken
-        outcomes : np.ndarray
-            Outcomes selected
+        outcomes : list of np.ndarray, or (np.ndarray, np.ndarray)
+            Outcomes selected; with flat, the pair (offsets, values) such that the
+            outcomes of state s are values[offsets[s]:offsets[s+1]]
         """
 
         self._check_value(valuefunction)
@@ -1485,12 +1514,12 @@ cdef class RMDP:
                         valuefunction,iterations,maxresidual)
 
         return np.array(sol.valuefunction), np.array(sol.policy), sol.residual, \
-                sol.iterations, sol.outcomes
+                sol.iterations, _outcome_arrays(sol.outcomes, flat)
 
 
     cpdef mpi_jac(self, long iterations=DEFAULT_ITERS, valuefunction = np.empty(0), \
                                     double maxresidual = 0, long valiterations = 1000, int stype=0,
-                                    double valresidual=-1, bool show_progress = False):
+                                    double valresidual=-1, bool show_progress = False, bool flat=False):
         """
         Runs modified policy iteration using the worst distribution constrained by the threshold 
         and l1 norm difference from the base distribution.
@@ -1515,6 +1544,9 @@ cdef class RMDP:
         valresidual : double, optional 
             Maximal residual at which iterations of computing the value function 
             stop. Default is maxresidual / 2.
+        flat : bool, optional
+            Whether to return the outcomes as two arrays copied from the contiguous
+            storage rather than as a list of arrays
             
         Returns
         -------
@@ -1526,8 +1558,9 @@ cdef class RMDP:
             Residual for the value function
         iterations : int
             Number of iterations taken
-        outcomes : np.ndarray
-            Outcomes selected
+        outcomes : list of np.ndarray, or (np.ndarray, np.ndarray)
+            Outcomes selected; with flat, the pair (offsets, values) such that the
+            outcomes of state s are values[offsets[s]:offsets[s+1]]
         """
 
         self._check_value(valuefunction)
@@ -1541,7 +1574,7 @@ cdef class RMDP:
                         valresidual, show_progress)
 
         return np.array(sol.valuefunction), np.array(sol.policy), sol.residual, \
-                sol.iterations, sol.outcomes
+                sol.iterations, _outcome_arrays(sol.outcomes, flat)
 
 
     cpdef from_matrices(self, np.ndarray[double,ndim=3] transitions, np.ndarray[double,ndim=2] rewards, \
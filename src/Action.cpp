@@ -39,7 +39,7 @@ Transition& OutcomeManagement::create_outcome(long outcomeid) {
         throw invalid_argument("Outcomeid must be non-negative.");
 
     if (outcomeid >= (long)outcomes.size())
-        outcomes.resize(outcomeid + 1);
+        outcomes.resize(checked_index(outcomeid) + 1l);
 
     return outcomes[outcomeid];
 }
@@ -169,6 +169,7 @@ Transition& WeightedOutcomeAction<nature>::create_outcome(long outcomeid, prec_t
     assert(weight >= 0 && weight <= 1);
 
     if (outcomeid >= static_cast<long>(outcomes.size())) { // needs to resize arrays
+        checked_index(outcomeid);
         outcomes.resize(outcomeid + 1);
         distribution.resize(outcomeid + 1);
     }
@@ -177,41 +178,66 @@ Transition& WeightedOutcomeAction<nature>::create_outcome(long outcomeid, prec_t
 }
 
 template <NatureConstr nature>
-auto WeightedOutcomeAction<nature>::maximal(const numvec& valuefunction, prec_t discount) const
-        -> pair<OutcomeId, prec_t> {
+prec_t WeightedOutcomeAction<nature>::nature_response(const numvec& valuefunction,
+        prec_t discount,
+        bool maximize,
+        prec_t* result) const {
     assert(distribution.size() == outcomes.size());
 
     if (outcomes.empty())
         throw invalid_argument("Action with no outcomes.");
 
-    numvec outcomevalues(outcomes.size());
+    // the values are stored in the workspace of the thread to avoid allocations
+    NatureWorkspace& workspace = NatureWorkspace::local();
+    numvec& outcomevalues = workspace.values;
+    outcomevalues.resize(outcomes.size());
 
+    // nature minimizes, so maximizing uses the negative values
+    const prec_t sign = maximize ? -1.0 : 1.0;
     for (size_t i = 0; i < outcomes.size(); i++) {
         const auto& outcome = outcomes[i];
-        outcomevalues[i] = -outcome.compute_value(valuefunction, discount);
+        outcomevalues[i] = sign * outcome.compute_value(valuefunction, discount);
     }
 
-    auto result = nature(outcomevalues, distribution, threshold);
-    result.second = -result.second;
+    const prec_t value = NatureSpan<nature>::compute(outcomevalues.data(),
+            distribution.data(),
+            outcomes.size(),
+            threshold,
+            result,
+            workspace,
+            order_cache ? &outcome_order : nullptr);
 
-    return result;
+    return sign * value;
 }
 
 template <NatureConstr nature>
-auto WeightedOutcomeAction<nature>::minimal(const numvec& valuefunction, prec_t discount) const
+auto WeightedOutcomeAction<nature>::maximal(const numvec& valuefunction, prec_t discount) const
         -> pair<OutcomeId, prec_t> {
-    assert(distribution.size() == outcomes.size());
+    OutcomeId result(outcomes.size());
+    const prec_t value = nature_response(valuefunction, discount, true, result.data());
+    return make_pair(move(result), value);
+}
 
-    if (outcomes.empty())
-        throw invalid_argument("Action with no outcomes");
+template <NatureConstr nature>
+auto WeightedOutcomeAction<nature>::minimal(const numvec& valuefunction, prec_t discount) const
+        -> pair<OutcomeId, prec_t> {
+    OutcomeId result(outcomes.size());
+    const prec_t value = nature_response(valuefunction, discount, false, result.data());
+    return make_pair(move(result), value);
+}
 
-    numvec outcomevalues(outcomes.size());
+template <NatureConstr nature>
+prec_t WeightedOutcomeAction<nature>::maximal_value(const numvec& valuefunction, prec_t discount) const {
+    numvec& result = NatureWorkspace::local().distribution;
+    result.resize(outcomes.size());
+    return nature_response(valuefunction, discount, true, result.data());
+}
 
-    for (size_t i = 0; i < outcomes.size(); i++) {
-        const auto& outcome = outcomes[i];
-        outcomevalues[i] = outcome.compute_value(valuefunction, discount);
-    }
-    return nature(outcomevalues, distribution, threshold);
+template <NatureConstr nature>
+prec_t WeightedOutcomeAction<nature>::minimal_value(const numvec& valuefunction, prec_t discount) const {
+    numvec& result = NatureWorkspace::local().distribution;
+    result.resize(outcomes.size());
+    return nature_response(valuefunction, discount, false, result.data());
 }
 
 template <NatureConstr nature>
@@ -0,0 +1,897 @@
+#include "CompiledRMDP.hpp"
+#include "MappedFile.hpp"
+#include "kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "cpp11-range-master/range.hpp"
+
+using namespace util::lang;
+
+namespace craam {
+
+// **************************************************************************************
+//  Helper functions for compiling actions
+// **************************************************************************************
+
+/// Nature's constraint function used by the actions of the state type (nullptr if none)
+template <class SType>
+struct compiled_nature {
+    static constexpr NatureConstr value = nullptr;
+    /// Computes nature's response without allocating; see NatureSpan
+    static prec_t compute(const prec_t*, const prec_t*, size_t, prec_t, prec_t*, NatureWorkspace&) {
+        throw invalid_argument("The state type does not define nature's constraints.");
+    }
+};
+
+template <NatureConstr nature>
+struct compiled_nature<SAState<WeightedOutcomeAction<nature>>> {
+    static constexpr NatureConstr value = nature;
+    /// Computes nature's response without allocating; see NatureSpan
+    static prec_t
+    compute(const prec_t* z, const prec_t* q, size_t n, prec_t t, prec_t* p, NatureWorkspace& workspace) {
+        return NatureSpan<nature>::compute(z, q, n, t, p, workspace);
+    }
+};
+
+/// Appends the nominal weights of outcomes and the threshold of a regular action
+void compile_weights(const RegularAction&, numvec& weights, numvec& thresholds) {
+    weights.push_back(1.0);
+    thresholds.push_back(0.0);
+}
+
+/// Appends the nominal (uniform) weights of outcomes and the threshold of a discrete action
+void compile_weights(const DiscreteOutcomeAction& action, numvec& weights, numvec& thresholds) {
+    const prec_t weight = 1.0 / prec_t(action.outcome_count());
+    weights.insert(weights.end(), action.outcome_count(), weight);
+    thresholds.push_back(0.0);
+}
+
+/// Appends the nominal weights of outcomes and the threshold of a weighted action
+template <NatureConstr nature>
+void compile_weights(const WeightedOutcomeAction<nature>& action, numvec& weights, numvec& thresholds) {
+    const numvec& distribution = action.get_distribution();
+    if (distribution.size() != action.outcome_count())
+        throw invalid_argument("Outcome distribution size does not match the number of outcomes.");
+    weights.insert(weights.end(), distribution.begin(), distribution.end());
+    thresholds.push_back(action.get_threshold());
+}
+
+/// Identifier of the state type in the binary format
+template <class SType>
+struct compiled_type;
+
+template <>
+struct compiled_type<RegularState> {
+    static constexpr uint32_t value = 0;
+};
+
+template <>
+struct compiled_type<DiscreteRobustState> {
+    static constexpr uint32_t value = 1;
+};
+
+template <>
+struct compiled_type<L1RobustState> {
+    static constexpr uint32_t value = 2;
+};
+
+/// Arrays of a model that has been compiled in memory
+template <class Storage>
+struct CompiledArrays {
+    vector<uint64_t> state_offsets, action_offsets, outcome_offsets;
+    indvec indices;
+    vector<Storage> probabilities, rewards, outcome_rewards;
+    vector<uint8_t> action_valid;
+    numvec thresholds, weights;
+};
+
+/// The offsets of an empty model
+static const uint64_t empty_offsets[] = {0};
+
+// **************************************************************************************
+//  Binary format
+// **************************************************************************************
+
+/// Identifies the binary files
+static const char binary_magic[8] = {'C', 'R', 'A', 'A', 'M', 'B', 'I', 'N'};
+/// Version of the binary format
+static const uint32_t binary_version = 1;
+/// Detects files with a different byte order
+static const uint64_t binary_byte_order = 0x0102030405060708ull;
+/// Alignment of arrays in the file
+static const uint64_t binary_alignment = 64;
+
+/// Arrays in the binary file (in this order)
+enum BinarySection {
+    StateOffsets = 0,
+    ActionOffsets,
+    OutcomeOffsets,
+    Indices,
+    Probabilities,
+    Rewards,
+    OutcomeRewards,
+    ActionValid,
+    Thresholds,
+    Weights,
+    SectionCount
+};
+
+/// Header of the binary file
+struct BinaryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t model_type;
+    uint32_t index_size;
+    uint32_t scalar_size;
+    uint64_t byte_order;
+    uint64_t state_count;
+    uint64_t action_count;
+    uint64_t outcome_count;
+    uint64_t transition_count;
+    /// Position (in bytes from the beginning of the file) and size (in bytes) of each array
+    uint64_t sections[SectionCount][2];
+};
+
+/// Checks that the array of offsets is non-decreasing and starts with 0 and ends with the last value
+static void check_offsets(const ArrayView<uint64_t>& offsets, uint64_t last, const char* name) {
+    if (offsets.empty() || offsets[0] != 0 || offsets.back() != last)
+        throw invalid_argument(string("Invalid binary model: inconsistent ") + name + ".");
+    for (size_t i = 1; i < offsets.size(); i++) {
+        if (offsets[i] < offsets[i - 1])
+            throw invalid_argument(string("Invalid binary model: decreasing ") + name + ".");
+    }
+}
+
+// **************************************************************************************
+//  Compiled MDP Class
+// **************************************************************************************
+
+template <class SType, class Storage>
+GCompiledRMDP<SType, Storage>::GCompiledRMDP()
+        : state_offsets(empty_offsets, 1), action_offsets(empty_offsets, 1), outcome_offsets(empty_offsets, 1) {}
+
+template <class SType, class Storage>
+GCompiledRMDP<SType, Storage>::GCompiledRMDP(const GRMDP<SType>& rmdp, bool keep_rewards) : GCompiledRMDP() {
+    auto arrays = make_shared<CompiledArrays<Storage>>();
+    auto& state_offsets = arrays->state_offsets;
+    auto& action_offsets = arrays->action_offsets;
+    auto& outcome_offsets = arrays->outcome_offsets;
+    auto& indices = arrays->indices;
+    auto& probabilities = arrays->probabilities;
+    auto& rewards = arrays->rewards;
+    auto& outcome_rewards = arrays->outcome_rewards;
+    auto& action_valid = arrays->action_valid;
+    auto& thresholds = arrays->thresholds;
+    auto& weights = arrays->weights;
+
+    state_offsets.push_back(0);
+    action_offsets.push_back(0);
+    outcome_offsets.push_back(0);
+
+    // count the elements first to allocate all memory at once
+    size_t action_total = 0, outcome_total = 0, transition_total = 0;
+    for (const auto& state : rmdp.get_states()) {
+        action_total += state.action_count();
+        for (const auto& action : state.get_actions()) {
+            const auto& outcomes = action.get_outcomes();
+            outcome_total += outcomes.size();
+            for (const auto& outcome : outcomes)
+                transition_total += outcome.size();
+        }
+    }
+
+    state_offsets.reserve(rmdp.state_count() + 1);
+    action_offsets.reserve(action_total + 1);
+    outcome_offsets.reserve(outcome_total + 1);
+    indices.reserve(transition_total);
+    probabilities.reserve(transition_total);
+    if (keep_rewards)
+        rewards.reserve(transition_total);
+    outcome_rewards.reserve(outcome_total);
+    action_valid.reserve(action_total);
+    thresholds.reserve(action_total);
+    weights.reserve(outcome_total);
+
+    for (const auto& state : rmdp.get_states()) {
+        for (const auto& action : state.get_actions()) {
+            const auto& outcomes = action.get_outcomes();
+            for (const auto& outcome : outcomes) {
+                const auto& tindices = outcome.get_indices();
+                const auto& tprobabilities = outcome.get_probabilities();
+                const auto& trewards = outcome.get_rewards();
+
+                indices.insert(indices.end(), tindices.begin(), tindices.end());
+                probabilities.insert(probabilities.end(), tprobabilities.begin(), tprobabilities.end());
+                if (keep_rewards)
+                    rewards.insert(rewards.end(), trewards.begin(), trewards.end());
+                // empty outcomes have no reward; computing their value fails later
+                outcome_rewards.push_back(Storage(outcome.empty() ? 0.0 : outcome.mean_reward()));
+                outcome_offsets.push_back(indices.size());
+            }
+            compile_weights(action, weights, thresholds);
+            action_valid.push_back(action.is_valid() ? 1 : 0);
+            action_offsets.push_back(outcome_offsets.size() - 1);
+        }
+        state_offsets.push_back(action_offsets.size() - 1);
+    }
+
+    // the views reference the vectors, which are kept by the shared storage
+    this->state_offsets = state_offsets;
+    this->action_offsets = action_offsets;
+    this->outcome_offsets = outcome_offsets;
+    this->indices = indices;
+    this->probabilities = probabilities;
+    this->rewards = rewards;
+    this->outcome_rewards = outcome_rewards;
+    this->action_valid = action_valid;
+    this->thresholds = thresholds;
+    this->weights = weights;
+    storage = arrays;
+}
+
+template <class SType, class Storage>
+void GCompiledRMDP<SType, Storage>::save(ostream& output) const {
+    BinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    copy(begin(binary_magic), end(binary_magic), header.magic);
+    header.version = binary_version;
+    header.model_type = compiled_type<SType>::value;
+    header.index_size = sizeof(idx_t);
+    header.scalar_size = sizeof(Storage);
+    header.byte_order = binary_byte_order;
+    header.state_count = state_count();
+    header.action_count = action_count();
+    header.outcome_count = outcome_count();
+    header.transition_count = transition_count();
+
+    const void* data[SectionCount] = {state_offsets.data(),
+            action_offsets.data(),
+            outcome_offsets.data(),
+            indices.data(),
+            probabilities.data(),
+            rewards.data(),
+            outcome_rewards.data(),
+            action_valid.data(),
+            thresholds.data(),
+            weights.data()};
+    const uint64_t bytes[SectionCount] = {state_offsets.size() * sizeof(uint64_t),
+            action_offsets.size() * sizeof(uint64_t),
+            outcome_offsets.size() * sizeof(uint64_t),
+            indices.size() * sizeof(idx_t),
+            probabilities.size() * sizeof(Storage),
+            rewards.size() * sizeof(Storage),
+            outcome_rewards.size() * sizeof(Storage),
+            action_valid.size() * sizeof(uint8_t),
+            thresholds.size() * sizeof(prec_t),
+            weights.size() * sizeof(prec_t)};
+
+    // arrays are aligned so that they can be used directly from the mapped file
+    uint64_t position = sizeof(BinaryHeader);
+    for (int i = 0; i < SectionCount; i++) {
+        position = (position + binary_alignment - 1) / binary_alignment * binary_alignment;
+        header.sections[i][0] = position;
+        header.sections[i][1] = bytes[i];
+        position += bytes[i];
+    }
+
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t written = sizeof(header);
+    const char padding[binary_alignment] = {};
+    for (int i = 0; i < SectionCount; i++) {
+        output.write(padding, header.sections[i][0] - written);
+        output.write(static_cast<const char*>(data[i]), bytes[i]);
+        written = header.sections[i][0] + bytes[i];
+    }
+    if (!output)
+        throw invalid_argument("Failed to write the binary model.");
+}
+
+template <class SType, class Storage>
+void GCompiledRMDP<SType, Storage>::save(const string& filename) const {
+    ofstream output(filename, ios::binary);
+    if (!output)
+        throw invalid_argument("Cannot open file " + filename + ".");
+    save(output);
+}
+
+template <class SType, class Storage>
+auto GCompiledRMDP<SType, Storage>::load(const string& filename, bool check_indices) -> GCompiledRMDP {
+    auto file = make_shared<MappedFile>(filename);
+
+    if (file->size() < sizeof(BinaryHeader))
+        throw invalid_argument("Invalid binary model: the file is too short.");
+    BinaryHeader header;
+    memcpy(&header, file->data(), sizeof(header));
+
+    if (!equal(begin(binary_magic), end(binary_magic), header.magic))
+        throw invalid_argument("Invalid binary model: not a binary model file.");
+    if (header.version != binary_version)
+        throw invalid_argument("Unsupported version of the binary model: " + to_string(header.version) + ".");
+    if (header.byte_order != binary_byte_order)
+        throw invalid_argument("The binary model was saved with a different byte order.");
+    if (header.model_type != compiled_type<SType>::value)
+        throw invalid_argument("The binary model has a different type of states.");
+    if (header.index_size != sizeof(idx_t))
+        throw invalid_argument("The binary model has a different size of indices: " +
+                               to_string(header.index_size) + " bytes.");
+    if (header.scalar_size != sizeof(Storage))
+        throw invalid_argument("The binary model has a different precision: " + to_string(header.scalar_size) +
+                               " bytes.");
+
+    // returns the array in the section and checks its size
+    auto section = [&](BinarySection i, uint64_t count, uint64_t elementsize) {
+        const uint64_t position = header.sections[i][0], bytes = header.sections[i][1];
+        if (bytes != count * elementsize || position % binary_alignment != 0 || position > file->size() ||
+                bytes > file->size() - position)
+            throw invalid_argument("Invalid binary model: corrupted array " + to_string(int(i)) + ".");
+        return file->data() + position;
+    };
+
+    GCompiledRMDP result;
+    result.state_offsets = OffsetArray(
+            reinterpret_cast<const uint64_t*>(section(StateOffsets, header.state_count + 1, sizeof(uint64_t))),
+            header.state_count + 1);
+    result.action_offsets = OffsetArray(
+            reinterpret_cast<const uint64_t*>(section(ActionOffsets, header.action_count + 1, sizeof(uint64_t))),
+            header.action_count + 1);
+    result.outcome_offsets = OffsetArray(
+            reinterpret_cast<const uint64_t*>(section(OutcomeOffsets, header.outcome_count + 1, sizeof(uint64_t))),
+            header.outcome_count + 1);
+    result.indices = ArrayView<idx_t>(
+            reinterpret_cast<const idx_t*>(section(Indices, header.transition_count, sizeof(idx_t))),
+            header.transition_count);
+    result.probabilities = StorageArray(
+            reinterpret_cast<const Storage*>(section(Probabilities, header.transition_count, sizeof(Storage))),
+            header.transition_count);
+    // rewards of transitions are optional
+    const uint64_t reward_count = header.sections[Rewards][1] == 0 ? 0 : header.transition_count;
+    result.rewards = StorageArray(
+            reinterpret_cast<const Storage*>(section(Rewards, reward_count, sizeof(Storage))), reward_count);
+    result.outcome_rewards = StorageArray(
+            reinterpret_cast<const Storage*>(section(OutcomeRewards, header.outcome_count, sizeof(Storage))),
+            header.outcome_count);
+    result.action_valid = ArrayView<uint8_t>(
+            reinterpret_cast<const uint8_t*>(section(ActionValid, header.action_count, sizeof(uint8_t))),
+            header.action_count);
+    result.thresholds = ArrayView<prec_t>(
+            reinterpret_cast<const prec_t*>(section(Thresholds, header.action_count, sizeof(prec_t))),
+            header.action_count);
+    result.weights = ArrayView<prec_t>(
+            reinterpret_cast<const prec_t*>(section(Weights, header.outcome_count, sizeof(prec_t))),
+            header.outcome_count);
+
+    check_offsets(result.state_offsets, header.action_count, "state offsets");
+    check_offsets(result.action_offsets, header.outcome_count, "action offsets");
+    check_offsets(result.outcome_offsets, header.transition_count, "outcome offsets");
+    if (check_indices) {
+        for (idx_t index : result.indices) {
+            if (index < 0 || uint64_t(index) >= header.state_count)
+                throw invalid_argument("Invalid binary model: target state out of range.");
+        }
+    }
+
+    result.storage = file;
+    return result;
+}
+
+template <class SType, class Storage>
+inline prec_t GCompiledRMDP<SType, Storage>::outcome_value(size_t outcome, const numvec& valuefunction, prec_t discount) const {
+    const size_t first = outcome_offsets[outcome], last = outcome_offsets[outcome + 1];
+    if (first == last)
+        throw range_error("No transitions defined. Cannot compute value.");
+
+    // the expected reward is precomputed, only the indices and probabilities are read
+    const prec_t future =
+            kernels::sparse_dot(indices.data() + first, probabilities.data() + first, last - first, valuefunction.data());
+    return outcome_rewards[outcome] + discount * future;
+}
+
+template <class SType, class Storage>
+auto GCompiledRMDP<SType, Storage>::select_outcome(size_t action,
+        const numvec& valuefunction,
+        prec_t discount,
+        bool maximize,
+        long) const -> pair<long, prec_t> {
+    const size_t first = action_offsets[action], last = action_offsets[action + 1];
+    if (first == last)
+        throw invalid_argument("Action with no outcomes.");
+
+    prec_t bestvalue = maximize ? -numeric_limits<prec_t>::infinity() : numeric_limits<prec_t>::infinity();
+    long result = -1;
+
+    for (size_t o = first; o < last; o++) {
+        auto value = outcome_value(o, valuefunction, discount);
+        if (maximize ? (value > bestvalue) : (value < bestvalue)) {
+            bestvalue = value;
+            result = o - first;
+        }
+    }
+    return make_pair(result, bestvalue);
+}
+
+template <class SType, class Storage>
+auto GCompiledRMDP<SType, Storage>::select_outcome(size_t action,
+        const numvec& valuefunction,
+        prec_t discount,
+        bool maximize,
+        const numvec&) const -> pair<numvec, prec_t> {
+    constexpr NatureConstr nature = compiled_nature<SType>::value;
+    if (nature == nullptr)
+        throw invalid_argument("The state type does not define nature's constraints.");
+
+    const size_t first = action_offsets[action], last = action_offsets[action + 1];
+    if (first == last)
+        throw invalid_argument("Action with no outcomes.");
+
+    // the values and weights are stored in the workspace of the thread to avoid allocations
+    NatureWorkspace& workspace = NatureWorkspace::local();
+    numvec& outcomevalues = workspace.values;
+    outcomevalues.resize(last - first);
+    for (size_t o = first; o < last; o++) {
+        auto value = outcome_value(o, valuefunction, discount);
+        outcomevalues[o - first] = maximize ? -value : value;
+    }
+    workspace.distribution.assign(weights.begin() + first, weights.begin() + last);
+
+    numvec result(last - first);
+    const prec_t value = compiled_nature<SType>::compute(outcomevalues.data(),
+            workspace.distribution.data(),
+            last - first,
+            thresholds[action],
+            result.data(),
+            workspace);
+    return make_pair(move(result), maximize ? -value : value);
+}
+
+template <class SType, class Storage>
+auto GCompiledRMDP<SType, Storage>::action_maximal(size_t action, const numvec& valuefunction, prec_t discount) const
+        -> pair<OutcomeId, prec_t> {
+    return select_outcome(action, valuefunction, discount, true, OutcomeId());
+}
+
+template <class SType, class Storage>
+auto GCompiledRMDP<SType, Storage>::action_minimal(size_t action, const numvec& valuefunction, prec_t discount) const
+        -> pair<OutcomeId, prec_t> {
+    return select_outcome(action, valuefunction, discount, false, OutcomeId());
+}
+
+template <class SType, class Storage>
+prec_t GCompiledRMDP<SType, Storage>::action_average(size_t action, const numvec& valuefunction, prec_t discount) const {
+    const size_t first = action_offsets[action], last = action_offsets[action + 1];
+    if (first == last)
+        throw invalid_argument("Action with no outcomes.");
+
+    prec_t averagevalue = 0.0;
+    for (size_t o = first; o < last; o++)
+        averagevalue += weights[o] * outcome_value(o, valuefunction, discount);
+    return averagevalue;
+}
+
+template <class SType, class Storage>
+prec_t GCompiledRMDP<SType, Storage>::action_fixed(size_t action,
+        const numvec& valuefunction,
+        prec_t discount,
+        long outcomeid) const {
+    const size_t first = action_offsets[action], last = action_offsets[action + 1];
+    // the outcome is ignored by regular actions, which have a single outcome
+    if (last - first == 1)
+        return outcome_value(first, valuefunction, discount);
+
+    assert(outcomeid >= 0l && outcomeid < (long)(last - first));
+    return outcome_value(first + outcomeid, valuefunction, discount);
+}
+
+template <class SType, class Storage>
+prec_t GCompiledRMDP<SType, Storage>::action_fixed(size_t action,
+        const numvec& valuefunction,
+        prec_t discount,
+        const numvec& distribution) const {
+    const size_t first = action_offsets[action], last = action_offsets[action + 1];
+    if (first == last)
+        throw invalid_argument("Action with no outcomes");
+    if (distribution.size() != last - first)
+        throw invalid_argument("Distribution size does not match number of outcomes");
+
+    prec_t averagevalue = 0.0;
+    for (size_t o = first; o < last; o++)
+        averagevalue += distribution[o - first] * outcome_value(o, valuefunction, discount);
+    return averagevalue;
+}
+
+template <class SType, class Storage>
+auto GCompiledRMDP<SType, Storage>::state_max_max(long stateid, const numvec& valuefunction, prec_t discount) const
+        -> tuple<ActionId, OutcomeId, prec_t> {
+    const size_t first = state_offsets[stateid], last = state_offsets[stateid + 1];
+    if (first == last)
+        return make_tuple(-1, OutcomeId(), 0);
+
+    prec_t maxvalue = -numeric_limits<prec_t>::infinity();
+    long result = -1l;
+    OutcomeId result_outcome = OutcomeId();
+
+    for (size_t a = first; a < last; a++) {
+        // skip invalid actions
+        if (!action_valid[a])
+            continue;
+
+        auto value = action_maximal(a, valuefunction, discount);
+        if (value.second > maxvalue) {
+            maxvalue = value.second;
+            result = a - first;
+            result_outcome = move(value.first);
+        }
+    }
+    return make_tuple(result, result_outcome, maxvalue);
+}
+
+template <class SType, class Storage>
+auto GCompiledRMDP<SType, Storage>::state_max_min(long stateid, const numvec& valuefunction, prec_t discount) const
+        -> tuple<ActionId, OutcomeId, prec_t> {
+    const size_t first = state_offsets[stateid], last = state_offsets[stateid + 1];
+    if (first == last)
+        return make_tuple(-1, OutcomeId(), 0);
+
+    prec_t maxvalue = -numeric_limits<prec_t>::infinity();
+    long result = -1l;
+    OutcomeId result_outcome = OutcomeId();
+
+    for (size_t a = first; a < last; a++) {
+        // skip invalid actions
+        if (!action_valid[a])
+            continue;
+
+        auto value = action_minimal(a, valuefunction, discount);
+        if (value.second > maxvalue) {
+            maxvalue = value.second;
+            result = a - first;
+            result_outcome = move(value.first);
+        }
+    }
+    return make_tuple(result, result_outcome, maxvalue);
+}
+
+template <class SType, class Storage>
+auto GCompiledRMDP<SType, Storage>::state_max_average(long stateid, const numvec& valuefunction, prec_t discount) const
+        -> pair<ActionId, prec_t> {
+    const size_t first = state_offsets[stateid], last = state_offsets[stateid + 1];
+    if (first == last)
+        return make_pair(-1, 0.0);
+
+    prec_t maxvalue = -numeric_limits<prec_t>::infinity();
+    long result = -1l;
+
+    for (size_t a = first; a < last; a++) {
+        // skip invalid actions
+        if (!action_valid[a])
+            continue;
+
+        auto value = action_average(a, valuefunction, discount);
+        if (value > maxvalue) {
+            maxvalue = value;
+            result = a - first;
+        }
+    }
+    return make_pair(result, maxvalue);
+}
+
+template <class SType, class Storage>
+size_t GCompiledRMDP<SType, Storage>::checked_action(long stateid, ActionId actionid) const {
+    const size_t first = state_offsets[stateid], last = state_offsets[stateid + 1];
+
+    if (actionid < 0 || actionid >= (long)(last - first))
+        throw range_error("invalid actionid: " + std::to_string(actionid) + " for action count: " +
+                std::to_string(last - first));
+
+    // cannot assume invalid actions
+    if (!action_valid[first + actionid])
+        throw invalid_argument("Cannot take an invalid action");
+
+    return first + actionid;
+}
+
+template <class SType, class Storage>
+prec_t GCompiledRMDP<SType, Storage>::state_fixed_fixed(long stateid,
+        const numvec& valuefunction,
+        prec_t discount,
+        ActionId actionid,
+        const OutcomeId& outcomeid) const {
+    // this is the terminal state, return 0
+    if (is_terminal(stateid))
+        return 0;
+    return action_fixed(checked_action(stateid, actionid), valuefunction, discount, outcomeid);
+}
+
+template <class SType, class Storage>
+prec_t GCompiledRMDP<SType, Storage>::state_fixed_average(long stateid,
+        const numvec& valuefunction,
+        prec_t discount,
+        ActionId actionid) const {
+    // this is the terminal state, return 0
+    if (is_terminal(stateid))
+        return 0;
+    return action_average(checked_action(stateid, actionid), valuefunction, discount);
+}
+
+template <class SType, class Storage>
+auto GCompiledRMDP<SType, Storage>::state_update(long stateid,
+        Uncertainty uncert,
+        const numvec& valuefunction,
+        prec_t discount) const -> tuple<ActionId, OutcomeId, prec_t> {
+    switch (uncert) {
+    case Uncertainty::Robust:
+        return state_max_min(stateid, valuefunction, discount);
+    case Uncertainty::Optimistic:
+        return state_max_max(stateid, valuefunction, discount);
+    case Uncertainty::Average:
+        pair<ActionId, prec_t> avgvalue = state_max_average(stateid, valuefunction, discount);
+        return make_tuple(avgvalue.first, OutcomeId(), avgvalue.second);
+    }
+    throw invalid_argument("Unknown type of uncertainty.");
+}
+
+template <class SType, class Storage>
+auto GCompiledRMDP<SType, Storage>::vi_gs(Uncertainty type,
+        prec_t discount,
+        numvec valuefunction,
+        unsigned long iterations,
+        prec_t maxresidual) const -> SolType {
+    // just quit if there are not states
+    if (state_count() == 0)
+        return SolType();
+
+    // check if the value function is a correct size, and if it is length 0
+    // then creates an appropriate size
+    if (valuefunction.size() > 0) {
+        if (valuefunction.size() != state_count())
+            throw invalid_argument("Incorrect dimensions of value function.");
+    } else
+        valuefunction.assign(state_count(), 0.0);
+
+    ActionPolicy policy(state_count());
+    OutcomePolicy outcomes(state_count());
+
+    prec_t residual = numeric_limits<prec_t>::infinity();
+    size_t i;
+
+    for (i = 0; i < iterations && residual > maxresidual; i++) {
+        residual = 0;
+
+        for (size_t s = 0l; s < state_count(); s++) {
+            auto newvalue = state_update(s, type, valuefunction, discount);
+
+            residual = max(residual, abs(valuefunction[s] - get<2>(newvalue)));
+            valuefunction[s] = get<2>(newvalue);
+
+            policy[s] = get<0>(newvalue);
+            outcomes[s] = move(get<1>(newvalue));
+        }
+    }
+    return SolType(valuefunction, policy, outcomes, residual, i);
+}
+
+template <class SType, class Storage>
+auto GCompiledRMDP<SType, Storage>::vi_jac(Uncertainty type,
+        prec_t discount,
+        const numvec& valuefunction,
+        unsigned long iterations,
+        prec_t maxresidual) const -> SolType {
+    // just quit if there are not states
+    if (state_count() == 0)
+        return SolType();
+
+    if ((valuefunction.size() > 0) && (valuefunction.size() != state_count()))
+        throw invalid_argument("Incorrect size of value function.");
+
+    numvec oddvalue(0); // set in even iterations (0 is even)
+    numvec evenvalue(0); // set in odd iterations
+
+    if (valuefunction.size() > 0) {
+        oddvalue = valuefunction;
+        evenvalue = valuefunction;
+    } else {
+        oddvalue.assign(state_count(), 0);
+        evenvalue.assign(state_count(), 0);
+    }
+
+    ActionPolicy policy(state_count());
+    OutcomePolicy outcomes(state_count());
+
+    numvec residuals(state_count());
+
+    prec_t residual = numeric_limits<prec_t>::infinity();
+    size_t i;
+
+    for (i = 0; i < iterations && residual > maxresidual; i++) {
+        numvec& sourcevalue = i % 2 == 0 ? oddvalue : evenvalue;
+        numvec& targetvalue = i % 2 == 0 ? evenvalue : oddvalue;
+
+#pragma omp parallel for
+        for (auto s = 0l; s < (long)state_count(); s++) {
+            auto newvalue = state_update(s, type, sourcevalue, discount);
+
+            residuals[s] = abs(sourcevalue[s] - get<2>(newvalue));
+            targetvalue[s] = get<2>(newvalue);
+
+            policy[s] = get<0>(newvalue);
+            outcomes[s] = move(get<1>(newvalue));
+        }
+        residual = *max_element(residuals.begin(), residuals.end());
+    }
+    numvec& valuenew = i % 2 == 0 ? oddvalue : evenvalue;
+    return SolType(valuenew, policy, outcomes, residual, i);
+}
+
+template <class SType, class Storage>
+auto GCompiledRMDP<SType, Storage>::mpi_jac(Uncertainty type,
+        prec_t discount,
+        const numvec& valuefunction,
+        unsigned long iterations_pi,
+        prec_t maxresidual_pi,
+        unsigned long iterations_vi,
+        prec_t maxresidual_vi,
+        bool show_progress) const -> SolType {
+    // just quit if there are no states
+    if (state_count() == 0)
+        return SolType();
+
+    if ((valuefunction.size() > 0) && (valuefunction.size() != state_count()))
+        throw invalid_argument("Incorrect size of value function.");
+
+    numvec oddvalue(0); // set in even iterations (0 is even)
+    numvec evenvalue(0); // set in odd iterations
+
+    if (valuefunction.size() > 0) {
+        oddvalue = valuefunction;
+        evenvalue = valuefunction;
+    } else {
+        oddvalue.assign(state_count(), 0);
+        evenvalue.assign(state_count(), 0);
+    }
+
+    ActionPolicy policy(state_count());
+    OutcomePolicy outcomes(state_count());
+
+    numvec residuals(state_count());
+
+    prec_t residual_pi = numeric_limits<prec_t>::infinity();
+
+    size_t i; // defined here to be able to report the number of iterations
+
+    numvec* sourcevalue = &oddvalue;
+    numvec* targetvalue = &evenvalue;
+
+    for (i = 0; i < iterations_pi; i++) {
+        if (show_progress)
+            cout << "Policy iteration " << i << "/" << iterations_pi << ":" << endl;
+
+        std::swap<numvec*>(targetvalue, sourcevalue);
+
+        prec_t residual_vi = numeric_limits<prec_t>::infinity();
+
+// update policies
+#pragma omp parallel for
+        for (auto s = 0l; s < (long)state_count(); s++) {
+            auto newvalue = state_update(s, type, *sourcevalue, discount);
+
+            residuals[s] = abs((*sourcevalue)[s] - get<2>(newvalue));
+            (*targetvalue)[s] = get<2>(newvalue);
+
+            policy[s] = get<0>(newvalue);
+            outcomes[s] = move(get<1>(newvalue));
+        }
+
+        residual_pi = *max_element(residuals.begin(), residuals.end());
+
+        if (show_progress)
+            cout << "    Bellman residual: " << residual_pi << endl;
+
+        // the residual is sufficiently small
+        if (residual_pi <= maxresidual_pi)
+            break;
+
+        if (show_progress)
+            cout << "    Value iteration: ";
+        // compute values using value iteration
+        for (size_t j = 0; j < iterations_vi && residual_vi > maxresidual_vi; j++) {
+            if (show_progress)
+                cout << ".";
+
+            swap(targetvalue, sourcevalue);
+
+#pragma omp parallel for
+            for (auto s = 0l; s < (long)state_count(); s++) {
+                prec_t newvalue = 0;
+
+                switch (type) {
+                case Uncertainty::Robust:
+                case Uncertainty::Optimistic:
+                    newvalue = state_fixed_fixed(s, *sourcevalue, discount, policy[s], outcomes[s]);
+                    break;
+                case Uncertainty::Average:
+                    newvalue = state_fixed_average(s, *sourcevalue, discount, policy[s]);
+                    break;
+                }
+
+                residuals[s] = abs((*sourcevalue)[s] - newvalue);
+                (*targetvalue)[s] = newvalue;
+            }
+            residual_vi = *max_element(residuals.begin(), residuals.end());
+        }
+        if (show_progress)
+            cout << endl << "    Residual (fixed policy): " << residual_vi << endl << endl;
+    }
+    numvec& valuenew = *targetvalue;
+    return SolType(valuenew, policy, outcomes, residual_pi, i);
+}
+
+template <class SType, class Storage>
+auto GCompiledRMDP<SType, Storage>::vi_jac_fix(prec_t discount,
+        const ActionPolicy& policy,
+        const OutcomePolicy& natpolicy,
+        const numvec& valuefunction,
+        unsigned long iterations,
+        prec_t maxresidual) const -> SolType {
+    // just quit if there are not states
+    if (state_count() == 0)
+        return SolType();
+
+    if (policy.size() != state_count())
+        throw invalid_argument("Dimension of the policy must match the state count.");
+    if (natpolicy.size() != state_count())
+        throw invalid_argument("Dimension of the nature's policy must match the state count.");
+
+    numvec oddvalue(0); // set in even iterations (0 is even)
+    numvec evenvalue(0); // set in odd iterations
+
+    if (valuefunction.size() > 0) {
+        oddvalue = valuefunction;
+        evenvalue = valuefunction;
+    } else {
+        oddvalue.assign(state_count(), 0);
+        evenvalue.assign(state_count(), 0);
+    }
+
+    numvec residuals(state_count());
+    prec_t residual = numeric_limits<prec_t>::infinity();
+
+    size_t j; // defined here to be able to report the number of iterations
+
+    numvec* sourcevalue = &oddvalue;
+    numvec* targetvalue = &evenvalue;
+
+    for (j = 0; j < iterations && residual > maxresidual; j++) {
+        swap(targetvalue, sourcevalue);
+
+#pragma omp parallel for
+        for (auto s = 0l; s < (long)state_count(); s++) {
+            auto newvalue = state_fixed_fixed(s, *sourcevalue, discount, policy[s], natpolicy[s]);
+
+            residuals[s] = abs((*sourcevalue)[s] - newvalue);
+            (*targetvalue)[s] = newvalue;
+        }
+        residual = *max_element(residuals.begin(), residuals.end());
+    }
+
+    return SolType(*targetvalue, policy, natpolicy, residual, j);
+}
+
+// **********************************************************************
+// *********************    TEMPLATE DECLARATIONS    ********************
+// **********************************************************************
+
+template class GCompiledRMDP<RegularState>;
+template class GCompiledRMDP<DiscreteRobustState>;
+template class GCompiledRMDP<L1RobustState>;
+
+template class GCompiledRMDP<RegularState, float>;
+template class GCompiledRMDP<DiscreteRobustState, float>;
+template class GCompiledRMDP<L1RobustState, float>;
+}
@@ -186,7 +186,7 @@ unique_ptr<T> MDPI::from_csv(istream& input_mdp, istream& input_state2obs, istre
         getline(linestream, cellstring, ',');
         auto idstate = stoi(cellstring);
         getline(linestream, cellstring, ',');
-        auto prob = stof(cellstring);
+        auto prob = stod(cellstring);
         initial.add_sample(idstate, prob, 0.0);
 
         input_initial >> line;
@@ -267,7 +267,7 @@ void MDPI_R::initialize_robustmdp() {
         robust_mdp.create_state(obs);
 
         // maps the transitions
-        for (auto action_index : range(0l, action_counts[obs])) {
+        for (auto action_index : range(idx_t(0), action_counts[obs])) {
             // get original MDP transition
             const Transition& old_tran = mdp->get_state(state_index).get_action(action_index).get_outcome();
             // create a new transition
@@ -341,7 +341,7 @@ indvec MDPI_R::solve_reweighted(long iterations, prec_t discount, const indvec&
         (void)iter; // to remove the warning
 
         // compute state distribution
-        numvec&& importanceweights = mdp->ofreq_mat(initial, discount, statepol, nature);
+        numvec&& importanceweights = mdp->ofreq_sparse(initial, discount, statepol, nature);
         // update importance weights
         update_importance_weights(importanceweights);
         // compute solution of the robust MDP with the new weights
@@ -376,7 +376,7 @@ indvec MDPI_R::solve_robust(long iterations, prec_t threshold, prec_t discount,
         (void)iter; // to remove the warning
 
         // compute state distribution
-        numvec&& importanceweights = mdp->ofreq_mat(initial, discount, statepol, nature);
+        numvec&& importanceweights = mdp->ofreq_sparse(initial, discount, statepol, nature);
 
         // update importance weights
         update_importance_weights(importanceweights);
@@ -0,0 +1,95 @@
+#include "MappedFile.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CRAAM_POSIX_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace craam {
+
+#ifdef CRAAM_POSIX_MMAP
+
+MappedFile::MappedFile(const string& filename) : MappedFile() {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw invalid_argument("Cannot open file " + filename + ".");
+
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        ::close(fd);
+        throw invalid_argument("Cannot determine the size of file " + filename + ".");
+    }
+    length = size_t(status.st_size);
+
+    // an empty file cannot be mapped
+    if (length > 0) {
+        void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            ::close(fd);
+            throw invalid_argument("Cannot map file " + filename + " to memory.");
+        }
+        // the file is usually read from the beginning to the end
+        madvise(address, length, MADV_SEQUENTIAL);
+        content = static_cast<const char*>(address);
+        mapped = true;
+    }
+    // the mapping remains valid after closing the descriptor
+    ::close(fd);
+}
+
+void MappedFile::close() {
+    if (mapped)
+        munmap(const_cast<char*>(content), length);
+    buffer.clear();
+    content = nullptr;
+    length = 0;
+    mapped = false;
+}
+
+#else
+
+MappedFile::MappedFile(const string& filename) : MappedFile() {
+    ifstream input(filename, ios::binary);
+    if (!input)
+        throw invalid_argument("Cannot open file " + filename + ".");
+    buffer.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    content = buffer.data();
+    length = buffer.size();
+}
+
+void MappedFile::close() {
+    buffer.clear();
+    content = nullptr;
+    length = 0;
+    mapped = false;
+}
+
+#endif
+
+MappedFile::MappedFile(MappedFile&& other) : MappedFile() {
+    *this = move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) {
+    if (this != &other) {
+        close();
+        mapped = other.mapped;
+        length = other.length;
+        buffer = move(other.buffer);
+        // the buffer content does not move when the vector is moved
+        content = other.content;
+        other.content = nullptr;
+        other.length = 0;
+        other.mapped = false;
+    }
+    return *this;
+}
+}
@@ -0,0 +1,95 @@
+#include "ModelBuilder.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <tuple>
+
+namespace craam {
+
+void ModelBuilder::add_transition(long fromid,
+        long actionid,
+        long outcomeid,
+        long toid,
+        prec_t probability,
+        prec_t reward) {
+    if (fromid < 0 || actionid < 0 || outcomeid < 0 || toid < 0)
+        throw invalid_argument("State, action, and outcome ids must be non-negative.");
+    if (probability < -0.001)
+        throw invalid_argument("probabilities must be non-negative.");
+
+    entries.push_back(Entry{checked_index(fromid),
+            checked_index(actionid),
+            checked_index(outcomeid),
+            checked_index(toid),
+            probability,
+            reward});
+}
+
+template <class Model>
+Model& ModelBuilder::build(Model& mdp) const {
+    if (entries.empty())
+        return mdp;
+
+    // make sure that all states (including the destinations) exist
+    long maxid = 0;
+    for (const Entry& e : entries)
+        maxid = max(maxid, long(max(e.fromid, e.toid)));
+    mdp.create_state(maxid);
+
+    // group the transitions by the originating state (counting sort)
+    vector<size_t> offsets(maxid + 2, 0);
+    for (const Entry& e : entries)
+        offsets[e.fromid + 1]++;
+    partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    vector<Entry> grouped(entries.size());
+    {
+        vector<size_t> positions(offsets.begin(), offsets.end() - 1);
+        for (const Entry& e : entries)
+            grouped[positions[e.fromid]++] = e;
+    }
+
+    // states are independent and can be processed in parallel
+#pragma omp parallel for schedule(dynamic, 64)
+    for (long s = 0; s <= maxid; s++) {
+        const auto first = grouped.begin() + offsets[s], last = grouped.begin() + offsets[s + 1];
+        if (first == last)
+            continue;
+
+        sort(first, last, [](const Entry& a, const Entry& b) {
+            return tie(a.actionid, a.outcomeid, a.toid) < tie(b.actionid, b.outcomeid, b.toid);
+        });
+
+        auto& state = mdp.get_state(s);
+        for (auto it = first; it != last;) {
+            const auto group = it;
+            Transition& outcome = state.create_action(group->actionid).create_outcome(group->outcomeid);
+
+            // aggregate all transitions to the same target
+            prec_t probability = 0.0, weightedreward = 0.0;
+            for (; it != last && it->actionid == group->actionid && it->outcomeid == group->outcomeid &&
+                    it->toid == group->toid;
+                    ++it) {
+                if (it->probability > 0) {
+                    probability += it->probability;
+                    weightedreward += it->probability * it->reward;
+                }
+            }
+            // targets are sorted, so this appends to the end of a new transition
+            if (probability > 0)
+                outcome.add_sample(group->toid, probability, weightedreward / probability);
+        }
+    }
+    return mdp;
+}
+
+// **********************************************************************
+// *********************    TEMPLATE DECLARATIONS    ********************
+// **********************************************************************
+
+template MDP& ModelBuilder::build<MDP>(MDP& mdp) const;
+template RMDP_D& ModelBuilder::build<RMDP_D>(RMDP_D& mdp) const;
+template RMDP_L1& ModelBuilder::build<RMDP_L1>(RMDP_L1& mdp) const;
+template RMDP_SL1& ModelBuilder::build<RMDP_SL1>(RMDP_SL1& mdp) const;
+}
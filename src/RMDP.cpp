@@ -1,8 +1,12 @@
 #include "RMDP.hpp"
+#include "CompiledRMDP.hpp"
 
 #include <algorithm>
+#include <deque>
 #include <iostream>
 #include <limits>
+#include <numeric>
+#include <queue>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -12,6 +16,10 @@
 
 #include "cpp11-range-master/range.hpp"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 // this is just for a matrix printout / remove if cout is not used
 // #include <boost/numeric/ublas/io.hpp>
 
@@ -19,19 +27,555 @@ using namespace util::lang;
 
 namespace craam {
 
+// **************************************************************************************
+//  Distribution array
+// **************************************************************************************
+
+DistributionArray::DistributionArray(const vector<numvec>& distributions)
+        : offsets(distributions.size() + 1, 0), values(0) {
+    for (size_t i = 0; i < distributions.size(); i++)
+        offsets[i + 1] = offsets[i] + distributions[i].size();
+    values.reserve(offsets.back());
+    for (const auto& distribution : distributions)
+        values.insert(values.end(), distribution.begin(), distribution.end());
+}
+
+DistributionArray::DistributionArray(vector<size_t> offsets, numvec values)
+        : offsets(move(offsets)), values(move(values)) {
+    if (this->offsets.empty() || this->offsets.front() != 0)
+        throw invalid_argument("The offsets must start with 0.");
+    if (!is_sorted(this->offsets.begin(), this->offsets.end()))
+        throw invalid_argument("The offsets must be non-decreasing.");
+    if (this->offsets.back() != this->values.size())
+        throw invalid_argument("The last offset must be the number of values.");
+}
+
+vector<numvec> DistributionArray::to_vectors() const {
+    vector<numvec> result;
+    result.reserve(size());
+    for (size_t i = 0; i < size(); i++)
+        result.emplace_back((*this)[i]);
+    return result;
+}
+
+/**
+Order in which vi_gs_par updates the states. The states in `order` are grouped in
+blocks, and the blocks are grouped by colors. Blocks of the same color do not
+depend on each other.
+*/
+struct BlockSchedule {
+    /// States in the order of the update
+    vector<size_t> order;
+    /// Positions in order where each block starts (one more element than blocks)
+    vector<size_t> block_offsets;
+    /// Positions in block_offsets where each color starts (one more element than colors)
+    vector<size_t> color_offsets;
+};
+
+/**
+Greedily colors an undirected graph in the order of the vertexes.
+\param neighbors Neighbors of each vertex
+\returns Color of each vertex
+*/
+static vector<size_t> greedy_coloring(const vector<vector<size_t>>& neighbors) {
+    const size_t none = numeric_limits<size_t>::max();
+    vector<size_t> colors(neighbors.size(), none);
+    // the last vertex whose neighbor uses each color
+    vector<size_t> used;
+    for (size_t v = 0; v < neighbors.size(); v++) {
+        for (size_t u : neighbors[v]) {
+            if (colors[u] != none)
+                used[colors[u]] = v;
+        }
+        size_t c = 0;
+        while (c < used.size() && used[c] == v)
+            c++;
+        if (c == used.size())
+            used.push_back(none);
+        colors[v] = c;
+    }
+    return colors;
+}
+
+/**
+Adds undirected edges between the groups of states that depend on each other.
+\param states States of the model
+\param group Group of each state
+\param groups Number of groups
+\returns Sorted neighbors of each group (a group is not its own neighbor)
+*/
+template <class SType>
+static vector<vector<size_t>> group_neighbors(const vector<SType>& states, const vector<size_t>& group,
+        size_t groups) {
+    vector<vector<size_t>> neighbors(groups);
+    for (size_t s = 0; s < states.size(); s++) {
+        for (const auto& action : states[s].get_actions()) {
+            for (const auto& outcome : action.get_outcomes()) {
+                for (auto t : outcome.get_indices()) {
+                    if (size_t(t) >= states.size() || group[t] == group[s])
+                        continue;
+                    neighbors[group[s]].push_back(group[t]);
+                    neighbors[group[t]].push_back(group[s]);
+                }
+            }
+        }
+    }
+    for (auto& n : neighbors) {
+        sort(n.begin(), n.end());
+        n.erase(unique(n.begin(), n.end()), n.end());
+    }
+    return neighbors;
+}
+
+/**
+Constructs the blocks and their colors for vi_gs_par.
+\param states States of the model
+\param partition How to partition the states
+\param block_size Maximal size of a block, 0 to choose automatically
+*/
+template <class SType>
+static BlockSchedule block_schedule(const vector<SType>& states, BlockPartition partition, size_t block_size) {
+    const size_t n = states.size();
+#ifdef _OPENMP
+    const size_t threads = omp_get_max_threads();
+#else
+    const size_t threads = 1;
+#endif
+    BlockSchedule schedule;
+
+    if (partition == BlockPartition::Ranges) {
+        // several blocks per thread to balance the load
+        if (block_size == 0)
+            block_size = max<size_t>(1, (n + 4 * threads - 1) / (4 * threads));
+        const size_t blocks = (n + block_size - 1) / block_size;
+
+        vector<size_t> group(n);
+        for (size_t s = 0; s < n; s++)
+            group[s] = s / block_size;
+        const auto colors = greedy_coloring(group_neighbors(states, group, blocks));
+        const size_t colorcount = *max_element(colors.begin(), colors.end()) + 1;
+
+        // order blocks by color, and keep the order of states within each block
+        vector<size_t> blockorder(blocks);
+        iota(blockorder.begin(), blockorder.end(), 0);
+        stable_sort(blockorder.begin(), blockorder.end(),
+                [&](size_t a, size_t b) { return colors[a] < colors[b]; });
+
+        schedule.order.reserve(n);
+        schedule.color_offsets.assign(colorcount + 1, 0);
+        schedule.block_offsets.push_back(0);
+        for (size_t b : blockorder) {
+            for (size_t s = b * block_size; s < min(n, (b + 1) * block_size); s++)
+                schedule.order.push_back(s);
+            schedule.block_offsets.push_back(schedule.order.size());
+            schedule.color_offsets[colors[b] + 1]++;
+        }
+        partial_sum(schedule.color_offsets.begin(), schedule.color_offsets.end(), schedule.color_offsets.begin());
+    } else {
+        // states of the same color are independent and can be split into blocks arbitrarily
+        vector<size_t> group(n);
+        iota(group.begin(), group.end(), 0);
+        const auto colors = greedy_coloring(group_neighbors(states, group, n));
+        const size_t colorcount = *max_element(colors.begin(), colors.end()) + 1;
+
+        schedule.order.resize(n);
+        iota(schedule.order.begin(), schedule.order.end(), 0);
+        stable_sort(schedule.order.begin(), schedule.order.end(),
+                [&](size_t a, size_t b) { return colors[a] < colors[b]; });
+
+        schedule.color_offsets.push_back(0);
+        schedule.block_offsets.push_back(0);
+        size_t first = 0;
+        for (size_t c = 0; c < colorcount; c++) {
+            size_t last = first;
+            while (last < n && colors[schedule.order[last]] == c)
+                last++;
+            // split the color to give every thread several blocks
+            const size_t size =
+                    block_size > 0 ? block_size : max<size_t>(64, (last - first + 4 * threads - 1) / (4 * threads));
+            for (size_t b = first; b < last; b += size)
+                schedule.block_offsets.push_back(min(last, b + size));
+            schedule.color_offsets.push_back(schedule.block_offsets.size() - 1);
+            first = last;
+        }
+    }
+    return schedule;
+}
+
 // **************************************************************************************
 //  Generic MDP Class
 // **************************************************************************************
 
+/**
+Computes the Bellman update for a single state.
+\param eliminated Bits of the actions to skip, or nullptr
+\param actionvalues Output of the values of the actions that are not skipped, or nullptr
+\returns Tuple with the optimal action, outcome, and the new value
+*/
+template <class SType>
+static tuple<typename SType::ActionId, typename SType::OutcomeId, prec_t> bellman_update(const SType& state,
+        Uncertainty type,
+        const numvec& valuefunction,
+        prec_t discount,
+        const ActionMask::Word* eliminated = nullptr,
+        prec_t* actionvalues = nullptr) {
+    switch (type) {
+    case Uncertainty::Robust:
+        return state.max_min(valuefunction, discount, eliminated, actionvalues);
+    case Uncertainty::Optimistic:
+        return state.max_max(valuefunction, discount, eliminated, actionvalues);
+    case Uncertainty::Average:
+    default:
+        auto avgvalue = state.max_average(valuefunction, discount, eliminated, actionvalues);
+        return make_tuple(avgvalue.first, typename SType::OutcomeId(), avgvalue.second);
+    }
+}
+
+/**
+Computes the Bellman update for a single state without nature's response; see
+bellman_update.
+\returns Pair with the optimal action and the new value
+*/
+template <class SType>
+static pair<typename SType::ActionId, prec_t> bellman_value(const SType& state,
+        Uncertainty type,
+        const numvec& valuefunction,
+        prec_t discount,
+        const ActionMask::Word* eliminated = nullptr,
+        prec_t* actionvalues = nullptr) {
+    switch (type) {
+    case Uncertainty::Robust:
+        return state.max_min_value(valuefunction, discount, eliminated, actionvalues);
+    case Uncertainty::Optimistic:
+        return state.max_max_value(valuefunction, discount, eliminated, actionvalues);
+    case Uncertainty::Average:
+    default:
+        return state.max_average(valuefunction, discount, eliminated, actionvalues);
+    }
+}
+
+/**
+Computes nature's responses to the actions of the policy. Value iteration computes
+only the values in its sweeps, since just the responses for the final value function
+are returned.
+\param policy Actions of the states; negative for terminal states
+\param outcomes Output of the outcomes (one for each state)
+*/
+template <class SType>
+static void nature_responses(const vector<SType>& states,
+        Uncertainty type,
+        const numvec& valuefunction,
+        prec_t discount,
+        const vector<typename SType::ActionId>& policy,
+        vector<typename SType::OutcomeId>& outcomes) {
+    if (type == Uncertainty::Average)
+        return;
+
+#pragma omp parallel for
+    for (auto s = 0l; s < (long)states.size(); s++) {
+        if (policy[s] < 0)
+            continue;
+        const auto& action = states[s].get_action(policy[s]);
+        outcomes[s] = type == Uncertainty::Robust ? action.minimal(valuefunction, discount).first
+                                                  : action.maximal(valuefunction, discount).first;
+    }
+}
+
+/**
+Recomputes nature's responses only in the selected states and keeps the outcomes of
+the other states; see nature_responses. The outcomes are extended to all states.
+\param selected Whether to recompute the response in each state
+*/
+template <class SType>
+static void update_responses(const vector<SType>& states,
+        Uncertainty type,
+        const numvec& valuefunction,
+        prec_t discount,
+        const vector<typename SType::ActionId>& policy,
+        const vector<bool>& selected,
+        vector<typename SType::OutcomeId>& outcomes) {
+    outcomes.resize(states.size());
+
+#pragma omp parallel for
+    for (auto s = 0l; s < (long)states.size(); s++) {
+        if (!selected[s])
+            continue;
+        if (type == Uncertainty::Average || policy[s] < 0) {
+            outcomes[s] = typename SType::OutcomeId();
+            continue;
+        }
+        const auto& action = states[s].get_action(policy[s]);
+        outcomes[s] = type == Uncertainty::Robust ? action.minimal(valuefunction, discount).first
+                                                  : action.maximal(valuefunction, discount).first;
+    }
+}
+
+/** Number of elements of nature's response to the action; 0 in terminal states */
+template <class SType>
+static size_t response_size(const SType& state, typename SType::ActionId action) {
+    return action < 0 ? 0 : state.get_action(action).size();
+}
+
+/** Number of elements of nature's response to the randomized action; 0 in terminal states */
+static size_t response_size(const L1SRobustState& state, const numvec& action) {
+    return action.empty() ? 0 : state.outcome_count();
+}
+
+/** Computes nature's response to the action in the memory provided by the caller */
+template <class SType>
+static void state_response(const SType& state,
+        Uncertainty type,
+        const numvec& valuefunction,
+        prec_t discount,
+        typename SType::ActionId action,
+        prec_t* outcome) {
+    state.get_action(action).nature_response(valuefunction, discount, type == Uncertainty::Optimistic, outcome);
+}
+
+/** Computes nature's response to the randomized action in the memory provided by the caller */
+static void state_response(const L1SRobustState& state,
+        Uncertainty type,
+        const numvec& valuefunction,
+        prec_t discount,
+        const numvec& action,
+        prec_t* outcome) {
+    state.nature_response(valuefunction, discount, type == Uncertainty::Optimistic, action, outcome);
+}
+
+/** Allocates the storage of nature's responses to the actions of the policy */
+template <class SType>
+static void allocate_responses(const vector<SType>& states,
+        Uncertainty,
+        const vector<typename SType::ActionId>&,
+        vector<typename SType::OutcomeId>& outcomes) {
+    outcomes.assign(states.size(), typename SType::OutcomeId());
+}
+
+/**
+Allocates the contiguous storage of nature's responses to the actions of the policy;
+the distributions are empty for the average type of uncertainty.
+*/
+template <class SType>
+static void allocate_responses(const vector<SType>& states,
+        Uncertainty type,
+        const vector<typename SType::ActionId>& policy,
+        DistributionArray& outcomes) {
+    vector<size_t> offsets(states.size() + 1, 0);
+    for (size_t s = 0; s < states.size(); s++)
+        offsets[s + 1] = offsets[s] + (type == Uncertainty::Average ? 0 : response_size(states[s], policy[s]));
+    const size_t total = offsets.back();
+    outcomes = DistributionArray(move(offsets), numvec(total));
+}
+
+/**
+Computes nature's responses to the actions of the policy directly in the contiguous
+storage; see the version with a vector. The responses have one element for each
+outcome of the action, or of all the actions of s-rectangular states.
+*/
+template <class SType>
+static void nature_responses(const vector<SType>& states,
+        Uncertainty type,
+        const numvec& valuefunction,
+        prec_t discount,
+        const vector<typename SType::ActionId>& policy,
+        DistributionArray& outcomes) {
+    if (type == Uncertainty::Average)
+        return;
+
+    allocate_responses(states, type, policy, outcomes);
+
+#pragma omp parallel for
+    for (auto s = 0l; s < (long)states.size(); s++) {
+        if (!outcomes[s].empty())
+            state_response(states[s], type, valuefunction, discount, policy[s], outcomes.data(s));
+    }
+}
+
+/**
+Recomputes nature's responses only in the selected states directly in the contiguous
+storage; see the version with a vector.
+*/
+template <class SType>
+static void update_responses(const vector<SType>& states,
+        Uncertainty type,
+        const numvec& valuefunction,
+        prec_t discount,
+        const vector<typename SType::ActionId>& policy,
+        const vector<bool>& selected,
+        DistributionArray& outcomes) {
+    // the other states keep the sizes of their outcomes
+    vector<size_t> offsets(states.size() + 1, 0);
+    for (size_t s = 0; s < states.size(); s++) {
+        const size_t size = selected[s] ? (type == Uncertainty::Average ? 0 : response_size(states[s], policy[s]))
+                                        : (s < outcomes.size() ? outcomes[s].size() : 0);
+        offsets[s + 1] = offsets[s] + size;
+    }
+    const size_t total = offsets.back();
+    DistributionArray result(move(offsets), numvec(total));
+
+#pragma omp parallel for
+    for (auto s = 0l; s < (long)states.size(); s++) {
+        if (!selected[s]) {
+            if (size_t(s) < outcomes.size())
+                copy(outcomes[s].begin(), outcomes[s].end(), result.data(s));
+        } else if (!result[s].empty())
+            state_response(states[s], type, valuefunction, discount, policy[s], result.data(s));
+    }
+    outcomes = move(result);
+}
+
+/** Whether the actions of the state type share the uncertainty set */
+template <class SType>
+struct is_s_rectangular : false_type {};
+template <>
+struct is_s_rectangular<L1SRobustState> : true_type {};
+
+/**
+Values of all actions computed during a sweep, used to eliminate actions.
+*/
+class ActionElimination {
+public:
+    /**
+    Prepares the elimination; it is disabled when mask is nullptr, and for s-rectangular
+    states, which do not compute the values of the individual actions.
+    \param states States of the model
+    \param enabled Whether the model satisfies the assumptions of the bounds
+    \param mask Eliminated actions; initialized when it does not match the model
+    */
+    template <class SType>
+    ActionElimination(const vector<SType>& states, bool enabled, ActionMask* mask)
+            : mask(enabled && !is_s_rectangular<SType>::value ? mask : nullptr), offsets(states.size() + 1, 0) {
+        if (this->mask == nullptr)
+            return;
+        vector<size_t> counts(states.size());
+        for (size_t s = 0; s < states.size(); s++) {
+            counts[s] = states[s].action_count();
+            offsets[s + 1] = offsets[s] + counts[s];
+        }
+        if (mask->state_count() != states.size())
+            *mask = ActionMask(counts);
+        values.resize(offsets.back());
+    }
+
+    /** Whether actions are being eliminated */
+    bool enabled() const { return mask != nullptr; };
+
+    /** Bits of the actions of the state to skip, or nullptr */
+    const ActionMask::Word* state_words(size_t stateid) const {
+        return mask ? mask->state_words(stateid) : nullptr;
+    };
+
+    /** Location for the values of the actions of the state, or nullptr */
+    prec_t* state_values(size_t stateid) { return mask ? values.data() + offsets[stateid] : nullptr; };
+
+    /**
+    Eliminates the actions that cannot be optimal. The optimal value of each action
+    is at most its computed value plus upper, and the optimal value of each state is
+    at least value + lower.
+    */
+    template <class SType>
+    void eliminate(const vector<SType>& states, const numvec& value, prec_t upper, prec_t lower) {
+        if (mask == nullptr)
+            return;
+#pragma omp parallel for
+        for (auto s = 0l; s < (long)states.size(); s++) {
+            const auto& actions = states[s].get_actions();
+            // a small margin guards against rounding errors
+            const prec_t bound = value[s] + lower - 1e-10 * max(1.0, abs(value[s]));
+            for (size_t a = 0; a < actions.size(); a++) {
+                if (!actions[a].is_valid() || mask->is_eliminated(s, a))
+                    continue;
+                if (values[offsets[s] + a] + upper < bound)
+                    mask->eliminate(s, a);
+            }
+        }
+    }
+
+protected:
+    ActionMask* mask;
+    /// Position of the values of the first action of each state
+    vector<size_t> offsets;
+    /// Values of the actions from the last sweep
+    numvec values;
+};
+
+/**
+Computes the minimal and maximal change targetvalue - sourcevalue of the value function.
+The values of terminal states do not shift with the value function, so the range
+includes 0 for them.
+*/
+template <class SType>
+static pair<prec_t, prec_t> change_range(const vector<SType>& states,
+        const numvec& sourcevalue,
+        const numvec& targetvalue) {
+    prec_t mindiff = numeric_limits<prec_t>::infinity(), maxdiff = -numeric_limits<prec_t>::infinity();
+#pragma omp parallel for reduction(min : mindiff) reduction(max : maxdiff)
+    for (auto s = 0l; s < (long)states.size(); s++) {
+        const prec_t diff = targetvalue[s] - sourcevalue[s];
+        mindiff = min(mindiff, states[s].is_terminal() ? min(diff, 0.0) : diff);
+        maxdiff = max(maxdiff, states[s].is_terminal() ? max(diff, 0.0) : diff);
+    }
+    return make_pair(mindiff, maxdiff);
+}
+
+/**
+Eliminates actions using MacQueen's bounds after a Jacobi iteration that computed
+targetvalue = T sourcevalue and the values of the actions from sourcevalue.
+\param change Range of targetvalue - sourcevalue (see change_range)
+*/
+template <class SType>
+static void eliminate_macqueen(ActionElimination& elimination,
+        const vector<SType>& states,
+        const numvec& targetvalue,
+        pair<prec_t, prec_t> change,
+        prec_t discount) {
+    // v* <= sourcevalue + maxdiff/(1-discount) and v* >= targetvalue + discount mindiff/(1-discount)
+    elimination.eliminate(states,
+            targetvalue,
+            discount * change.second / (1 - discount),
+            discount * change.first / (1 - discount));
+}
+
+/**
+Stores the bounds value + lowershift <= v* <= value + uppershift in the solution and
+replaces its value function by the midpoint of the bounds.
+*/
+template <class Solution>
+static void set_value_bounds(Solution& solution, prec_t lowershift, prec_t uppershift) {
+    const numvec& value = solution.valuefunction;
+    solution.lowerbound.resize(value.size());
+    solution.upperbound.resize(value.size());
+    for (size_t s = 0; s < value.size(); s++) {
+        solution.lowerbound[s] = value[s] + lowershift;
+        solution.upperbound[s] = value[s] + uppershift;
+    }
+    solution.gap = uppershift - lowershift;
+    for (size_t s = 0; s < value.size(); s++)
+        solution.valuefunction[s] = (solution.lowerbound[s] + solution.upperbound[s]) / 2;
+}
+
 template <class SType>
 SType& GRMDP<SType>::create_state(long stateid) {
     assert(stateid >= 0);
 
-    if (stateid >= (long)states.size())
-        states.resize(stateid + 1);
+    if (stateid >= (long)states.size()) {
+        states.resize(checked_index(stateid) + 1l);
+        dirty.resize(states.size(), 1);
+    }
+    dirty[stateid] = 1;
     return states[stateid];
 }
 
+template <class SType>
+indvec GRMDP<SType>::dirty_states() const {
+    indvec result;
+    for (size_t s = 0; s < dirty.size(); s++) {
+        if (dirty[s])
+            result.push_back(idx_t(s));
+    }
+    return result;
+}
+
 template <class SType>
 bool GRMDP<SType>::is_normalized() const {
     for (auto const& s : states) {
@@ -49,6 +593,7 @@ template <class SType>
 void GRMDP<SType>::normalize() {
     for (SType& s : states)
         s.normalize();
+    fill(dirty.begin(), dirty.end(), 1);
 }
 
 template <class SType>
@@ -149,7 +694,9 @@ auto GRMDP<SType>::vi_gs(Uncertainty type,
         prec_t discount,
         numvec valuefunction,
         unsigned long iterations,
-        prec_t maxresidual) const -> SolType {
+        prec_t maxresidual,
+        ActionMask* eliminated,
+        StoppingRule stopping) const -> SolType {
     // static_assert(type != Uncertainty::Robust || type != Uncertainty::Optimistic || type != Uncertainty::Average,
     //              "Unknown/invalid (average not supported) optimization type.");
 
@@ -157,6 +704,10 @@ auto GRMDP<SType>::vi_gs(Uncertainty type,
     if (state_count() == 0)
         return SolType();
 
+    const bool span = stopping == StoppingRule::Span;
+    if (span && (discount >= 1 || !is_normalized()))
+        throw invalid_argument("The span stopping rule requires a discount less than 1 and normalized transitions.");
+
     // check if the value function is a correct size, and if it is length 0
     // then creates an appropriate size
     if (valuefunction.size() > 0) {
@@ -168,46 +719,677 @@ auto GRMDP<SType>::vi_gs(Uncertainty type,
     GRMDP<SType>::ActionPolicy policy(states.size());
     GRMDP<SType>::OutcomePolicy outcomes(states.size());
 
+    ActionElimination elimination(states, eliminated && discount < 1 && is_normalized(), eliminated);
+
     prec_t residual = numeric_limits<prec_t>::infinity();
+    // the smallest and largest change of the value function in the last sweep, including 0
+    prec_t mindiff = -numeric_limits<prec_t>::infinity(), maxdiff = numeric_limits<prec_t>::infinity();
     size_t i;
 
-    for (i = 0; i < iterations && residual > maxresidual; i++) {
+    for (i = 0; i < iterations && (span ? maxdiff - mindiff : residual) > maxresidual; i++) {
         residual = 0;
+        mindiff = maxdiff = 0;
 
         for (size_t s = 0l; s < states.size(); s++) {
             const auto& state = states[s];
 
-            tuple<ActionId, OutcomeId, prec_t> newvalue;
+            const pair<ActionId, prec_t> newvalue = bellman_value(
+                    state, type, valuefunction, discount, elimination.state_words(s), elimination.state_values(s));
 
-            switch (type) {
-            case Uncertainty::Robust:
-                newvalue = state.max_min(valuefunction, discount);
-                break;
-            case Uncertainty::Optimistic:
-                newvalue = state.max_max(valuefunction, discount);
-                break;
-            case Uncertainty::Average:
-                pair<typename SType::ActionId, prec_t> avgvalue = state.max_average(valuefunction, discount);
-                newvalue = make_tuple(avgvalue.first, OutcomeId(), avgvalue.second);
-                break;
+            const prec_t diff = newvalue.second - valuefunction[s];
+            residual = max(residual, abs(diff));
+            mindiff = min(mindiff, diff);
+            maxdiff = max(maxdiff, diff);
+            valuefunction[s] = newvalue.second;
+
+            policy[s] = newvalue.first;
+        }
+
+        // the sweep is a contraction, so |v - v*| <= discount/(1-discount) residual; the action
+        // values were computed from values that are within residual/(1-discount) of v*
+        if (elimination.enabled()) {
+            const prec_t bound = discount * residual / (1 - discount);
+            elimination.eliminate(states, valuefunction, bound, -bound);
+        }
+    }
+    if (i > 0)
+        nature_responses(states, type, valuefunction, discount, policy, outcomes);
+    SolType solution(valuefunction, policy, outcomes, residual, i);
+    if (span && i > 0)
+        set_value_bounds(solution, discount * mindiff / (1 - discount), discount * maxdiff / (1 - discount));
+    return solution;
+}
+
+template <class SType>
+auto GRMDP<SType>::vi_gs_par(Uncertainty type,
+        prec_t discount,
+        numvec valuefunction,
+        unsigned long iterations,
+        prec_t maxresidual,
+        BlockPartition partition,
+        size_t block_size) const -> SolType {
+    // just quit if there are not states
+    if (state_count() == 0)
+        return SolType();
+
+    // check if the value function is a correct size, and if it is length 0
+    // then creates an appropriate size
+    if (valuefunction.size() > 0) {
+        if (valuefunction.size() != states.size())
+            throw invalid_argument("Incorrect dimensions of value function.");
+    } else
+        valuefunction.assign(state_count(), 0.0);
+
+    const BlockSchedule schedule = block_schedule(states, partition, block_size);
+    const auto& order = schedule.order;
+    const auto& block_offsets = schedule.block_offsets;
+    const auto& color_offsets = schedule.color_offsets;
+
+    GRMDP<SType>::ActionPolicy policy(states.size());
+    GRMDP<SType>::OutcomePolicy outcomes(states.size());
+
+    numvec residuals(states.size());
+
+    prec_t residual = numeric_limits<prec_t>::infinity();
+    size_t i;
+
+    for (i = 0; i < iterations && residual > maxresidual; i++) {
+        for (size_t c = 0; c + 1 < color_offsets.size(); c++) {
+            // blocks of the same color do not read values written by each other
+#pragma omp parallel for schedule(dynamic)
+            for (auto b = (long)color_offsets[c]; b < (long)color_offsets[c + 1]; b++) {
+                for (size_t k = block_offsets[b]; k < block_offsets[b + 1]; k++) {
+                    const size_t s = order[k];
+                    const auto& state = states[s];
+
+                    const pair<ActionId, prec_t> newvalue = bellman_value(state, type, valuefunction, discount);
+
+                    residuals[s] = abs(valuefunction[s] - newvalue.second);
+                    valuefunction[s] = newvalue.second;
+
+                    policy[s] = newvalue.first;
+                }
             }
+        }
+        residual = *max_element(residuals.begin(), residuals.end());
+    }
+    if (i > 0)
+        nature_responses(states, type, valuefunction, discount, policy, outcomes);
+    return SolType(valuefunction, policy, outcomes, residual, i);
+}
 
-            residual = max(residual, abs(valuefunction[s] - get<2>(newvalue)));
-            valuefunction[s] = get<2>(newvalue);
+template <class SType>
+StateAdjacency GRMDP<SType>::successors() const {
+    const size_t n = states.size();
+    vector<indvec> targets(n);
+
+#pragma omp parallel for schedule(dynamic, 64)
+    for (auto s = 0l; s < (long)n; s++) {
+        auto& t = targets[s];
+        for (const auto& action : states[s].get_actions()) {
+            for (const auto& outcome : action.get_outcomes()) {
+                const auto& indices = outcome.get_indices();
+                t.insert(t.end(), indices.begin(), indices.end());
+            }
+        }
+        sort(t.begin(), t.end());
+        t.erase(unique(t.begin(), t.end()), t.end());
+    }
 
-            policy[s] = get<0>(newvalue);
-            outcomes[s] = get<1>(newvalue);
+    StateAdjacency result;
+    result.offsets.resize(n + 1, 0);
+    for (size_t s = 0; s < n; s++)
+        result.offsets[s + 1] = result.offsets[s] + targets[s].size();
+    result.indices.reserve(result.offsets.back());
+    for (const auto& t : targets)
+        result.indices.insert(result.indices.end(), t.begin(), t.end());
+    return result;
+}
+
+template <class SType>
+StateAdjacency GRMDP<SType>::predecessors() const {
+    const StateAdjacency forward = successors();
+    const size_t n = states.size();
+
+    // transpose by a counting sort; sources are visited in order and remain sorted
+    StateAdjacency result;
+    result.offsets.assign(n + 1, 0);
+    for (idx_t t : forward.indices) {
+        if (size_t(t) >= n)
+            throw invalid_argument("Transition to a state that does not exist: " + std::to_string(t) + ".");
+        result.offsets[t + 1]++;
+    }
+    partial_sum(result.offsets.begin(), result.offsets.end(), result.offsets.begin());
+
+    result.indices.resize(forward.indices.size());
+    vector<size_t> positions(result.offsets.begin(), result.offsets.end() - 1);
+    for (size_t s = 0; s < n; s++) {
+        for (auto t = forward.begin(s); t != forward.end(s); ++t)
+            result.indices[positions[*t]++] = idx_t(s);
+    }
+    return result;
+}
+
+/**
+Backs up the states in the order of the largest bounds on their Bellman residuals
+until all bounds drop below maxresidual (see GRMDP::vi_prioritized).
+\param bounds Upper bounds on the residuals of the states (updated)
+\param touched Marks the states whose residual may have changed, or nullptr (updated)
+\returns Number of backups
+*/
+template <class SType>
+static unsigned long prioritized_sweeping(const vector<SType>& states,
+        const StateAdjacency& preds,
+        Uncertainty type,
+        prec_t discount,
+        numvec& valuefunction,
+        numvec& bounds,
+        vector<bool>* touched,
+        unsigned long backups,
+        prec_t maxresidual) {
+    // max-heap with lazy deletion: entries whose priority differs from the bound are stale
+    priority_queue<pair<prec_t, size_t>> queue;
+    for (size_t s = 0; s < states.size(); s++) {
+        if (bounds[s] > maxresidual)
+            queue.emplace(bounds[s], s);
+    }
+
+    unsigned long i = 0;
+    while (!queue.empty() && i < backups) {
+        const auto top = queue.top();
+        queue.pop();
+        const size_t s = top.second;
+        if (top.first != bounds[s])
+            continue;
+
+        const prec_t newvalue = get<2>(bellman_update(states[s], type, valuefunction, discount));
+        const prec_t change = abs(newvalue - valuefunction[s]);
+        valuefunction[s] = newvalue;
+        bounds[s] = 0;
+        i++;
+        if (touched)
+            (*touched)[s] = true;
+
+        // the residual of a predecessor changes by at most discount * change
+        if (change == 0)
+            continue;
+        for (auto p = preds.begin(s); p != preds.end(s); ++p) {
+            bounds[*p] += discount * change;
+            if (touched)
+                (*touched)[*p] = true;
+            if (bounds[*p] > maxresidual)
+                queue.emplace(bounds[*p], *p);
         }
     }
+    return i;
+}
+
+template <class SType>
+auto GRMDP<SType>::vi_prioritized(Uncertainty type,
+        prec_t discount,
+        numvec valuefunction,
+        unsigned long backups,
+        prec_t maxresidual) const -> SolType {
+    // just quit if there are not states
+    if (state_count() == 0)
+        return SolType();
+
+    // check if the value function is a correct size, and if it is length 0
+    // then creates an appropriate size
+    if (valuefunction.size() > 0) {
+        if (valuefunction.size() != states.size())
+            throw invalid_argument("Incorrect dimensions of value function.");
+    } else
+        valuefunction.assign(state_count(), 0.0);
+
+    const size_t n = states.size();
+    const StateAdjacency preds = predecessors();
+
+    // upper bounds on the Bellman residuals, initially exact
+    numvec bounds(n);
+#pragma omp parallel for
+    for (auto s = 0l; s < (long)n; s++)
+        bounds[s] = abs(get<2>(bellman_update(states[s], type, valuefunction, discount)) - valuefunction[s]);
+
+    const unsigned long i =
+            prioritized_sweeping(states, preds, type, discount, valuefunction, bounds, nullptr, backups, maxresidual);
+
+    // compute the greedy policy and the actual residual for the final value function
+    GRMDP<SType>::ActionPolicy policy(n);
+    GRMDP<SType>::OutcomePolicy outcomes(n);
+    numvec residuals(n);
+
+#pragma omp parallel for
+    for (auto s = 0l; s < (long)n; s++) {
+        const pair<ActionId, prec_t> newvalue = bellman_value(states[s], type, valuefunction, discount);
+        residuals[s] = abs(valuefunction[s] - newvalue.second);
+        policy[s] = newvalue.first;
+    }
+    const prec_t residual = *max_element(residuals.begin(), residuals.end());
+    nature_responses(states, type, valuefunction, discount, policy, outcomes);
+
+    return SolType(valuefunction, policy, outcomes, residual, i);
+}
+
+template <class SType>
+auto GRMDP<SType>::vi_incremental(Uncertainty type,
+        prec_t discount,
+        const SolType& previous,
+        unsigned long backups,
+        prec_t maxresidual) -> SolType {
+    const size_t n = states.size();
+    if (previous.valuefunction.size() > n)
+        throw invalid_argument("The previous solution has more states than the model.");
+
+    // states added since the previous solution start with 0 and are dirty
+    numvec valuefunction(previous.valuefunction);
+    valuefunction.resize(n, 0.0);
+    ActionPolicy policy(previous.policy);
+    policy.resize(n);
+    OutcomePolicy outcomes(previous.outcomes);
+
+    if (n == 0)
+        return SolType(valuefunction, policy, OutcomePolicy(), 0, 0);
+
+    const StateAdjacency preds = predecessors();
+
+    // the previous residual bounds the residuals of the unmodified states, unless the
+    // values were shifted to the midpoint of the bounds by the span stopping rule
+    const bool all = previous.residual < 0 || previous.residual > maxresidual || previous.gap >= 0;
+    vector<bool> touched(n, all);
+    for (size_t s = 0; s < n; s++) {
+        if (dirty[s] || s >= previous.valuefunction.size()) {
+            touched[s] = true;
+            for (auto p = preds.begin(s); p != preds.end(s); ++p)
+                touched[*p] = true;
+        }
+    }
+
+    numvec bounds(n, all ? 0.0 : previous.residual);
+#pragma omp parallel for
+    for (auto s = 0l; s < (long)n; s++) {
+        if (touched[s])
+            bounds[s] = abs(get<2>(bellman_update(states[s], type, valuefunction, discount)) - valuefunction[s]);
+    }
+
+    const unsigned long i =
+            prioritized_sweeping(states, preds, type, discount, valuefunction, bounds, &touched, backups, maxresidual);
+
+    // the policy may only change in the states whose residual may have changed
+    prec_t residual = all ? 0.0 : previous.residual;
+#pragma omp parallel for reduction(max : residual)
+    for (auto s = 0l; s < (long)n; s++) {
+        if (!touched[s])
+            continue;
+        const pair<ActionId, prec_t> newvalue = bellman_value(states[s], type, valuefunction, discount);
+        residual = max(residual, abs(valuefunction[s] - newvalue.second));
+        policy[s] = newvalue.first;
+    }
+    update_responses(states, type, valuefunction, discount, policy, touched, outcomes);
+
+    clear_dirty();
     return SolType(valuefunction, policy, outcomes, residual, i);
 }
 
+indvec strong_components(const StateAdjacency& graph) {
+    const size_t n = graph.state_count();
+    const size_t unvisited = numeric_limits<size_t>::max();
+
+    indvec component(n, -1);
+    // order of discovery and the smallest discovery index reachable in the search tree
+    vector<size_t> discovery(n, unvisited), lowlink(n);
+    vector<bool> onstack(n, false);
+    // states that have not been assigned to a component yet
+    vector<size_t> stack;
+    // the search stack: the state and the next edge to follow
+    vector<pair<size_t, const idx_t*>> search;
+
+    size_t counter = 0;
+    idx_t components = 0;
+
+    auto visit = [&](size_t v) {
+        discovery[v] = lowlink[v] = counter++;
+        stack.push_back(v);
+        onstack[v] = true;
+        search.emplace_back(v, graph.begin(v));
+    };
+
+    for (size_t root = 0; root < n; root++) {
+        if (discovery[root] != unvisited)
+            continue;
+        visit(root);
+
+        while (!search.empty()) {
+            const size_t v = search.back().first;
+            if (search.back().second != graph.end(v)) {
+                const idx_t w = *(search.back().second++);
+                if (w < 0 || size_t(w) >= n)
+                    throw invalid_argument("Transition to a state that does not exist: " + std::to_string(w) + ".");
+                if (discovery[w] == unvisited)
+                    visit(w);
+                else if (onstack[w])
+                    lowlink[v] = min(lowlink[v], discovery[w]);
+                continue;
+            }
+
+            // all edges of v have been followed
+            search.pop_back();
+            if (!search.empty()) {
+                const size_t parent = search.back().first;
+                lowlink[parent] = min(lowlink[parent], lowlink[v]);
+            }
+            if (lowlink[v] == discovery[v]) {
+                size_t w;
+                do {
+                    w = stack.back();
+                    stack.pop_back();
+                    onstack[w] = false;
+                    component[w] = components;
+                } while (w != v);
+                components++;
+            }
+        }
+    }
+    return component;
+}
+
+template <class SType>
+auto GRMDP<SType>::vi_scc(Uncertainty type,
+        prec_t discount,
+        numvec valuefunction,
+        unsigned long iterations,
+        prec_t maxresidual) const -> SolType {
+    // just quit if there are not states
+    if (state_count() == 0)
+        return SolType();
+
+    // check if the value function is a correct size, and if it is length 0
+    // then creates an appropriate size
+    if (valuefunction.size() > 0) {
+        if (valuefunction.size() != states.size())
+            throw invalid_argument("Incorrect dimensions of value function.");
+    } else
+        valuefunction.assign(state_count(), 0.0);
+
+    const size_t n = states.size();
+    const StateAdjacency graph = successors();
+    const indvec component = strong_components(graph);
+    const size_t components = size_t(*max_element(component.begin(), component.end())) + 1;
+
+    // states of each component, in increasing order
+    vector<size_t> component_offsets(components + 1, 0);
+    for (idx_t c : component)
+        component_offsets[c + 1]++;
+    partial_sum(component_offsets.begin(), component_offsets.end(), component_offsets.begin());
+    vector<size_t> component_states(n);
+    {
+        vector<size_t> positions(component_offsets.begin(), component_offsets.end() - 1);
+        for (size_t s = 0; s < n; s++)
+            component_states[positions[component[s]]++] = s;
+    }
+
+    // level of a component: the length of the longest path to a sink component;
+    // successors always have smaller component numbers
+    vector<size_t> level(components, 0);
+    vector<bool> cyclic(components, false);
+    for (size_t c = 0; c < components; c++) {
+        for (size_t k = component_offsets[c]; k < component_offsets[c + 1]; k++) {
+            const size_t s = component_states[k];
+            for (auto t = graph.begin(s); t != graph.end(s); ++t) {
+                if (size_t(component[*t]) == c)
+                    cyclic[c] = true;
+                else
+                    level[c] = max(level[c], level[component[*t]] + 1);
+            }
+        }
+    }
+
+    // components grouped by levels
+    const size_t levels = *max_element(level.begin(), level.end()) + 1;
+    vector<size_t> level_offsets(levels + 1, 0);
+    for (size_t l : level)
+        level_offsets[l + 1]++;
+    partial_sum(level_offsets.begin(), level_offsets.end(), level_offsets.begin());
+    vector<size_t> level_components(components);
+    {
+        vector<size_t> positions(level_offsets.begin(), level_offsets.end() - 1);
+        for (size_t c = 0; c < components; c++)
+            level_components[positions[level[c]]++] = c;
+    }
+
+    GRMDP<SType>::ActionPolicy policy(n);
+    GRMDP<SType>::OutcomePolicy outcomes(n);
+    numvec residuals(components, 0.0);
+    vector<size_t> component_iterations(components, 0);
+
+    for (size_t l = 0; l < levels; l++) {
+        // components on the same level only read values of components on lower levels
+#pragma omp parallel for schedule(dynamic)
+        for (auto k = (long)level_offsets[l]; k < (long)level_offsets[l + 1]; k++) {
+            const size_t c = level_components[k];
+            // a single backup is exact when the component has no cycles
+            const unsigned long maxiterations = cyclic[c] ? iterations : min(iterations, 1ul);
+
+            prec_t residual = numeric_limits<prec_t>::infinity();
+            size_t i;
+            for (i = 0; i < maxiterations && residual > maxresidual; i++) {
+                residual = 0;
+                for (size_t j = component_offsets[c]; j < component_offsets[c + 1]; j++) {
+                    const size_t s = component_states[j];
+                    const auto newvalue = bellman_value(states[s], type, valuefunction, discount);
+
+                    residual = max(residual, abs(valuefunction[s] - newvalue.second));
+                    valuefunction[s] = newvalue.second;
+
+                    policy[s] = newvalue.first;
+                }
+            }
+            // the value of an acyclic component is exact after the backup
+            residuals[c] = (cyclic[c] || i == 0) ? residual : 0.0;
+            component_iterations[c] = i;
+        }
+    }
+
+    if (iterations > 0)
+        nature_responses(states, type, valuefunction, discount, policy, outcomes);
+    return SolType(valuefunction,
+            policy,
+            outcomes,
+            *max_element(residuals.begin(), residuals.end()),
+            *max_element(component_iterations.begin(), component_iterations.end()));
+}
+
+// **************************************************************************************
+//  Policy evaluation with linear systems
+// **************************************************************************************
+
+/** Weights of the outcomes of a regular action */
+static numvec outcome_weights(const RegularAction&, idx_t, bool) {
+    return numvec{1.0};
+}
+
+/** Weights of the outcomes of a discrete action: the chosen one, or uniform when averaging */
+static numvec outcome_weights(const DiscreteOutcomeAction& action, idx_t outcomeid, bool average) {
+    const size_t n = action.get_outcomes().size();
+    if (average)
+        return numvec(n, 1.0 / prec_t(n));
+    numvec weights(n, 0.0);
+    weights[outcomeid] = 1.0;
+    return weights;
+}
+
+/** Weights of the outcomes of a weighted action: the nature's, or nominal when averaging */
+template <NatureConstr nature>
+static numvec outcome_weights(const WeightedOutcomeAction<nature>& action, const numvec& outcomedist, bool average) {
+    return average ? action.get_distribution() : outcomedist;
+}
+
+/**
+Adds the transitions and the mean reward of an action to a row of the policy system.
+\param weights Weights of the outcomes of the action
+\param scale Probability of the action
+\param entries Entries of the row as (column, value) pairs
+\returns False when the weights do not match the outcomes
+*/
+template <class AType>
+static bool add_action_row(const AType& action,
+        const numvec& weights,
+        prec_t scale,
+        prec_t discount,
+        vector<pair<idx_t, prec_t>>& entries,
+        prec_t& reward) {
+    const auto outcomes = action.get_outcomes();
+    if (weights.size() != outcomes.size())
+        return false;
+
+    for (size_t o = 0; o < outcomes.size(); o++) {
+        const prec_t weight = scale * weights[o];
+        if (weight == 0)
+            continue;
+        const auto& indices = outcomes[o].get_indices();
+        const auto& probabilities = outcomes[o].get_probabilities();
+        for (size_t k = 0; k < indices.size(); k++)
+            entries.emplace_back(indices[k], -discount * weight * probabilities[k]);
+        reward += weight * outcomes[o].mean_reward();
+    }
+    return true;
+}
+
+/** Adds the action and the outcome of a non-terminal state to its row; see add_action_row */
+template <class AType>
+static bool add_policy_row(const SAState<AType>& state,
+        idx_t actionid,
+        const typename AType::OutcomeId& outcomeid,
+        bool average,
+        prec_t discount,
+        vector<pair<idx_t, prec_t>>& entries,
+        prec_t& reward) {
+    const auto& action = state.get_action(actionid);
+    return add_action_row(action, outcome_weights(action, outcomeid, average), 1.0, discount, entries, reward);
+}
+
+/** Adds the randomized action and the outcomes of all actions to the row; see add_action_row */
+static bool add_policy_row(const L1SRobustState& state,
+        const numvec& actionid,
+        const numvec& outcomeid,
+        bool average,
+        prec_t discount,
+        vector<pair<idx_t, prec_t>>& entries,
+        prec_t& reward) {
+    if (actionid.size() != state.action_count() || (!average && outcomeid.size() != state.outcome_count()))
+        return false;
+
+    auto outcome = outcomeid.begin();
+    for (size_t a = 0; a < state.action_count(); a++) {
+        const auto& action = state.get_action(a);
+        const size_t count = action.get_outcomes().size();
+        if (actionid[a] > 0) {
+            const numvec weights = average ? action.get_distribution() : numvec(outcome, outcome + count);
+            if (!add_action_row(action, weights, actionid[a], discount, entries, reward))
+                return false;
+        }
+        if (!average)
+            outcome += count;
+    }
+    return true;
+}
+
+template <class SType>
+SparseMatrix GRMDP<SType>::policy_system(prec_t discount,
+        const ActionPolicy& policy,
+        const OutcomePolicy& natpolicy,
+        numvec& rewards,
+        bool average) const {
+    const size_t n = states.size();
+    if (policy.size() != n)
+        throw invalid_argument("Dimension of the policy must match the state count.");
+    if (!average && natpolicy.size() != n)
+        throw invalid_argument("Dimension of the nature's policy must match the state count.");
+
+    vector<indvec> columns(n);
+    vector<numvec> values(n);
+    rewards.assign(n, 0.0);
+    // exceptions cannot leave the parallel loop
+    long invalidstate = -1;
+
+#pragma omp parallel for schedule(dynamic, 64)
+    for (auto s = 0l; s < (long)n; s++) {
+        // entries of the row as (column, value) pairs, including the diagonal
+        vector<pair<idx_t, prec_t>> entries{{idx_t(s), 1.0}};
+
+        if (!states[s].is_terminal()) {
+            const bool correct = add_policy_row(states[s],
+                    policy[s],
+                    average ? typename SType::OutcomeId() : natpolicy[s],
+                    average,
+                    discount,
+                    entries,
+                    rewards[s]);
+            if (!correct) {
+#pragma omp critical
+                invalidstate = s;
+                continue;
+            }
+        }
+
+        // merge the entries with the same column
+        sort(entries.begin(), entries.end(),
+                [](const pair<idx_t, prec_t>& a, const pair<idx_t, prec_t>& b) { return a.first < b.first; });
+        for (const auto& e : entries) {
+            if (!columns[s].empty() && columns[s].back() == e.first)
+                values[s].back() += e.second;
+            else {
+                columns[s].push_back(e.first);
+                values[s].push_back(e.second);
+            }
+        }
+    }
+
+    if (invalidstate >= 0)
+        throw invalid_argument("Outcome distribution does not match the outcomes in state " +
+                               std::to_string(invalidstate) + ".");
+
+    SparseMatrix result;
+    for (size_t s = 0; s < n; s++)
+        result.add_row(columns[s], values[s]);
+    return result;
+}
+
+/** Preconditioner used by the policy evaluation method */
+static Preconditioner evaluation_preconditioner(PolicyEvaluation evaluation) {
+    return evaluation == PolicyEvaluation::KrylovJacobi ? Preconditioner::Jacobi : Preconditioner::ILU0;
+}
+
+template <class SType>
+auto GRMDP<SType>::krylov_fix(prec_t discount,
+        const ActionPolicy& policy,
+        const OutcomePolicy& natpolicy,
+        const numvec& valuefunction,
+        unsigned long iterations,
+        prec_t maxresidual,
+        Preconditioner preconditioner) const -> SolType {
+    // just quit if there are not states
+    if (state_count() == 0)
+        return SolType();
+
+    if ((valuefunction.size() > 0) && (valuefunction.size() != state_count()))
+        throw invalid_argument("Incorrect size of value function.");
+
+    numvec rewards;
+    const SparseMatrix system = policy_system(discount, policy, natpolicy, rewards);
+    auto solution = bicgstab(system, rewards, valuefunction, preconditioner, iterations, maxresidual);
+
+    return SolType(solution.solution, policy, natpolicy, solution.residual, solution.iterations);
+}
+
 template <class SType>
 auto GRMDP<SType>::vi_jac(Uncertainty type,
         prec_t discount,
         const numvec& valuefunction,
         unsigned long iterations,
-        prec_t maxresidual) const -> SolType {
+        prec_t maxresidual,
+        ActionMask* eliminated,
+        StoppingRule stopping) const -> SolType {
     // static_assert(type != Uncertainty::Robust || type != Uncertainty::Optimistic || type != Uncertainty::Average,
     //                      "Unknown/invalid (average not supported) optimization type.");
 
@@ -215,6 +1397,10 @@ auto GRMDP<SType>::vi_jac(Uncertainty type,
     if (state_count() == 0)
         return SolType();
 
+    const bool span = stopping == StoppingRule::Span;
+    if (span && (discount >= 1 || !is_normalized()))
+        throw invalid_argument("The span stopping rule requires a discount less than 1 and normalized transitions.");
+
     // check if the value function is a correct size, and if it is length 0
     // then creates an appropriate size
     if ((valuefunction.size() > 0) && (valuefunction.size() != states.size()))
@@ -236,10 +1422,13 @@ auto GRMDP<SType>::vi_jac(Uncertainty type,
 
     numvec residuals(states.size());
 
+    ActionElimination elimination(states, eliminated && discount < 1 && is_normalized(), eliminated);
+
     prec_t residual = numeric_limits<prec_t>::infinity();
+    pair<prec_t, prec_t> change(-numeric_limits<prec_t>::infinity(), numeric_limits<prec_t>::infinity());
     size_t i;
 
-    for (i = 0; i < iterations && residual > maxresidual; i++) {
+    for (i = 0; i < iterations && (span ? change.second - change.first : residual) > maxresidual; i++) {
         numvec& sourcevalue = i % 2 == 0 ? oddvalue : evenvalue;
         numvec& targetvalue = i % 2 == 0 ? evenvalue : oddvalue;
 
@@ -247,31 +1436,593 @@ auto GRMDP<SType>::vi_jac(Uncertainty type,
         for (auto s = 0l; s < (long)states.size(); s++) {
             const auto& state = states[s];
 
-            tuple<ActionId, OutcomeId, prec_t> newvalue;
-
-            switch (type) {
-            case Uncertainty::Robust:
-                newvalue = state.max_min(sourcevalue, discount);
-                break;
-            case Uncertainty::Optimistic:
-                newvalue = state.max_max(sourcevalue, discount);
-                break;
-            case Uncertainty::Average:
-                pair<typename SType::ActionId, prec_t> avgvalue = state.max_average(sourcevalue, discount);
-                newvalue = make_tuple(avgvalue.first, OutcomeId(), avgvalue.second);
-                break;
-            }
+            const pair<ActionId, prec_t> newvalue = bellman_value(
+                    state, type, sourcevalue, discount, elimination.state_words(s), elimination.state_values(s));
 
-            residuals[s] = abs(sourcevalue[s] - get<2>(newvalue));
-            targetvalue[s] = get<2>(newvalue);
+            residuals[s] = abs(sourcevalue[s] - newvalue.second);
+            targetvalue[s] = newvalue.second;
 
-            policy[s] = get<0>(newvalue);
-            outcomes[s] = get<1>(newvalue);
+            policy[s] = newvalue.first;
         }
         residual = *max_element(residuals.begin(), residuals.end());
+
+        if (span || elimination.enabled())
+            change = change_range(states, sourcevalue, targetvalue);
+        if (elimination.enabled())
+            eliminate_macqueen(elimination, states, targetvalue, change, discount);
     }
     numvec& valuenew = i % 2 == 0 ? oddvalue : evenvalue;
-    return SolType(valuenew, policy, outcomes, residual, i);
+    if (i > 0)
+        nature_responses(states, type, valuenew, discount, policy, outcomes);
+    SolType solution(valuenew, policy, outcomes, residual, i);
+    if (span && i > 0)
+        set_value_bounds(solution, discount * change.first / (1 - discount), discount * change.second / (1 - discount));
+    return solution;
+}
+
+// **************************************************************************************
+//  Value iteration for several configurations
+// **************************************************************************************
+
+/** Whether the actions of the state type have thresholds */
+template <class SType>
+struct has_thresholds : false_type {};
+template <>
+struct has_thresholds<L1RobustState> : true_type {};
+
+/** Sets the outcome to the default value while keeping its memory */
+static void reset_outcome(idx_t& outcome) {
+    outcome = idx_t();
+}
+static void reset_outcome(numvec& outcome) {
+    outcome.clear();
+}
+
+/**
+Computes the values of a transition for several configurations at once.
+\param values Value functions of all configurations; the values of state s are
+        stored at s * configs, ..., (s+1) * configs - 1
+\param configs Number of configurations
+\param active Configurations to compute
+\param discounts Discount factor of each configuration
+\param result Value for each active configuration (in the order of active)
+*/
+static void transition_values(const Transition& transition,
+        const numvec& values,
+        size_t configs,
+        const vector<size_t>& active,
+        const numvec& discounts,
+        prec_t* result) {
+    if (transition.empty())
+        throw range_error("No transitions defined. Cannot compute value.");
+
+    const auto& indices = transition.get_indices();
+    const auto& probabilities = transition.get_probabilities();
+    const auto& rewards = transition.get_rewards();
+
+    fill(result, result + active.size(), 0.0);
+    for (size_t j = 0; j < indices.size(); j++) {
+        const prec_t probability = probabilities[j], reward = rewards[j];
+        const prec_t* value = values.data() + size_t(indices[j]) * configs;
+        for (size_t a = 0; a < active.size(); a++)
+            result[a] += probability * (reward + discounts[active[a]] * value[active[a]]);
+    }
+}
+
+/**
+Computes the values of an action and the outcomes for several configurations at
+once; see transition_values.
+\param scratch Temporary storage
+\param result Outcome and value for each active configuration
+*/
+static void action_values(const RegularAction& action,
+        Uncertainty,
+        const numvec& values,
+        size_t configs,
+        const vector<size_t>& active,
+        const numvec& discounts,
+        const numvec&,
+        numvec& scratch,
+        vector<pair<RegularAction::OutcomeId, prec_t>>& result) {
+    scratch.resize(active.size());
+    transition_values(action.get_outcome(), values, configs, active, discounts, scratch.data());
+    for (size_t a = 0; a < active.size(); a++)
+        result[a] = make_pair(0, scratch[a]);
+}
+
+static void action_values(const DiscreteOutcomeAction& action,
+        Uncertainty type,
+        const numvec& values,
+        size_t configs,
+        const vector<size_t>& active,
+        const numvec& discounts,
+        const numvec&,
+        numvec& scratch,
+        vector<pair<DiscreteOutcomeAction::OutcomeId, prec_t>>& result) {
+    const auto& outcomes = action.get_outcomes();
+    if (outcomes.empty())
+        throw invalid_argument("Action with no outcomes.");
+
+    const size_t count = active.size();
+    scratch.resize(outcomes.size() * count);
+    for (size_t o = 0; o < outcomes.size(); o++)
+        transition_values(outcomes[o], values, configs, active, discounts, scratch.data() + o * count);
+
+    for (size_t a = 0; a < count; a++) {
+        switch (type) {
+        case Uncertainty::Robust:
+        case Uncertainty::Optimistic: {
+            const prec_t sign = type == Uncertainty::Robust ? 1 : -1;
+            long best = 0;
+            for (size_t o = 1; o < outcomes.size(); o++) {
+                if (sign * scratch[o * count + a] < sign * scratch[best * count + a])
+                    best = o;
+            }
+            result[a] = make_pair(best, scratch[best * count + a]);
+            break;
+        }
+        case Uncertainty::Average:
+            prec_t average = 0;
+            for (size_t o = 0; o < outcomes.size(); o++)
+                average += scratch[o * count + a] / prec_t(outcomes.size());
+            result[a] = make_pair(DiscreteOutcomeAction::OutcomeId(), average);
+            break;
+        }
+    }
+}
+
+template <NatureConstr nature>
+static void action_values(const WeightedOutcomeAction<nature>& action,
+        Uncertainty type,
+        const numvec& values,
+        size_t configs,
+        const vector<size_t>& active,
+        const numvec& discounts,
+        const numvec& thresholds,
+        numvec& scratch,
+        vector<pair<typename WeightedOutcomeAction<nature>::OutcomeId, prec_t>>& result) {
+    const auto& outcomes = action.get_outcomes();
+    const auto& distribution = action.get_distribution();
+    if (outcomes.empty())
+        throw invalid_argument("Action with no outcomes");
+
+    const size_t count = active.size();
+    scratch.resize(outcomes.size() * count);
+    for (size_t o = 0; o < outcomes.size(); o++)
+        transition_values(outcomes[o], values, configs, active, discounts, scratch.data() + o * count);
+
+    NatureWorkspace& workspace = NatureWorkspace::local();
+    numvec& outcomevalues = workspace.values;
+    outcomevalues.resize(outcomes.size());
+    for (size_t a = 0; a < count; a++) {
+        const prec_t threshold = thresholds.empty() ? action.get_threshold() : thresholds[active[a]];
+        switch (type) {
+        case Uncertainty::Robust:
+        case Uncertainty::Optimistic: {
+            const prec_t sign = type == Uncertainty::Robust ? 1 : -1;
+            for (size_t o = 0; o < outcomes.size(); o++)
+                outcomevalues[o] = sign * scratch[o * count + a];
+            // the buffers of the results are reused
+            result[a].first.resize(outcomes.size());
+            result[a].second = sign * NatureSpan<nature>::compute(outcomevalues.data(),
+                                              distribution.data(),
+                                              outcomes.size(),
+                                              threshold,
+                                              result[a].first.data(),
+                                              workspace);
+            break;
+        }
+        case Uncertainty::Average:
+            prec_t average = 0;
+            for (size_t o = 0; o < outcomes.size(); o++)
+                average += distribution[o] * scratch[o * count + a];
+            result[a].first.clear();
+            result[a].second = average;
+            break;
+        }
+    }
+}
+
+/** Copies nature's response in the state to the outcomes; see sweep_responses */
+template <class OutcomeId>
+static void store_response(vector<OutcomeId>& outcomes, size_t stateid, const OutcomeId& outcome) {
+    outcomes[stateid] = outcome;
+}
+static void store_response(DistributionArray& outcomes, size_t stateid, const numvec& outcome) {
+    copy(outcome.begin(), outcome.end(), outcomes.data(stateid));
+}
+
+/**
+Computes nature's responses to the final values of one configuration of vi_jac_sweep,
+like nature_responses does for vi_jac.
+\param values Value functions of all configurations; see transition_values
+\param config Configuration to compute the responses for
+\param outcomes Output of the outcomes (one for each state)
+*/
+template <class SType, class Outcomes>
+static void sweep_responses(const vector<SType>& states,
+        Uncertainty type,
+        const numvec& values,
+        size_t configs,
+        size_t config,
+        const numvec& discounts,
+        const numvec& thresholds,
+        const vector<typename SType::ActionId>& policy,
+        Outcomes& outcomes) {
+    if (type == Uncertainty::Average)
+        return;
+    allocate_responses(states, type, policy, outcomes);
+
+    const vector<size_t> active{config};
+#pragma omp parallel
+    {
+        numvec scratch;
+        vector<pair<typename SType::OutcomeId, prec_t>> result(1);
+#pragma omp for
+        for (auto s = 0l; s < (long)states.size(); s++) {
+            if (policy[s] < 0)
+                continue;
+            action_values(states[s].get_action(policy[s]),
+                    type,
+                    values,
+                    configs,
+                    active,
+                    discounts,
+                    thresholds,
+                    scratch,
+                    result);
+            store_response(outcomes, s, result[0].first);
+        }
+    }
+}
+
+template <class SType>
+auto GRMDP<SType>::vi_jac_sweep(Uncertainty type,
+        const numvec& discounts,
+        const numvec& thresholds,
+        unsigned long iterations,
+        prec_t maxresidual) const -> vector<SolType> {
+    const size_t configs = discounts.size();
+    if (!thresholds.empty()) {
+        if (thresholds.size() != configs)
+            throw invalid_argument("The number of thresholds must match the number of discounts.");
+        if (!has_thresholds<SType>::value)
+            throw invalid_argument("The actions of the model do not have thresholds.");
+    }
+
+    const size_t n = states.size();
+    // just quit if there are not states
+    if (n == 0)
+        return vector<SolType>(configs);
+
+    // the values of all configurations for each state are stored together
+    numvec sourcevalue(n * configs, 0.0), targetvalue(n * configs, 0.0);
+
+    vector<ActionPolicy> policies(configs, ActionPolicy(n));
+    numvec residuals(configs, numeric_limits<prec_t>::infinity());
+    vector<unsigned long> counts(configs, 0);
+
+    // configurations that have not converged yet
+    vector<size_t> active(configs);
+    iota(active.begin(), active.end(), 0);
+
+    for (unsigned long i = 0; i < iterations && !active.empty(); i++) {
+        const size_t count = active.size();
+        numvec activeresiduals(count, 0.0);
+
+#pragma omp parallel
+        {
+            numvec localresiduals(count, 0.0);
+            numvec scratch;
+            vector<pair<OutcomeId, prec_t>> actionresult(count), best(count);
+            vector<ActionId> bestaction(count);
+
+#pragma omp for
+            for (auto s = 0l; s < (long)n; s++) {
+                const auto& state = states[s];
+
+                // terminal states have the value 0
+                const prec_t initial = state.is_terminal() ? 0 : -numeric_limits<prec_t>::infinity();
+                for (size_t j = 0; j < count; j++) {
+                    reset_outcome(best[j].first);
+                    best[j].second = initial;
+                    bestaction[j] = -1;
+                }
+
+                const auto& actions = state.get_actions();
+                for (size_t a = 0; a < actions.size(); a++) {
+                    if (!actions[a].is_valid())
+                        continue;
+                    action_values(actions[a],
+                            type,
+                            sourcevalue,
+                            configs,
+                            active,
+                            discounts,
+                            thresholds,
+                            scratch,
+                            actionresult);
+                    for (size_t j = 0; j < count; j++) {
+                        // swap rather than move to keep reusing the buffers of the outcomes
+                        if (actionresult[j].second > best[j].second) {
+                            swap(best[j], actionresult[j]);
+                            bestaction[j] = a;
+                        }
+                    }
+                }
+
+                for (size_t j = 0; j < count; j++) {
+                    const size_t k = active[j], position = s * configs + k;
+                    localresiduals[j] = max(localresiduals[j], abs(sourcevalue[position] - best[j].second));
+                    targetvalue[position] = best[j].second;
+                    policies[k][s] = bestaction[j];
+                }
+            }
+
+#pragma omp critical
+            for (size_t j = 0; j < count; j++)
+                activeresiduals[j] = max(activeresiduals[j], localresiduals[j]);
+        }
+
+        for (size_t j = 0; j < count; j++) {
+            residuals[active[j]] = activeresiduals[j];
+            counts[active[j]] = i + 1;
+        }
+        swap(sourcevalue, targetvalue);
+        // the values of the configurations that stop are not modified anymore; they are
+        // copied to both buffers, since the buffers are still swapped after each sweep
+        const auto stopped =
+                stable_partition(active.begin(), active.end(), [&](size_t k) { return residuals[k] > maxresidual; });
+        for (auto k = stopped; k != active.end(); ++k) {
+            for (size_t s = 0; s < n; s++)
+                targetvalue[s * configs + *k] = sourcevalue[s * configs + *k];
+        }
+        active.erase(stopped, active.end());
+    }
+
+    vector<SolType> solutions;
+    solutions.reserve(configs);
+    for (size_t k = 0; k < configs; k++) {
+        numvec valuefunction(n);
+        for (size_t s = 0; s < n; s++)
+            valuefunction[s] = sourcevalue[s * configs + k];
+        OutcomePolicy outcomes(n);
+        if (counts[k] > 0)
+            sweep_responses(states, type, sourcevalue, configs, k, discounts, thresholds, policies[k], outcomes);
+        solutions.emplace_back(valuefunction, policies[k], move(outcomes), residuals[k], counts[k]);
+    }
+    return solutions;
+}
+
+/** The decisions of s-rectangular states are randomized and need a different sweep */
+template <>
+auto GRMDP<L1SRobustState>::vi_jac_sweep(Uncertainty,
+        const numvec&,
+        const numvec&,
+        unsigned long,
+        prec_t) const -> vector<SolType> {
+    throw invalid_argument("The sweep does not support s-rectangular models.");
+}
+
+/** Concatenates the outcomes of the stages of a finite-horizon solution */
+template <class OutcomeId>
+static vector<OutcomeId> join_stages(const vector<vector<OutcomeId>>& stages) {
+    vector<OutcomeId> result;
+    for (const auto& stage : stages)
+        result.insert(result.end(), stage.begin(), stage.end());
+    return result;
+}
+
+/** Concatenates the distributions of the stages of a finite-horizon solution */
+static DistributionArray join_stages(const vector<DistributionArray>& stages) {
+    vector<size_t> offsets(1, 0);
+    numvec values;
+    for (const auto& stage : stages) {
+        const size_t first = values.size();
+        for (auto o = stage.get_offsets().begin() + 1; o != stage.get_offsets().end(); ++o)
+            offsets.push_back(first + *o);
+        values.insert(values.end(), stage.get_values().begin(), stage.get_values().end());
+    }
+    return DistributionArray(move(offsets), move(values));
+}
+
+template <class SType>
+auto GRMDP<SType>::finite_horizon(Uncertainty type,
+        prec_t discount,
+        size_t horizon,
+        const numvec& terminalvalue,
+        bool store_values) const -> FiniteSolType {
+    const size_t n = states.size();
+    if (!terminalvalue.empty() && terminalvalue.size() != n)
+        throw invalid_argument("Incorrect size of the terminal value function.");
+
+    FiniteSolType solution(horizon, n);
+
+    numvec nextvalue = terminalvalue.empty() ? numvec(n, 0.0) : terminalvalue;
+    numvec value(n);
+    if (store_values) {
+        solution.stagevalues.resize((horizon + 1) * n);
+        copy(nextvalue.begin(), nextvalue.end(), solution.stagevalues.begin() + horizon * n);
+    }
+
+    // the outcomes of each stage are stored contiguously and joined at the end
+    ActionPolicy policy(n);
+    vector<OutcomePolicy> stageoutcomes(horizon, OutcomePolicy(n));
+
+    for (size_t t = horizon; t-- > 0;) {
+#pragma omp parallel for
+        for (auto s = 0l; s < (long)n; s++) {
+            const pair<ActionId, prec_t> newvalue = bellman_value(states[s], type, nextvalue, discount);
+            value[s] = newvalue.second;
+            policy[s] = newvalue.first;
+        }
+        nature_responses(states, type, nextvalue, discount, policy, stageoutcomes[t]);
+        copy(policy.begin(), policy.end(), solution.policy.begin() + t * n);
+        if (store_values)
+            copy(value.begin(), value.end(), solution.stagevalues.begin() + t * n);
+        swap(value, nextvalue);
+    }
+
+    solution.outcomes = join_stages(stageoutcomes);
+    solution.valuefunction = move(nextvalue);
+    return solution;
+}
+
+/**
+Solves the small regularized least squares problem min_w ||g - D w||_2 for Anderson
+acceleration using the normal equations.
+\param differences Columns of D
+\param g Target vector
+\param weights Output of the weights w
+\returns False when the system is singular
+*/
+static bool anderson_weights(const deque<numvec>& differences, const numvec& g, numvec& weights) {
+    const size_t m = differences.size();
+    // the normal equations: [D^T D | D^T g]
+    vector<numvec> system(m, numvec(m + 1, 0.0));
+    for (size_t i = 0; i < m; i++) {
+        for (size_t j = i; j < m; j++) {
+            const prec_t product =
+                    inner_product(differences[i].begin(), differences[i].end(), differences[j].begin(), 0.0);
+            system[i][j] = system[j][i] = product;
+        }
+        system[i][m] = inner_product(differences[i].begin(), differences[i].end(), g.begin(), 0.0);
+    }
+
+    // regularize to improve the conditioning
+    prec_t trace = 0;
+    for (size_t i = 0; i < m; i++)
+        trace += system[i][i];
+    if (trace <= 0)
+        return false;
+    for (size_t i = 0; i < m; i++)
+        system[i][i] += 1e-10 * trace;
+
+    // Gaussian elimination with partial pivoting
+    for (size_t c = 0; c < m; c++) {
+        size_t pivot = c;
+        for (size_t r = c + 1; r < m; r++) {
+            if (abs(system[r][c]) > abs(system[pivot][c]))
+                pivot = r;
+        }
+        if (system[pivot][c] == 0)
+            return false;
+        swap(system[c], system[pivot]);
+        for (size_t r = c + 1; r < m; r++) {
+            const prec_t factor = system[r][c] / system[c][c];
+            for (size_t k = c; k <= m; k++)
+                system[r][k] -= factor * system[c][k];
+        }
+    }
+    weights.assign(m, 0.0);
+    for (size_t c = m; c-- > 0;) {
+        prec_t sum = system[c][m];
+        for (size_t k = c + 1; k < m; k++)
+            sum -= system[c][k] * weights[k];
+        weights[c] = sum / system[c][c];
+    }
+    return true;
+}
+
+template <class SType>
+auto GRMDP<SType>::vi_anderson(Uncertainty type,
+        prec_t discount,
+        const numvec& valuefunction,
+        unsigned long iterations,
+        prec_t maxresidual,
+        unsigned int memory) const -> SolType {
+    // just quit if there are not states
+    if (state_count() == 0)
+        return SolType();
+
+    // check if the value function is a correct size, and if it is length 0
+    // then creates an appropriate size
+    if ((valuefunction.size() > 0) && (valuefunction.size() != states.size()))
+        throw invalid_argument("Incorrect size of value function.");
+
+    const size_t n = states.size();
+    numvec residuals(n);
+
+    // computes the Bellman update of all states and returns the residual; nature's
+    // responses are computed only for the returned policy
+    auto bellman = [&](const numvec& value, numvec& target, numvec& residual, ActionPolicy& policy) -> prec_t {
+        target.resize(n);
+        residual.resize(n);
+        policy.resize(n);
+#pragma omp parallel for
+        for (auto s = 0l; s < (long)n; s++) {
+            const pair<ActionId, prec_t> newvalue = bellman_value(states[s], type, value, discount);
+            target[s] = newvalue.second;
+            residual[s] = newvalue.second - value[s];
+            residuals[s] = abs(residual[s]);
+            policy[s] = newvalue.first;
+        }
+        return *max_element(residuals.begin(), residuals.end());
+    };
+
+    // current iterate, its Bellman update, the residual, and the greedy policy
+    numvec value = valuefunction.empty() ? numvec(n, 0.0) : valuefunction;
+    numvec update, difference;
+    GRMDP<SType>::ActionPolicy policy;
+    prec_t residual = bellman(value, update, difference, policy);
+    size_t i = 1;
+
+    // differences between consecutive residuals and Bellman updates
+    deque<numvec> residual_differences, update_differences;
+    numvec weights, newvalue(n), newupdate, newdifference;
+    GRMDP<SType>::ActionPolicy newpolicy;
+
+    while (i < iterations && residual > maxresidual) {
+        // extrapolate from the previous updates
+        bool accelerated = false;
+        newvalue = update;
+        if (!residual_differences.empty() && anderson_weights(residual_differences, difference, weights)) {
+            accelerated = true;
+#pragma omp parallel for
+            for (auto s = 0l; s < (long)n; s++) {
+                for (size_t k = 0; k < weights.size(); k++)
+                    newvalue[s] -= weights[k] * update_differences[k][s];
+            }
+        }
+
+        prec_t newresidual = bellman(newvalue, newupdate, newdifference, newpolicy);
+        i++;
+
+        // safeguard: take a plain Bellman step when the residual grows
+        if (accelerated && newresidual > residual) {
+            residual_differences.clear();
+            update_differences.clear();
+            if (i >= iterations)
+                break;
+            newvalue = update;
+            newresidual = bellman(newvalue, newupdate, newdifference, newpolicy);
+            i++;
+        } else if (memory > 0) {
+            numvec rdiff(n), udiff(n);
+#pragma omp parallel for
+            for (auto s = 0l; s < (long)n; s++) {
+                rdiff[s] = newdifference[s] - difference[s];
+                udiff[s] = newupdate[s] - update[s];
+            }
+            residual_differences.push_back(move(rdiff));
+            update_differences.push_back(move(udiff));
+            if (residual_differences.size() > memory) {
+                residual_differences.pop_front();
+                update_differences.pop_front();
+            }
+        }
+
+        swap(value, newvalue);
+        swap(update, newupdate);
+        swap(difference, newdifference);
+        swap(policy, newpolicy);
+        residual = newresidual;
+    }
+
+    // the policy is greedy for the last iterate, and so are the responses
+    GRMDP<SType>::OutcomePolicy outcomes(n);
+    nature_responses(states, type, value, discount, policy, outcomes);
+    return SolType(update, policy, outcomes, residual, i);
 }
 
 template <class SType>
@@ -282,11 +2033,18 @@ auto GRMDP<SType>::mpi_jac(Uncertainty type,
         prec_t maxresidual_pi,
         unsigned long iterations_vi,
         prec_t maxresidual_vi,
-        bool show_progress) const -> SolType {
+        bool show_progress,
+        PolicyEvaluation evaluation,
+        ActionMask* eliminated,
+        StoppingRule stopping) const -> SolType {
     // just quit if there are no states
     if (state_count() == 0)
         return SolType();
 
+    const bool span = stopping == StoppingRule::Span;
+    if (span && (discount >= 1 || !is_normalized()))
+        throw invalid_argument("The span stopping rule requires a discount less than 1 and normalized transitions.");
+
     // check if the value function is a correct size, and if it is length 0
     // then creates an appropriate size
     if ((valuefunction.size() > 0) && (valuefunction.size() != state_count()))
@@ -312,6 +2070,9 @@ auto GRMDP<SType>::mpi_jac(Uncertainty type,
 
     size_t i; // defined here to be able to report the number of iterations
 
+    ActionElimination elimination(states, eliminated && discount < 1 && is_normalized(), eliminated);
+    pair<prec_t, prec_t> change;
+
     numvec* sourcevalue = &oddvalue;
     numvec* targetvalue = &evenvalue;
 
@@ -328,37 +2089,52 @@ auto GRMDP<SType>::mpi_jac(Uncertainty type,
         for (auto s = 0l; s < (long)states.size(); s++) {
             const auto& state = states[s];
 
-            tuple<ActionId, OutcomeId, prec_t> newvalue;
+            const pair<ActionId, prec_t> newvalue = bellman_value(
+                    state, type, *sourcevalue, discount, elimination.state_words(s), elimination.state_values(s));
 
-            switch (type) {
-            case Uncertainty::Robust:
-                newvalue = state.max_min(*sourcevalue, discount);
-                break;
-            case Uncertainty::Optimistic:
-                newvalue = state.max_max(*sourcevalue, discount);
-                break;
-            case Uncertainty::Average:
-                pair<typename SType::ActionId, prec_t> avgvalue = state.max_average(*sourcevalue, discount);
-                newvalue = make_tuple(avgvalue.first, OutcomeId(), avgvalue.second);
-                break;
-            }
+            residuals[s] = abs((*sourcevalue)[s] - newvalue.second);
+            (*targetvalue)[s] = newvalue.second;
 
-            residuals[s] = abs((*sourcevalue)[s] - get<2>(newvalue));
-            (*targetvalue)[s] = get<2>(newvalue);
-
-            policy[s] = get<0>(newvalue);
-            outcomes[s] = get<1>(newvalue);
+            policy[s] = newvalue.first;
         }
+        // the policy is evaluated with nature's responses to the values it is greedy for
+        nature_responses(states, type, *sourcevalue, discount, policy, outcomes);
 
         residual_pi = *max_element(residuals.begin(), residuals.end());
 
+        if (span || elimination.enabled())
+            change = change_range(states, *sourcevalue, *targetvalue);
+        if (elimination.enabled())
+            eliminate_macqueen(elimination, states, *targetvalue, change, discount);
+
         if (show_progress)
             cout << "    Bellman residual: " << residual_pi << endl;
 
-        // the residual is sufficiently small
-        if (residual_pi <= maxresidual_pi)
+        // the residual (or the span of the change) is sufficiently small
+        if ((span ? change.second - change.first : residual_pi) <= maxresidual_pi)
             break;
 
+        // compute values by solving the linear system
+        if (evaluation != PolicyEvaluation::ValueIteration) {
+            numvec rewards;
+            const SparseMatrix system =
+                    policy_system(discount, policy, outcomes, rewards, type == Uncertainty::Average);
+            auto solution = bicgstab(system,
+                    rewards,
+                    *targetvalue,
+                    evaluation_preconditioner(evaluation),
+                    iterations_vi,
+                    maxresidual_vi);
+            *targetvalue = move(solution.solution);
+            residual_vi = solution.residual;
+
+            if (show_progress)
+                cout << "    Krylov iterations: " << solution.iterations << endl
+                     << "    Residual (fixed policy): " << residual_vi << endl
+                     << endl;
+            continue;
+        }
+
         if (show_progress)
             cout << "    Value iteration: ";
         // compute values using value iteration
@@ -391,7 +2167,11 @@ auto GRMDP<SType>::mpi_jac(Uncertainty type,
             cout << endl << "    Residual (fixed policy): " << residual_vi << endl << endl;
     }
     numvec& valuenew = *targetvalue;
-    return SolType(valuenew, policy, outcomes, residual_pi, i);
+    SolType solution(valuenew, policy, outcomes, residual_pi, i);
+    // the bounds are only valid when the last step was the policy improvement
+    if (span && i < iterations_pi)
+        set_value_bounds(solution, discount * change.first / (1 - discount), discount * change.second / (1 - discount));
+    return solution;
 }
 
 template <class SType>
@@ -476,6 +2256,23 @@ numvec GRMDP<SType>::ofreq_mat(const Transition& init,
     return initial_svec;
 }
 
+template <class SType>
+numvec GRMDP<SType>::ofreq_sparse(const Transition& init,
+        prec_t discount,
+        const ActionPolicy& policy,
+        const OutcomePolicy& nature,
+        unsigned long iterations,
+        prec_t maxresidual) const {
+    const auto n = state_count();
+    const numvec initial = init.probabilities_vector(n);
+
+    // terminal states have no outgoing transitions in the system
+    numvec rewards;
+    const SparseMatrix system = policy_system(discount, policy, nature, rewards).transpose();
+
+    return bicgstab(system, initial, numvec(0), Preconditioner::ILU0, iterations, maxresidual).solution;
+}
+
 template <class SType>
 numvec GRMDP<SType>::rewards_state(const ActionPolicy& policy, const OutcomePolicy& nature) const {
     const auto n = state_count();
@@ -535,6 +2332,17 @@ unique_ptr<ublas::matrix<prec_t>> GRMDP<SType>::transition_mat_t(const ActionPol
     return result;
 }
 
+template <class SType>
+GCompiledRMDP<SType> GRMDP<SType>::compile(bool keep_rewards) const {
+    return GCompiledRMDP<SType>(*this, keep_rewards);
+}
+
+/** The compiled models store a single action index in the policy */
+template <>
+GCompiledRMDP<L1SRobustState> GRMDP<L1SRobustState>::compile(bool) const {
+    throw invalid_argument("S-rectangular models cannot be compiled.");
+}
+
 // **********************************************************************
 // *********************    TEMPLATE DECLARATIONS    ********************
 // **********************************************************************
@@ -542,7 +2350,13 @@ unique_ptr<ublas::matrix<prec_t>> GRMDP<SType>::transition_mat_t(const ActionPol
 template class GRMDP<RegularState>;
 template class GRMDP<DiscreteRobustState>;
 template class GRMDP<L1RobustState>;
+template class GRMDP<L1SRobustState>;
+
+template class GSolution<idx_t, idx_t>;
+template class GSolution<idx_t, numvec>;
+template class GSolution<numvec, numvec>;
 
-template class GSolution<long, long>;
-template class GSolution<long, numvec>;
+template class GFiniteSolution<idx_t, idx_t>;
+template class GFiniteSolution<idx_t, numvec>;
+template class GFiniteSolution<numvec, numvec>;
 }
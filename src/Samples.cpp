@@ -1,4 +1,5 @@
 #include "Samples.hpp"
+#include "ModelBuilder.hpp"
 #include "modeltools.hpp"
 
 #include <string>
@@ -17,6 +18,10 @@ void SampledMDP::add_samples(const DiscreteSamples& samples) {
     // copy the state and action counts to be
     auto old_state_action_weights = state_action_weights;
 
+    // the transitions are collected and added to the MDP at once
+    ModelBuilder builder;
+    builder.reserve(samples.size());
+
     // add transition samples
     for (size_t si : indices(samples)) {
         DiscreteSample s = samples.get_sample(si);
@@ -71,8 +76,9 @@ void SampledMDP::add_samples(const DiscreteSamples& samples) {
         // ---------------------
 
         // adds a transition
-        add_transition(*mdp, s.state_from(), s.action(), s.state_to(), weight * s.weight(), s.reward());
+        builder.add_transition(s.state_from(), s.action(), s.state_to(), weight * s.weight(), s.reward());
     }
+    builder.build(*mdp);
 
     // make sure to set action validity based on whether there have been
     // samples observed for the action
@@ -1,5 +1,6 @@
 #include "State.hpp"
 
+#include <algorithm>
 #include <limits>
 #include <string>
 
@@ -14,22 +15,27 @@ using namespace util::lang;
 // **************************************************************************************
 
 template <class AType>
-auto SAState<AType>::max_max(numvec const& valuefunction, prec_t discount) const -> tuple<ActionId, OutcomeId, prec_t> {
+auto SAState<AType>::max_max(numvec const& valuefunction,
+        prec_t discount,
+        const ActionMask::Word* eliminated,
+        prec_t* actionvalues) const -> tuple<ActionId, OutcomeId, prec_t> {
     if (is_terminal())
         return make_tuple(-1, OutcomeId(), 0);
 
     prec_t maxvalue = -numeric_limits<prec_t>::infinity();
     long result = -1l;
-    OutcomeId result_outcome;
+    OutcomeId result_outcome = OutcomeId();
 
     for (size_t i = 0; i < actions.size(); i++) {
         const auto& action = actions[i];
 
-        // skip invalid actions
-        if (!action.is_valid())
+        // skip invalid and eliminated actions
+        if (!action.is_valid() || (eliminated && ((eliminated[i / ActionMask::bits] >> (i % ActionMask::bits)) & 1)))
             continue;
 
         auto value = action.maximal(valuefunction, discount);
+        if (actionvalues)
+            actionvalues[i] = value.second;
         if (value.second > maxvalue) {
             maxvalue = value.second;
             result = i;
@@ -40,22 +46,27 @@ auto SAState<AType>::max_max(numvec const& valuefunction, prec_t discount) const
 }
 
 template <class AType>
-auto SAState<AType>::max_min(numvec const& valuefunction, prec_t discount) const -> tuple<ActionId, OutcomeId, prec_t> {
+auto SAState<AType>::max_min(numvec const& valuefunction,
+        prec_t discount,
+        const ActionMask::Word* eliminated,
+        prec_t* actionvalues) const -> tuple<ActionId, OutcomeId, prec_t> {
     if (is_terminal())
         return make_tuple(-1, OutcomeId(), 0);
 
     prec_t maxvalue = -numeric_limits<prec_t>::infinity();
     long result = -1l;
-    OutcomeId result_outcome;
+    OutcomeId result_outcome = OutcomeId();
 
     for (size_t i = 0; i < actions.size(); i++) {
         const auto& action = actions[i];
 
-        // skip invalid actions
-        if (!action.is_valid())
+        // skip invalid and eliminated actions
+        if (!action.is_valid() || (eliminated && ((eliminated[i / ActionMask::bits] >> (i % ActionMask::bits)) & 1)))
             continue;
 
         auto value = action.minimal(valuefunction, discount);
+        if (actionvalues)
+            actionvalues[i] = value.second;
         if (value.second > maxvalue) {
             maxvalue = value.second;
             result = i;
@@ -66,7 +77,68 @@ auto SAState<AType>::max_min(numvec const& valuefunction, prec_t discount) const
 }
 
 template <class AType>
-auto SAState<AType>::max_average(numvec const& valuefunction, prec_t discount) const -> pair<ActionId, prec_t> {
+auto SAState<AType>::max_max_value(numvec const& valuefunction,
+        prec_t discount,
+        const ActionMask::Word* eliminated,
+        prec_t* actionvalues) const -> pair<ActionId, prec_t> {
+    if (is_terminal())
+        return make_pair(-1, 0.0);
+
+    prec_t maxvalue = -numeric_limits<prec_t>::infinity();
+    long result = -1l;
+
+    for (size_t i = 0; i < actions.size(); i++) {
+        const auto& action = actions[i];
+
+        // skip invalid and eliminated actions
+        if (!action.is_valid() || (eliminated && ((eliminated[i / ActionMask::bits] >> (i % ActionMask::bits)) & 1)))
+            continue;
+
+        auto value = action.maximal_value(valuefunction, discount);
+        if (actionvalues)
+            actionvalues[i] = value;
+        if (value > maxvalue) {
+            maxvalue = value;
+            result = i;
+        }
+    }
+    return make_pair(result, maxvalue);
+}
+
+template <class AType>
+auto SAState<AType>::max_min_value(numvec const& valuefunction,
+        prec_t discount,
+        const ActionMask::Word* eliminated,
+        prec_t* actionvalues) const -> pair<ActionId, prec_t> {
+    if (is_terminal())
+        return make_pair(-1, 0.0);
+
+    prec_t maxvalue = -numeric_limits<prec_t>::infinity();
+    long result = -1l;
+
+    for (size_t i = 0; i < actions.size(); i++) {
+        const auto& action = actions[i];
+
+        // skip invalid and eliminated actions
+        if (!action.is_valid() || (eliminated && ((eliminated[i / ActionMask::bits] >> (i % ActionMask::bits)) & 1)))
+            continue;
+
+        auto value = action.minimal_value(valuefunction, discount);
+        if (actionvalues)
+            actionvalues[i] = value;
+        if (value > maxvalue) {
+            maxvalue = value;
+            result = i;
+        }
+    }
+    return make_pair(result, maxvalue);
+}
+
+template <class AType>
+auto SAState<AType>::max_average(numvec const& valuefunction,
+        prec_t discount,
+        const ActionMask::Word* eliminated,
+        prec_t* actionvalues) const -> pair<ActionId, prec_t> {
     if (is_terminal())
         return make_pair(-1, 0.0);
 
@@ -76,11 +148,13 @@ auto SAState<AType>::max_average(numvec const& valuefunction, prec_t discount) c
     for (size_t i = 0; i < actions.size(); i++) {
         auto const& action = actions[i];
 
-        // skip invalid actions
-        if (!action.is_valid())
+        // skip invalid and eliminated actions
+        if (!action.is_valid() || (eliminated && ((eliminated[i / ActionMask::bits] >> (i % ActionMask::bits)) & 1)))
             continue;
 
         auto value = action.average(valuefunction, discount);
+        if (actionvalues)
+            actionvalues[i] = value;
 
         if (value > maxvalue) {
             maxvalue = value;
@@ -135,7 +209,7 @@ AType& SAState<AType>::create_action(long actionid) {
     assert(actionid >= 0);
 
     if (actionid >= (long)actions.size())
-        actions.resize(actionid + 1);
+        actions.resize(checked_index(actionid) + 1l);
 
     return this->actions[actionid];
 }
@@ -171,6 +245,358 @@ string SAState<AType>::to_json(long stateid) const {
     return result;
 }
 
+// **************************************************************************************
+//  S State (S rectangular with L1 constraints)
+// **************************************************************************************
+
+size_t L1SRobustState::outcome_count() const {
+    size_t count = 0;
+    for (const auto& action : actions)
+        count += action.get_outcomes().size();
+    return count;
+}
+
+L1OutcomeAction& L1SRobustState::create_action(long actionid) {
+    assert(actionid >= 0);
+
+    if (actionid >= (long)actions.size())
+        actions.resize(checked_index(actionid) + 1l);
+
+    return this->actions[actionid];
+}
+
+void L1SRobustState::normalize() {
+    for (auto& a : actions)
+        a.normalize();
+}
+
+bool L1SRobustState::is_action_outcome_correct(const ActionId& aid, const OutcomeId& oid) const {
+    return aid.size() == actions.size() && oid.size() == outcome_count();
+}
+
+prec_t L1SRobustState::mean_reward(const ActionId& actionid, const OutcomeId& outcomeid) const {
+    assert(actionid.size() == actions.size() && outcomeid.size() == outcome_count());
+
+    prec_t result = 0;
+    auto outcome = outcomeid.begin();
+    for (size_t a = 0; a < actions.size(); a++) {
+        const auto& outcomes = actions[a].get_outcomes();
+        for (size_t o = 0; o < outcomes.size(); o++, outcome++)
+            result += actionid[a] * (*outcome) * outcomes[o].mean_reward();
+    }
+    return result;
+}
+
+Transition L1SRobustState::mean_transition(const ActionId& actionid, const OutcomeId& outcomeid) const {
+    assert(actionid.size() == actions.size() && outcomeid.size() == outcome_count());
+
+    Transition result;
+    auto outcome = outcomeid.begin();
+    for (size_t a = 0; a < actions.size(); a++) {
+        const auto& outcomes = actions[a].get_outcomes();
+        for (size_t o = 0; o < outcomes.size(); o++, outcome++) {
+            if (actionid[a] * (*outcome) > 0)
+                outcomes[o].probabilities_addto(actionid[a] * (*outcome), result);
+        }
+    }
+    return result;
+}
+
+void L1SRobustState::outcome_values(numvec const& valuefunction,
+        prec_t discount,
+        prec_t sign,
+        SRectWorkspace& workspace) const {
+    workspace.values.clear();
+    workspace.distributions.clear();
+    workspace.offsets.assign(1, 0);
+    workspace.actions.clear();
+    for (size_t a = 0; a < actions.size(); a++) {
+        const auto& action = actions[a];
+        if (!action.is_valid())
+            continue;
+        const auto& outcomes = action.get_outcomes();
+        if (outcomes.empty())
+            throw invalid_argument("Action with no outcomes");
+
+        for (const auto& outcome : outcomes)
+            workspace.values.push_back(sign * outcome.compute_value(valuefunction, discount));
+        const auto& distribution = action.get_distribution();
+        workspace.distributions.insert(workspace.distributions.end(), distribution.begin(), distribution.end());
+        workspace.offsets.push_back(workspace.values.size());
+        workspace.actions.push_back(a);
+    }
+    const size_t count = workspace.actions.size();
+    workspace.decision.resize(count);
+    workspace.thresholds.resize(count);
+}
+
+void L1SRobustState::nominal_outcomes(prec_t* result) const {
+    for (const auto& action : actions) {
+        const auto& distribution = action.get_distribution();
+        result = copy(distribution.begin(), distribution.end(), result);
+    }
+}
+
+auto L1SRobustState::max_max(numvec const& valuefunction,
+        prec_t discount,
+        const ActionMask::Word* eliminated,
+        prec_t* actionvalues) const -> tuple<ActionId, OutcomeId, prec_t> {
+    if (is_terminal())
+        return make_tuple(ActionId(), OutcomeId(), 0);
+
+    auto decision = max_max_value(valuefunction, discount, eliminated, actionvalues);
+    if (decision.first.empty())
+        return make_tuple(ActionId(), OutcomeId(), decision.second);
+
+    OutcomeId outcomes(outcome_count());
+    nature_response(valuefunction, discount, true, decision.first, outcomes.data());
+    return make_tuple(move(decision.first), move(outcomes), decision.second);
+}
+
+auto L1SRobustState::max_min(numvec const& valuefunction,
+        prec_t discount,
+        const ActionMask::Word*,
+        prec_t*) const -> tuple<ActionId, OutcomeId, prec_t> {
+    if (is_terminal())
+        return make_tuple(ActionId(), OutcomeId(), 0);
+
+    SRectWorkspace& workspace = SRectWorkspace::local();
+    const auto value = max_min_value(valuefunction, discount);
+    if (value.first.empty())
+        return make_tuple(ActionId(), OutcomeId(), value.second);
+
+    // the values and the thresholds of the valid actions remain in the workspace;
+    // invalid actions are never taken and keep the nominal distributions
+    OutcomeId outcomes(outcome_count());
+    nominal_outcomes(outcomes.data());
+    NatureWorkspace& natureworkspace = NatureWorkspace::local();
+    size_t offset = 0, v = 0;
+    for (size_t a = 0; a < actions.size(); a++) {
+        if (v < workspace.actions.size() && workspace.actions[v] == a) {
+            const size_t first = workspace.offsets[v];
+            worstcase_l1(workspace.values.data() + first,
+                    workspace.distributions.data() + first,
+                    workspace.offsets[v + 1] - first,
+                    workspace.thresholds[v],
+                    outcomes.data() + offset,
+                    natureworkspace);
+            v++;
+        }
+        offset += actions[a].get_outcomes().size();
+    }
+    return make_tuple(move(value.first), move(outcomes), value.second);
+}
+
+auto L1SRobustState::max_max_value(numvec const& valuefunction,
+        prec_t discount,
+        const ActionMask::Word*,
+        prec_t*) const -> pair<ActionId, prec_t> {
+    if (is_terminal())
+        return make_pair(ActionId(), 0.0);
+
+    // nature spends the whole threshold on the best action; more than 2 has no effect
+    const prec_t actionthreshold = min(threshold, 2.0);
+    NatureWorkspace& workspace = NatureWorkspace::local();
+    numvec& values = workspace.values;
+    numvec& distribution = workspace.distribution;
+
+    prec_t maxvalue = -numeric_limits<prec_t>::infinity();
+    long result = -1l;
+    for (size_t a = 0; a < actions.size(); a++) {
+        const auto& action = actions[a];
+        if (!action.is_valid())
+            continue;
+        const auto& outcomes = action.get_outcomes();
+        if (outcomes.empty())
+            throw invalid_argument("Action with no outcomes");
+
+        values.resize(outcomes.size());
+        distribution.resize(outcomes.size());
+        for (size_t o = 0; o < outcomes.size(); o++)
+            values[o] = -outcomes[o].compute_value(valuefunction, discount);
+        const prec_t value = -worstcase_l1(values.data(),
+                                     action.get_distribution().data(),
+                                     outcomes.size(),
+                                     actionthreshold,
+                                     distribution.data(),
+                                     workspace);
+        if (value > maxvalue) {
+            maxvalue = value;
+            result = a;
+        }
+    }
+    if (result < 0)
+        return make_pair(ActionId(), maxvalue);
+    ActionId decision(actions.size(), 0.0);
+    decision[result] = 1;
+    return make_pair(move(decision), maxvalue);
+}
+
+auto L1SRobustState::max_min_value(numvec const& valuefunction,
+        prec_t discount,
+        const ActionMask::Word*,
+        prec_t*) const -> pair<ActionId, prec_t> {
+    if (is_terminal())
+        return make_pair(ActionId(), 0.0);
+
+    SRectWorkspace& workspace = SRectWorkspace::local();
+    outcome_values(valuefunction, discount, 1.0, workspace);
+    const size_t count = workspace.actions.size();
+    if (count == 0)
+        return make_pair(ActionId(), -numeric_limits<prec_t>::infinity());
+
+    const prec_t value = worstcase_srect_l1(workspace.values.data(),
+            workspace.distributions.data(),
+            workspace.offsets.data(),
+            count,
+            threshold,
+            workspace.decision.data(),
+            workspace.thresholds.data(),
+            workspace);
+    ActionId decision(actions.size(), 0.0);
+    for (size_t v = 0; v < count; v++)
+        decision[workspace.actions[v]] = workspace.decision[v];
+    return make_pair(move(decision), value);
+}
+
+auto L1SRobustState::max_average(numvec const& valuefunction,
+        prec_t discount,
+        const ActionMask::Word*,
+        prec_t*) const -> pair<ActionId, prec_t> {
+    if (is_terminal())
+        return make_pair(ActionId(), 0.0);
+
+    prec_t maxvalue = -numeric_limits<prec_t>::infinity();
+    long result = -1l;
+    for (size_t a = 0; a < actions.size(); a++) {
+        const auto& action = actions[a];
+        if (!action.is_valid())
+            continue;
+        const prec_t value = action.average(valuefunction, discount);
+        if (value > maxvalue) {
+            maxvalue = value;
+            result = a;
+        }
+    }
+    if (result < 0)
+        return make_pair(ActionId(), maxvalue);
+    ActionId decision(actions.size(), 0.0);
+    decision[result] = 1;
+    return make_pair(move(decision), maxvalue);
+}
+
+prec_t L1SRobustState::fixed_average(numvec const& valuefunction, prec_t discount, const ActionId& actionid) const {
+    // this is the terminal state, return 0
+    if (is_terminal())
+        return 0;
+
+    if (actionid.size() != actions.size())
+        throw invalid_argument("Action distribution size does not match the number of actions");
+
+    prec_t result = 0;
+    for (size_t a = 0; a < actions.size(); a++) {
+        if (actionid[a] <= 0)
+            continue;
+        // cannot assume invalid actions
+        if (!actions[a].is_valid())
+            throw invalid_argument("Cannot take an invalid action");
+        result += actionid[a] * actions[a].average(valuefunction, discount);
+    }
+    return result;
+}
+
+prec_t L1SRobustState::fixed_fixed(numvec const& valuefunction,
+        prec_t discount,
+        const ActionId& actionid,
+        const OutcomeId& outcomeid) const {
+    // this is the terminal state, return 0
+    if (is_terminal())
+        return 0;
+
+    if (actionid.size() != actions.size())
+        throw invalid_argument("Action distribution size does not match the number of actions");
+    if (outcomeid.size() != outcome_count())
+        throw invalid_argument("Distribution size does not match number of outcomes");
+
+    prec_t result = 0;
+    auto outcome = outcomeid.begin();
+    for (size_t a = 0; a < actions.size(); a++) {
+        const auto& outcomes = actions[a].get_outcomes();
+        if (actionid[a] > 0) {
+            // cannot assume invalid actions
+            if (!actions[a].is_valid())
+                throw invalid_argument("Cannot take an invalid action");
+            for (size_t o = 0; o < outcomes.size(); o++)
+                result += actionid[a] * outcome[o] * outcomes[o].compute_value(valuefunction, discount);
+        }
+        outcome += outcomes.size();
+    }
+    return result;
+}
+
+prec_t L1SRobustState::nature_response(numvec const& valuefunction,
+        prec_t discount,
+        bool maximize,
+        const ActionId& actionid,
+        prec_t* result) const {
+    if (actionid.size() != actions.size())
+        throw invalid_argument("Action distribution size does not match the number of actions");
+
+    // nature minimizes, so maximizing uses the negative values
+    const prec_t sign = maximize ? -1.0 : 1.0;
+    SRectWorkspace& workspace = SRectWorkspace::local();
+    outcome_values(valuefunction, discount, sign, workspace);
+    const size_t count = workspace.actions.size();
+    for (size_t v = 0; v < count; v++)
+        workspace.decision[v] = actionid[workspace.actions[v]];
+    const prec_t value = response_srect_l1(workspace.values.data(),
+            workspace.distributions.data(),
+            workspace.offsets.data(),
+            count,
+            threshold,
+            workspace.decision.data(),
+            workspace.thresholds.data(),
+            workspace);
+
+    nominal_outcomes(result);
+    NatureWorkspace& natureworkspace = NatureWorkspace::local();
+    size_t offset = 0, v = 0;
+    for (size_t a = 0; a < actions.size(); a++) {
+        if (v < count && workspace.actions[v] == a) {
+            if (workspace.decision[v] > 0) {
+                const size_t first = workspace.offsets[v];
+                worstcase_l1(workspace.values.data() + first,
+                        workspace.distributions.data() + first,
+                        workspace.offsets[v + 1] - first,
+                        workspace.thresholds[v],
+                        result + offset,
+                        natureworkspace);
+            }
+            v++;
+        }
+        offset += actions[a].get_outcomes().size();
+    }
+    return sign * value;
+}
+
+string L1SRobustState::to_json(long stateid) const {
+    string result{"{"};
+    result += "\"stateid\" : ";
+    result += std::to_string(stateid);
+    result += ",\"threshold\" : ";
+    result += std::to_string(threshold);
+    result += ",\"actions\" : [";
+    for (auto ai : indices(actions)) {
+        const auto& a = actions[ai];
+        result += a.to_json(ai);
+        result += ",";
+    }
+    if (!actions.empty())
+        result.pop_back(); // remove last comma
+    result += ("]}");
+    return result;
+}
+
 /// **********************************************************************
 /// *********************    TEMPLATE DECLARATIONS    ********************
 /// **********************************************************************
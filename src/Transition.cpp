@@ -1,5 +1,6 @@
 #include "Transition.hpp"
 #include "definitions.hpp"
+#include "kernels.hpp"
 
 #include <algorithm>
 #include <cmath>
@@ -38,6 +39,7 @@ void Transition::add_sample(long stateid, prec_t probability, prec_t reward) {
         throw invalid_argument("probabilities must be non-negative.");
     if (stateid < 0)
         throw invalid_argument("State id must be non-negative.");
+    checked_index(stateid);
     // if the probability is 0 or negative, just do not add the sample
     if (probability <= 0)
         return;
@@ -108,24 +110,15 @@ prec_t Transition::compute_value(numvec const& valuefunction, prec_t discount) c
     if (indices.empty())
         throw range_error("No transitions defined. Cannot compute value.");
 
-    prec_t value = 0.0;
-
-    for (size_t c : util::lang::indices(indices)) {
-        value += probabilities[c] * (rewards[c] + discount * valuefunction[indices[c]]);
-    }
-    return value;
+    return kernels::transition_value(
+            indices.data(), probabilities.data(), rewards.data(), indices.size(), valuefunction.data(), discount);
 }
 
 prec_t Transition::mean_reward() const {
     if (indices.empty())
         throw range_error("No transitions defined. Cannot compute mean reward.");
 
-    prec_t value = 0.0;
-
-    for (size_t c : util::lang::indices(indices)) {
-        value += probabilities[c] * rewards[c];
-    }
-    return value;
+    return kernels::dot(probabilities.data(), rewards.data(), indices.size());
 }
 
 void Transition::probabilities_addto(prec_t scale, numvec& transition) const {
@@ -0,0 +1,78 @@
+#include "batch.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+namespace craam {
+
+/** Solves a single model of the batch */
+template <class Model>
+static typename Model::SolType solve_model(const Model& model, const BatchParameters& p) {
+    return model.mpi_jac(p.uncertainty,
+            p.discount,
+            p.valuefunction,
+            p.iterations_pi,
+            p.maxresidual_pi,
+            p.iterations_vi,
+            p.maxresidual_vi,
+            false,
+            p.evaluation);
+}
+
+template <class Model>
+vector<typename Model::SolType> solve_batch(const vector<Model>& models,
+        const vector<BatchParameters>& parameters,
+        size_t large_states) {
+    if (models.size() != parameters.size())
+        throw invalid_argument("The number of parameters must match the number of models.");
+
+    vector<typename Model::SolType> solutions(models.size());
+    // exceptions cannot leave a parallel region; they are rethrown after it
+    vector<exception_ptr> errors(models.size());
+
+    // split the models by size, and order the small ones from the largest
+    vector<size_t> small, large;
+    for (size_t m = 0; m < models.size(); m++)
+        (models[m].state_count() < large_states ? small : large).push_back(m);
+    stable_sort(small.begin(), small.end(),
+            [&](size_t a, size_t b) { return models[a].state_count() > models[b].state_count(); });
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (auto k = 0l; k < (long)small.size(); k++) {
+        const size_t m = small[k];
+        try {
+            solutions[m] = solve_model(models[m], parameters[m]);
+        } catch (...) {
+            errors[m] = current_exception();
+        }
+    }
+
+    for (size_t m : large) {
+        try {
+            solutions[m] = solve_model(models[m], parameters[m]);
+        } catch (...) {
+            errors[m] = current_exception();
+        }
+    }
+
+    for (const auto& error : errors) {
+        if (error)
+            rethrow_exception(error);
+    }
+    return solutions;
+}
+
+// **************************************************************************************
+//  Specific template instantiations
+// **************************************************************************************
+
+template vector<MDP::SolType> solve_batch<MDP>(const vector<MDP>&, const vector<BatchParameters>&, size_t);
+template vector<RMDP_D::SolType> solve_batch<RMDP_D>(const vector<RMDP_D>&, const vector<BatchParameters>&, size_t);
+template vector<RMDP_L1::SolType> solve_batch<RMDP_L1>(const vector<RMDP_L1>&,
+        const vector<BatchParameters>&,
+        size_t);
+template vector<RMDP_SL1::SolType> solve_batch<RMDP_SL1>(const vector<RMDP_SL1>&,
+        const vector<BatchParameters>&,
+        size_t);
+}
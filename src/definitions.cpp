@@ -1,5 +1,7 @@
 #include <assert.h>
 #include <algorithm>
+#include <functional>
+#include <limits>
 #include <numeric>
 #include <stdexcept>
 
@@ -49,6 +51,8 @@ different definitions of the uncertainty set. The avialable specializations are:
 - craam::MDP : plain MDP with no definition of uncertainty
 - craam::RMDP_D : a robust/uncertain with discrete outcomes with the best/worst one chosen
 - craam::RMDP_L1 : a robust/uncertain with discrete outcomes with L1 constraints on the uncertainty
+- craam::RMDP_SL1 : a robust/uncertain with discrete outcomes with an L1 constraint shared by the actions of a state
+  (s-rectangular) and randomized policies
 
 
 States, actions, and outcomes are identified using 0-based contiguous indexes. The actions are indexed independently for
@@ -71,6 +75,10 @@ worst-case outcome for each action.
 
 For uncertain MDPs, each method supports average, robust, and optimistic computation modes.
 
+Large models can be compiled using GRMDP::compile to a flat representation (GCompiledRMDP)
+that supports the same solution methods but is more cache friendly. The compiled model
+cannot be modified.
+
 The following is a simple example of formulating and solving a small MDP.
 
 \code
@@ -172,7 +180,7 @@ vector<size_t> sort_indexes(vector<T> const& v) {
     return idx;
 }
 
-template vector<size_t> sort_indexes<long>(vector<long> const&);
+template vector<size_t> sort_indexes<idx_t>(indvec const&);
 
 template <typename T>
 vector<size_t> sort_indexes_desc(vector<T> const& v) {
@@ -193,6 +201,11 @@ vector<size_t> sort_indexes_desc(vector<T> const& v) {
     return idx;
 }
 
+NatureWorkspace& NatureWorkspace::local() {
+    thread_local NatureWorkspace workspace;
+    return workspace;
+}
+
 pair<numvec, prec_t> worstcase_l1(numvec const& z, numvec const& q, prec_t t) {
     /**
     Computes the solution of:
@@ -203,38 +216,504 @@ pair<numvec, prec_t> worstcase_l1(numvec const& z, numvec const& q, prec_t t) {
 
     Notes
     -----
-    This implementation works in O(n log n) time because of the sort. Using
-    quickselect to choose the right quantile would work in O(n) time.
+    This implementation uses quickselect to choose the right quantile for large n,
+    which takes linear time on typical inputs (quadratic in the worst case), and it
+    works in O(n log n) time otherwise.
 
     This function does not check whether the probability distribution sums to 1.
     **/
 
-    assert(*min_element(q.begin(), q.end()) >= 0 && *max_element(q.begin(), q.end()) <= 1);
-    assert(z.size() > 0);
-    assert(t >= 0.0 && t <= 2.0);
     assert(z.size() == q.size());
 
-    size_t sz = z.size();
+    numvec o(z.size());
+    auto r = worstcase_l1(z.data(), q.data(), z.size(), t, o.data(), NatureWorkspace::local());
+    return make_pair(move(o), r);
+}
+
+/// Outcome sets up to this size are ordered on the stack by ranking
+static const size_t L1_SMALL = 8;
+/// Outcome sets at least this large use quickselect
+static const size_t L1_SELECT = 48;
 
-    vector<size_t> smallest = sort_indexes<prec_t>(z);
-    numvec o(q);
+/**
+Moves the probability mass to the smallest value from the largest values, given
+the outcomes ordered by their values in the ascending order.
+*/
+static prec_t worstcase_l1_ordered(const prec_t* z,
+        const prec_t* q,
+        size_t n,
+        prec_t t,
+        prec_t* p,
+        const size_t* smallest) {
+    copy(q, q + n, p);
 
     auto k = smallest[0];
     auto epsilon = min(t / 2, 1 - q[k]);
 
-    o[k] += epsilon;
+    p[k] += epsilon;
 
-    auto i = sz - 1;
+    auto i = n - 1;
     while (epsilon > 0) {
         k = smallest[i];
-        auto diff = min(epsilon, o[k]);
-        o[k] -= diff;
+        auto diff = min(epsilon, p[k]);
+        p[k] -= diff;
         epsilon -= diff;
         i -= 1;
     }
 
-    auto r = inner_product(o.begin(), o.end(), z.begin(), (prec_t)0.0);
+    return inner_product(p, p + n, z, (prec_t)0.0);
+}
 
-    return make_pair(move(o), r);
+/**
+Orders a small number of outcomes by computing the rank of each value; the
+comparisons are summed rather than branched on. Ties are ranked by the index.
+*/
+static prec_t worstcase_l1_small(const prec_t* z, const prec_t* q, size_t n, prec_t t, prec_t* p) {
+    assert(n <= L1_SMALL);
+    size_t smallest[L1_SMALL];
+    for (size_t i = 0; i < n; i++) {
+        size_t rank = 0;
+        for (size_t j = 0; j < n; j++)
+            rank += (z[j] < z[i]) | ((z[j] == z[i]) & (j < i));
+        smallest[rank] = i;
+    }
+    return worstcase_l1_ordered(z, q, n, t, p, smallest);
+}
+
+/// Ranges at least this large choose the pivot as the ninther rather than the median of three
+static const size_t L1_NINTHER = 128;
+
+/// Index of the median of the values of three indices
+static size_t median3(const prec_t* z, size_t a, size_t b, size_t c) {
+    if (z[a] < z[b])
+        return z[b] < z[c] ? b : (z[a] < z[c] ? c : a);
+    return z[a] < z[c] ? a : (z[b] < z[c] ? c : b);
+}
+
+/**
+Chooses the pivot of the indices in [lo, hi) as the median of the first, middle,
+and last values, or as Tukey's ninther (the median of three such medians) in
+large ranges. Sorted, reversed, and constant values then take linear time.
+*/
+static prec_t select_pivot(const prec_t* z, const vector<size_t>& indices, size_t lo, size_t hi) {
+    const size_t n = hi - lo, mid = lo + n / 2, last = hi - 1;
+    if (n < L1_NINTHER)
+        return z[median3(z, indices[lo], indices[mid], indices[last])];
+    const size_t step = n / 8;
+    const size_t first3 = median3(z, indices[lo], indices[lo + step], indices[lo + 2 * step]);
+    const size_t mid3 = median3(z, indices[mid - step], indices[mid], indices[mid + step]);
+    const size_t last3 = median3(z, indices[last - 2 * step], indices[last - step], indices[last]);
+    return z[median3(z, first3, mid3, last3)];
+}
+
+/**
+Finds the largest values that give up the probability mass by a weighted
+quickselect with a median-of-three (or ninther) pivot. It runs in linear time on
+typical inputs, but, because the pivot is deterministic, in quadratic time in the
+worst case. Only the values above the last one to give up the mass are separated,
+they are never sorted.
+*/
+static prec_t worstcase_l1_select(const prec_t* z,
+        const prec_t* q,
+        size_t n,
+        prec_t t,
+        prec_t* p,
+        vector<size_t>& indices) {
+    copy(q, q + n, p);
+
+    const size_t k = size_t(min_element(z, z + n) - z);
+    auto epsilon = min(t / 2, 1 - q[k]);
+    p[k] += epsilon;
+
+    // the smallest value gives up its mass only after all the others
+    indices.resize(n - 1);
+    iota(indices.begin(), indices.begin() + k, 0);
+    iota(indices.begin() + k, indices.end(), k + 1);
+
+    // indices in [lo, hi) are candidates for giving up the remaining epsilon
+    size_t lo = 0, hi = indices.size();
+    while (epsilon > 0 && lo < hi) {
+        const prec_t pivot = select_pivot(z, indices, lo, hi);
+
+        // three-way partition: [lo, gt) greater, [gt, eq) equal, [eq, hi) smaller than the pivot
+        size_t gt = lo, eq = lo, sm = hi;
+        while (eq < sm) {
+            const prec_t value = z[indices[eq]];
+            if (value > pivot)
+                swap(indices[gt++], indices[eq++]);
+            else if (value < pivot)
+                swap(indices[eq], indices[--sm]);
+            else
+                eq++;
+        }
+
+        prec_t greater = 0;
+        for (size_t i = lo; i < gt; i++)
+            greater += p[indices[i]];
+
+        // the greater values alone cover epsilon: the smaller values keep their mass
+        if (greater >= epsilon) {
+            hi = gt;
+            continue;
+        }
+
+        // all of the greater values give up their mass, then the equal values do
+        for (size_t i = lo; i < gt; i++)
+            p[indices[i]] = 0;
+        epsilon -= greater;
+        for (size_t i = gt; i < eq && epsilon > 0; i++) {
+            const auto diff = min(epsilon, p[indices[i]]);
+            p[indices[i]] -= diff;
+            epsilon -= diff;
+        }
+        lo = eq;
+    }
+    if (epsilon > 0)
+        p[k] -= min(epsilon, p[k]);
+
+    return inner_product(p, p + n, z, (prec_t)0.0);
+}
+
+prec_t worstcase_l1(const prec_t* z, const prec_t* q, size_t n, prec_t t, prec_t* p, NatureWorkspace& workspace) {
+    assert(*min_element(q, q + n) >= 0 && *max_element(q, q + n) <= 1);
+    assert(n > 0);
+    assert(t >= 0.0 && t <= 2.0);
+
+    if (n <= L1_SMALL)
+        return worstcase_l1_small(z, q, n, t, p);
+    if (n >= L1_SELECT)
+        return worstcase_l1_select(z, q, n, t, p, workspace.indices);
+
+    // sort indexes by the values in ascending order
+    vector<size_t>& smallest = workspace.indices;
+    smallest.resize(n);
+    iota(smallest.begin(), smallest.end(), 0);
+    sort(smallest.begin(), smallest.end(), [z](size_t i1, size_t i2) { return z[i1] < z[i2]; });
+
+    return worstcase_l1_ordered(z, q, n, t, p, smallest.data());
+}
+
+prec_t worstcase_l1_warm(const prec_t* z, const prec_t* q, size_t n, prec_t t, prec_t* p, vector<size_t>& order) {
+    assert(*min_element(q, q + n) >= 0 && *max_element(q, q + n) <= 1);
+    assert(n > 0);
+    assert(t >= 0.0 && t <= 2.0);
+
+    const auto less = [z](size_t i1, size_t i2) { return z[i1] < z[i2]; };
+
+    if (order.size() != n) {
+        order.resize(n);
+        iota(order.begin(), order.end(), 0);
+        sort(order.begin(), order.end(), less);
+        return worstcase_l1_ordered(z, q, n, t, p, order.data());
+    }
+
+    // insertion sort is linear when few outcomes change their position; when the
+    // order changes a lot, the remainder is sorted from scratch
+    size_t budget = 4 * n;
+    for (size_t i = 1; i < n; i++) {
+        const size_t current = order[i];
+        size_t j = i;
+        for (; j > 0 && budget > 0 && less(current, order[j - 1]); j--, budget--)
+            order[j] = order[j - 1];
+        order[j] = current;
+        if (budget == 0) {
+            sort(order.begin(), order.end(), less);
+            break;
+        }
+    }
+
+    return worstcase_l1_ordered(z, q, n, t, p, order.data());
+}
+
+/**
+Appends the breakpoints of the worst-case value of worstcase_l1 as a function of the
+threshold. The function is linear between the breakpoints and constant after the last
+one; the first breakpoint has the threshold 0.
+\param order Temporary storage for the order of the outcomes
+\param thresholds Output of the thresholds of the breakpoints
+\param values Output of the worst-case values at the breakpoints; decreasing
+*/
+static void l1_breakpoints(const prec_t* z,
+        const prec_t* q,
+        size_t n,
+        vector<size_t>& order,
+        numvec& thresholds,
+        numvec& values) {
+    if (n == 0)
+        throw invalid_argument("Action with no outcomes.");
+
+    const size_t k = size_t(min_element(z, z + n) - z);
+    order.resize(n);
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(), [z](size_t i1, size_t i2) { return z[i1] > z[i2]; });
+
+    thresholds.push_back(0.0);
+    values.push_back(inner_product(q, q + n, z, (prec_t)0.0));
+
+    // the mass moves from the largest values to the smallest one
+    const prec_t capacity = 1 - q[k];
+    prec_t moved = 0;
+    for (size_t i : order) {
+        if (z[i] <= z[k] || moved >= capacity)
+            break;
+        const prec_t step = min(q[i], capacity - moved);
+        if (step <= 0)
+            continue;
+        moved += step;
+        thresholds.push_back(2 * moved);
+        values.push_back(values.back() + step * (z[k] - z[i]));
+    }
+}
+
+/** Breakpoints of all actions stored together in the workspace; see l1_breakpoints */
+class L1Breakpoints {
+public:
+    L1Breakpoints(const prec_t* z, const prec_t* q, const size_t* outcomes, size_t actions, SRectWorkspace& workspace)
+            : offsets(workspace.breakpoint_offsets),
+              thresholds(workspace.breakpoint_thresholds),
+              values(workspace.breakpoint_values) {
+        offsets.assign(actions + 1, 0);
+        thresholds.clear();
+        values.clear();
+        for (size_t a = 0; a < actions; a++) {
+            l1_breakpoints(z + outcomes[a],
+                    q + outcomes[a],
+                    outcomes[a + 1] - outcomes[a],
+                    workspace.order,
+                    thresholds,
+                    values);
+            offsets[a + 1] = thresholds.size();
+        }
+    }
+
+    /** Value of the action with no threshold */
+    prec_t nominal(size_t a) const { return values[offsets[a]]; }
+
+    /** Smallest value of the action for any threshold */
+    prec_t minimal(size_t a) const { return values[offsets[a + 1] - 1]; }
+
+    /**
+    Index of the first breakpoint of the piece with the value u, which must be
+    between the minimal and the nominal values
+    */
+    size_t piece(size_t a, prec_t u) const {
+        // the first breakpoint with a value that is at most u ends the piece
+        const auto end = lower_bound(
+                values.begin() + offsets[a] + 1, values.begin() + offsets[a + 1], u, greater<prec_t>());
+        return size_t(end - values.begin()) - 1;
+    }
+
+    /** Smallest threshold that reduces the value of the action to u; infinite if none does */
+    prec_t threshold(size_t a, prec_t u) const {
+        if (u >= nominal(a))
+            return 0;
+        if (u < minimal(a))
+            return numeric_limits<prec_t>::infinity();
+        const size_t j = piece(a, u);
+        const prec_t step = (values[j] - u) / (values[j] - values[j + 1]) * (thresholds[j + 1] - thresholds[j]);
+        // rounding must not leave the piece
+        return min(thresholds[j] + step, thresholds[j + 1]);
+    }
+
+    /** Sum of the thresholds that reduce the values of all actions to u */
+    prec_t total(prec_t u) const {
+        prec_t result = 0;
+        for (size_t a = 0; a + 1 < offsets.size(); a++)
+            result += threshold(a, u);
+        return result;
+    }
+
+    /** Decrease of the value for a unit of threshold on the piece with the value u */
+    prec_t rate(size_t a, prec_t u) const {
+        const size_t j = piece(a, u);
+        return (values[j] - values[j + 1]) / (thresholds[j + 1] - thresholds[j]);
+    }
+
+    /// Position of the first breakpoint of each action; the last element is their number
+    vector<size_t>& offsets;
+    /// Thresholds of the breakpoints
+    numvec& thresholds;
+    /// Worst-case values at the breakpoints
+    numvec& values;
+};
+
+SRectWorkspace& SRectWorkspace::local() {
+    thread_local SRectWorkspace workspace;
+    return workspace;
+}
+
+/** Concatenates the outcomes of the actions; returns the offsets of the actions */
+static vector<size_t> flatten_outcomes(const vector<numvec>& z, const vector<numvec>& q, numvec& zflat, numvec& qflat) {
+    assert(z.size() == q.size());
+    vector<size_t> offsets(z.size() + 1, 0);
+    for (size_t a = 0; a < z.size(); a++) {
+        assert(z[a].size() == q[a].size());
+        zflat.insert(zflat.end(), z[a].begin(), z[a].end());
+        qflat.insert(qflat.end(), q[a].begin(), q[a].end());
+        offsets[a + 1] = zflat.size();
+    }
+    return offsets;
+}
+
+tuple<numvec, numvec, prec_t> worstcase_srect_l1(const vector<numvec>& z, const vector<numvec>& q, prec_t t) {
+    numvec zflat, qflat;
+    const vector<size_t> offsets = flatten_outcomes(z, q, zflat, qflat);
+    numvec decision(z.size()), thresholds(z.size());
+    const prec_t value = worstcase_srect_l1(zflat.data(),
+            qflat.data(),
+            offsets.data(),
+            z.size(),
+            t,
+            decision.data(),
+            thresholds.data(),
+            SRectWorkspace::local());
+    return make_tuple(move(decision), move(thresholds), value);
+}
+
+prec_t worstcase_srect_l1(const prec_t* z,
+        const prec_t* q,
+        const size_t* outcomes,
+        size_t actions,
+        prec_t t,
+        prec_t* decision,
+        prec_t* thresholds,
+        SRectWorkspace& workspace) {
+    assert(t >= 0);
+    if (actions == 0)
+        throw invalid_argument("No actions to randomize over.");
+
+    const L1Breakpoints breakpoints(z, q, outcomes, actions, workspace);
+
+    // the value is between the largest minimal and the largest nominal values
+    prec_t lower = -numeric_limits<prec_t>::infinity(), upper = -numeric_limits<prec_t>::infinity();
+    size_t lowest = 0;
+    for (size_t a = 0; a < actions; a++) {
+        if (breakpoints.minimal(a) > lower) {
+            lower = breakpoints.minimal(a);
+            lowest = a;
+        }
+        upper = max(upper, breakpoints.nominal(a));
+    }
+
+    fill(decision, decision + actions, 0.0);
+
+    // the threshold is sufficient to reduce all actions to their minimal values: nature
+    // cannot reduce the action with the largest minimal value any further
+    const prec_t lowertotal = breakpoints.total(lower);
+    if (lowertotal <= t) {
+        for (size_t a = 0; a < actions; a++)
+            thresholds[a] = breakpoints.threshold(a, lower);
+        decision[lowest] = 1;
+        return lower;
+    }
+
+    // the total threshold is linear between consecutive breakpoint values
+    numvec& candidates = workspace.candidates;
+    candidates.clear();
+    for (prec_t v : breakpoints.values) {
+        if (v > lower && v <= upper)
+            candidates.push_back(v);
+    }
+    sort(candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+
+    // the smallest candidate with the total at most t; the largest one has the total 0
+    size_t first = 0, last = candidates.size() - 1;
+    while (first < last) {
+        const size_t middle = first + (last - first) / 2;
+        if (breakpoints.total(candidates[middle]) <= t)
+            last = middle;
+        else
+            first = middle + 1;
+    }
+    const prec_t above = candidates[first];
+    const prec_t below = first > 0 ? candidates[first - 1] : lower;
+    const prec_t belowtotal = first > 0 ? breakpoints.total(below) : lowertotal;
+    const prec_t abovetotal = breakpoints.total(above);
+
+    const prec_t value = below + (belowtotal - t) / (belowtotal - abovetotal) * (above - below);
+    for (size_t a = 0; a < actions; a++)
+        thresholds[a] = breakpoints.threshold(a, value);
+
+    // the decision equalizes the decrease of the value for an additional unit of the
+    // threshold among the actions that nature reduces
+    const prec_t inside = (below + above) / 2;
+    for (size_t a = 0; a < actions; a++) {
+        if (breakpoints.nominal(a) > inside)
+            decision[a] = 1 / breakpoints.rate(a, inside);
+    }
+    const prec_t sum = accumulate(decision, decision + actions, (prec_t)0.0);
+    for (size_t a = 0; a < actions; a++)
+        decision[a] /= sum;
+
+    return value;
+}
+
+pair<numvec, prec_t> response_srect_l1(const vector<numvec>& z, const vector<numvec>& q, prec_t t, const numvec& d) {
+    assert(z.size() == d.size());
+    numvec zflat, qflat;
+    const vector<size_t> offsets = flatten_outcomes(z, q, zflat, qflat);
+    numvec thresholds(z.size());
+    const prec_t value = response_srect_l1(zflat.data(),
+            qflat.data(),
+            offsets.data(),
+            z.size(),
+            t,
+            d.data(),
+            thresholds.data(),
+            SRectWorkspace::local());
+    return make_pair(move(thresholds), value);
+}
+
+prec_t response_srect_l1(const prec_t* z,
+        const prec_t* q,
+        const size_t* outcomes,
+        size_t actions,
+        prec_t t,
+        const prec_t* d,
+        prec_t* thresholds,
+        SRectWorkspace& workspace) {
+    assert(t >= 0);
+    const L1Breakpoints breakpoints(z, q, outcomes, actions, workspace);
+
+    // pieces of all the actions, ordered by the decrease of the weighted value
+    vector<size_t>& pieces = workspace.pieces;
+    numvec& lengths = workspace.lengths;
+    numvec& rates = workspace.rates;
+    vector<size_t>& order = workspace.order;
+    pieces.clear();
+    lengths.clear();
+    rates.clear();
+    prec_t value = 0;
+    for (size_t a = 0; a < actions; a++) {
+        if (d[a] <= 0)
+            continue;
+        value += d[a] * breakpoints.nominal(a);
+        for (size_t j = breakpoints.offsets[a]; j + 1 < breakpoints.offsets[a + 1]; j++) {
+            const prec_t length = breakpoints.thresholds[j + 1] - breakpoints.thresholds[j];
+            pieces.push_back(a);
+            lengths.push_back(length);
+            rates.push_back(d[a] * (breakpoints.values[j] - breakpoints.values[j + 1]) / length);
+        }
+    }
+    // the pieces of each action are convex, and the stable sort keeps them in their order
+    order.resize(pieces.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&rates](size_t i1, size_t i2) { return rates[i1] > rates[i2]; });
+
+    fill(thresholds, thresholds + actions, 0.0);
+    prec_t remaining = t;
+    for (size_t i : order) {
+        if (remaining <= 0)
+            break;
+        const prec_t step = min(lengths[i], remaining);
+        thresholds[pieces[i]] += step;
+        value -= rates[i] * step;
+        remaining -= step;
+    }
+    // rounding must not exceed the last breakpoint
+    for (size_t a = 0; a < actions; a++)
+        thresholds[a] = min(thresholds[a], breakpoints.thresholds[breakpoints.offsets[a + 1] - 1]);
+    return value;
 }
 }
@@ -0,0 +1,375 @@
+#include "kernels.hpp"
+
+// the vectorized kernels are compiled with function-specific target attributes,
+// which makes it possible to build the library without any -m flags and
+// select the instruction set at runtime
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__) && !defined(_WIN32)
+#define CRAAM_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace craam {
+namespace kernels {
+
+// **************************************************************************************
+//  Portable kernels
+// **************************************************************************************
+
+prec_t value_portable(const idx_t* indices,
+        const prec_t* probabilities,
+        const prec_t* rewards,
+        size_t n,
+        const prec_t* valuefunction,
+        prec_t discount) {
+    prec_t value = 0.0;
+    for (size_t c = 0; c < n; c++)
+        value += probabilities[c] * (rewards[c] + discount * valuefunction[indices[c]]);
+    return value;
+}
+
+prec_t dot_portable(const prec_t* probabilities, const prec_t* rewards, size_t n) {
+    prec_t value = 0.0;
+    for (size_t c = 0; c < n; c++)
+        value += probabilities[c] * rewards[c];
+    return value;
+}
+
+prec_t sparse_dot_portable(const idx_t* indices, const prec_t* probabilities, size_t n, const prec_t* valuefunction) {
+    prec_t value = 0.0;
+    for (size_t c = 0; c < n; c++)
+        value += probabilities[c] * valuefunction[indices[c]];
+    return value;
+}
+
+prec_t sparse_dot_f_portable(const idx_t* indices, const float* probabilities, size_t n, const prec_t* valuefunction) {
+    prec_t value = 0.0;
+    for (size_t c = 0; c < n; c++)
+        value += prec_t(probabilities[c]) * valuefunction[indices[c]];
+    return value;
+}
+
+#ifdef CRAAM_X86_KERNELS
+
+static_assert(sizeof(prec_t) == sizeof(double), "Vectorized kernels require double precision.");
+
+// **************************************************************************************
+//  Gathers of the value function with 32-bit or 64-bit indices
+// **************************************************************************************
+
+// The gathers are all masked with an explicit zero source; the unmasked intrinsics
+// gather into an undefined register, which GCC reports as an uninitialized value.
+
+/// Mask that selects all 4 lanes of an AVX2 gather
+__attribute__((target("avx2,fma"))) inline __m256d all_avx2() {
+    return _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+}
+
+#ifdef CRAAM_INDEX_64
+
+/// Gathers 4 values of the value function
+__attribute__((target("avx2,fma"))) inline __m256d gather_avx2(const prec_t* valuefunction, const idx_t* indices) {
+    const __m256i vindex = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices));
+    return _mm256_mask_i64gather_pd(_mm256_setzero_pd(), valuefunction, vindex, all_avx2(), 8);
+}
+
+/// Gathers 8 values of the value function
+__attribute__((target("avx512f"))) inline __m512d gather_avx512(const prec_t* valuefunction, const idx_t* indices) {
+    return _mm512_mask_i64gather_pd(_mm512_setzero_pd(), 0xFF, _mm512_loadu_si512(indices), valuefunction, 8);
+}
+
+/// Gathers up to 8 values of the value function; the values not in the mask are 0
+__attribute__((target("avx512f"))) inline __m512d
+gather_avx512(const prec_t* valuefunction, const idx_t* indices, __mmask8 mask) {
+    const __m512i vindex = _mm512_maskz_loadu_epi64(mask, indices);
+    return _mm512_mask_i64gather_pd(_mm512_setzero_pd(), mask, vindex, valuefunction, 8);
+}
+
+#else
+
+/// Gathers 4 values of the value function
+__attribute__((target("avx2,fma"))) inline __m256d gather_avx2(const prec_t* valuefunction, const idx_t* indices) {
+    const __m128i vindex = _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices));
+    return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), valuefunction, vindex, all_avx2(), 8);
+}
+
+/// Gathers 8 values of the value function
+__attribute__((target("avx512f"))) inline __m512d gather_avx512(const prec_t* valuefunction, const idx_t* indices) {
+    const __m256i vindex = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices));
+    return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xFF, vindex, valuefunction, 8);
+}
+
+/// Gathers up to 8 values of the value function; the values not in the mask are 0
+__attribute__((target("avx512f"))) inline __m512d
+gather_avx512(const prec_t* valuefunction, const idx_t* indices, __mmask8 mask) {
+    const __m512i indices16 = _mm512_maskz_loadu_epi32(static_cast<__mmask16>(mask), indices);
+    const __m256i vindex = _mm512_maskz_extracti64x4_epi64(0xF, indices16, 0);
+    return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), mask, vindex, valuefunction, 8);
+}
+
+#endif
+
+// **************************************************************************************
+//  AVX2 kernels
+// **************************************************************************************
+
+__attribute__((target("avx2,fma"))) inline prec_t hsum_avx2(__m256d x) {
+    __m128d lo = _mm256_castpd256_pd128(x);
+    __m128d hi = _mm256_extractf128_pd(x, 1);
+    lo = _mm_add_pd(lo, hi);
+    __m128d high64 = _mm_unpackhi_pd(lo, lo);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, high64));
+}
+
+__attribute__((target("avx2,fma"))) prec_t value_avx2(const idx_t* indices,
+        const prec_t* probabilities,
+        const prec_t* rewards,
+        size_t n,
+        const prec_t* valuefunction,
+        prec_t discount) {
+    const __m256d vdiscount = _mm256_set1_pd(discount);
+    __m256d acc = _mm256_setzero_pd();
+
+    size_t c = 0;
+    for (; c + 4 <= n; c += 4) {
+        const __m256d values = gather_avx2(valuefunction, indices + c);
+        const __m256d target = _mm256_fmadd_pd(vdiscount, values, _mm256_loadu_pd(rewards + c));
+        acc = _mm256_fmadd_pd(_mm256_loadu_pd(probabilities + c), target, acc);
+    }
+    prec_t value = hsum_avx2(acc);
+    for (; c < n; c++)
+        value += probabilities[c] * (rewards[c] + discount * valuefunction[indices[c]]);
+    return value;
+}
+
+__attribute__((target("avx2,fma"))) prec_t dot_avx2(const prec_t* probabilities, const prec_t* rewards, size_t n) {
+    __m256d acc = _mm256_setzero_pd();
+
+    size_t c = 0;
+    for (; c + 4 <= n; c += 4)
+        acc = _mm256_fmadd_pd(_mm256_loadu_pd(probabilities + c), _mm256_loadu_pd(rewards + c), acc);
+
+    prec_t value = hsum_avx2(acc);
+    for (; c < n; c++)
+        value += probabilities[c] * rewards[c];
+    return value;
+}
+
+__attribute__((target("avx2,fma"))) prec_t sparse_dot_avx2(const idx_t* indices,
+        const prec_t* probabilities,
+        size_t n,
+        const prec_t* valuefunction) {
+    __m256d acc = _mm256_setzero_pd();
+
+    size_t c = 0;
+    for (; c + 4 <= n; c += 4) {
+        const __m256d values = gather_avx2(valuefunction, indices + c);
+        acc = _mm256_fmadd_pd(_mm256_loadu_pd(probabilities + c), values, acc);
+    }
+    prec_t value = hsum_avx2(acc);
+    for (; c < n; c++)
+        value += probabilities[c] * valuefunction[indices[c]];
+    return value;
+}
+
+__attribute__((target("avx2,fma"))) prec_t sparse_dot_f_avx2(const idx_t* indices,
+        const float* probabilities,
+        size_t n,
+        const prec_t* valuefunction) {
+    __m256d acc = _mm256_setzero_pd();
+
+    size_t c = 0;
+    for (; c + 4 <= n; c += 4) {
+        const __m256d values = gather_avx2(valuefunction, indices + c);
+        const __m256d probs = _mm256_cvtps_pd(_mm_loadu_ps(probabilities + c));
+        acc = _mm256_fmadd_pd(probs, values, acc);
+    }
+    prec_t value = hsum_avx2(acc);
+    for (; c < n; c++)
+        value += prec_t(probabilities[c]) * valuefunction[indices[c]];
+    return value;
+}
+
+// **************************************************************************************
+//  AVX-512 kernels
+// **************************************************************************************
+
+/// Sums the lanes; _mm512_reduce_add_pd and the 512-bit casts extract into undefined registers
+__attribute__((target("avx512f"))) inline prec_t hsum_avx512(__m512d x) {
+    const __m256d half = _mm256_add_pd(_mm512_maskz_extractf64x4_pd(0xF, x, 0),
+            _mm512_maskz_extractf64x4_pd(0xF, x, 1));
+    __m128d lo = _mm_add_pd(_mm256_castpd256_pd128(half), _mm256_extractf128_pd(half, 1));
+    __m128d high64 = _mm_unpackhi_pd(lo, lo);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, high64));
+}
+
+__attribute__((target("avx512f"))) prec_t value_avx512(const idx_t* indices,
+        const prec_t* probabilities,
+        const prec_t* rewards,
+        size_t n,
+        const prec_t* valuefunction,
+        prec_t discount) {
+    const __m512d vdiscount = _mm512_set1_pd(discount);
+    __m512d acc = _mm512_setzero_pd();
+
+    size_t c = 0;
+    for (; c + 8 <= n; c += 8) {
+        const __m512d values = gather_avx512(valuefunction, indices + c);
+        const __m512d target = _mm512_fmadd_pd(vdiscount, values, _mm512_loadu_pd(rewards + c));
+        acc = _mm512_fmadd_pd(_mm512_loadu_pd(probabilities + c), target, acc);
+    }
+    // the remainder is processed with a masked gather to avoid a scalar loop
+    if (c < n) {
+        const __mmask8 mask = static_cast<__mmask8>((1u << (n - c)) - 1);
+        const __m512d values = gather_avx512(valuefunction, indices + c, mask);
+        const __m512d target = _mm512_fmadd_pd(vdiscount, values, _mm512_maskz_loadu_pd(mask, rewards + c));
+        acc = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, probabilities + c), target, acc);
+    }
+    return hsum_avx512(acc);
+}
+
+__attribute__((target("avx512f"))) prec_t dot_avx512(const prec_t* probabilities, const prec_t* rewards, size_t n) {
+    __m512d acc = _mm512_setzero_pd();
+
+    size_t c = 0;
+    for (; c + 8 <= n; c += 8)
+        acc = _mm512_fmadd_pd(_mm512_loadu_pd(probabilities + c), _mm512_loadu_pd(rewards + c), acc);
+    if (c < n) {
+        const __mmask8 mask = static_cast<__mmask8>((1u << (n - c)) - 1);
+        acc = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, probabilities + c), _mm512_maskz_loadu_pd(mask, rewards + c),
+                acc);
+    }
+    return hsum_avx512(acc);
+}
+
+__attribute__((target("avx512f"))) prec_t sparse_dot_avx512(const idx_t* indices,
+        const prec_t* probabilities,
+        size_t n,
+        const prec_t* valuefunction) {
+    __m512d acc = _mm512_setzero_pd();
+
+    size_t c = 0;
+    for (; c + 8 <= n; c += 8) {
+        const __m512d values = gather_avx512(valuefunction, indices + c);
+        acc = _mm512_fmadd_pd(_mm512_loadu_pd(probabilities + c), values, acc);
+    }
+    if (c < n) {
+        const __mmask8 mask = static_cast<__mmask8>((1u << (n - c)) - 1);
+        const __m512d values = gather_avx512(valuefunction, indices + c, mask);
+        acc = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, probabilities + c), values, acc);
+    }
+    return hsum_avx512(acc);
+}
+
+__attribute__((target("avx512f"))) prec_t sparse_dot_f_avx512(const idx_t* indices,
+        const float* probabilities,
+        size_t n,
+        const prec_t* valuefunction) {
+    __m512d acc = _mm512_setzero_pd();
+
+    size_t c = 0;
+    for (; c + 8 <= n; c += 8) {
+        const __m512d values = gather_avx512(valuefunction, indices + c);
+        const __m512d probs = _mm512_maskz_cvtps_pd(0xFF, _mm256_loadu_ps(probabilities + c));
+        acc = _mm512_fmadd_pd(probs, values, acc);
+    }
+    if (c < n) {
+        const __mmask8 mask = static_cast<__mmask8>((1u << (n - c)) - 1);
+        const __m512d values = gather_avx512(valuefunction, indices + c, mask);
+        const __m512 probs16 = _mm512_maskz_loadu_ps(static_cast<__mmask16>(mask), probabilities + c);
+        const __m256 probs8 = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xF, _mm512_castps_pd(probs16), 0));
+        const __m512d probs = _mm512_maskz_cvtps_pd(mask, probs8);
+        acc = _mm512_fmadd_pd(probs, values, acc);
+    }
+    return hsum_avx512(acc);
+}
+
+#endif // CRAAM_X86_KERNELS
+
+// **************************************************************************************
+//  Kernel selection
+// **************************************************************************************
+
+// the portable kernels are used until the best ones are selected during startup
+ValueKernel value_kernel = &value_portable;
+DotKernel dot_kernel = &dot_portable;
+SparseDotKernel sparse_dot_kernel = &sparse_dot_portable;
+SparseDotKernelF sparse_dot_kernel_f = &sparse_dot_f_portable;
+
+/// Instruction set of the current kernels
+static SimdIsa current_isa = SimdIsa::Portable;
+
+bool is_isa_supported(SimdIsa isa) {
+    switch (isa) {
+    case SimdIsa::Portable:
+        return true;
+#ifdef CRAAM_X86_KERNELS
+    case SimdIsa::AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case SimdIsa::AVX512:
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return false;
+    }
+}
+
+SimdIsa best_isa() {
+    if (is_isa_supported(SimdIsa::AVX512))
+        return SimdIsa::AVX512;
+    if (is_isa_supported(SimdIsa::AVX2))
+        return SimdIsa::AVX2;
+    return SimdIsa::Portable;
+}
+
+SimdIsa active_isa() {
+    return current_isa;
+}
+
+bool select_isa(SimdIsa isa) {
+    if (!is_isa_supported(isa))
+        return false;
+
+    switch (isa) {
+    case SimdIsa::Portable:
+        value_kernel = &value_portable;
+        dot_kernel = &dot_portable;
+        sparse_dot_kernel = &sparse_dot_portable;
+        sparse_dot_kernel_f = &sparse_dot_f_portable;
+        break;
+#ifdef CRAAM_X86_KERNELS
+    case SimdIsa::AVX2:
+        value_kernel = &value_avx2;
+        dot_kernel = &dot_avx2;
+        sparse_dot_kernel = &sparse_dot_avx2;
+        sparse_dot_kernel_f = &sparse_dot_f_avx2;
+        break;
+    case SimdIsa::AVX512:
+        value_kernel = &value_avx512;
+        dot_kernel = &dot_avx512;
+        sparse_dot_kernel = &sparse_dot_avx512;
+        sparse_dot_kernel_f = &sparse_dot_f_avx512;
+        break;
+#endif
+    default:
+        return false;
+    }
+    current_isa = isa;
+    return true;
+}
+
+const char* isa_name(SimdIsa isa) {
+    switch (isa) {
+    case SimdIsa::Portable:
+        return "portable";
+    case SimdIsa::AVX2:
+        return "avx2";
+    case SimdIsa::AVX512:
+        return "avx512";
+    }
+    return "unknown";
+}
+
+/// Selects the best kernels once at startup
+static const bool kernels_selected = select_isa(best_isa());
+}
+}
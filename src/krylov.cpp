@@ -0,0 +1,278 @@
+#include "krylov.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace craam {
+
+void SparseMatrix::add_row(const indvec& rowcolumns, const numvec& rowvalues) {
+    if (rowcolumns.size() != rowvalues.size())
+        throw invalid_argument("Columns and values must have the same size.");
+    columns.insert(columns.end(), rowcolumns.begin(), rowcolumns.end());
+    values.insert(values.end(), rowvalues.begin(), rowvalues.end());
+    offsets.push_back(values.size());
+}
+
+SparseMatrix SparseMatrix::transpose() const {
+    const size_t n = size();
+    SparseMatrix result;
+
+    // counting sort by columns; rows are visited in order and remain sorted
+    result.offsets.assign(n + 1, 0);
+    for (idx_t c : columns)
+        result.offsets[c + 1]++;
+    for (size_t i = 0; i < n; i++)
+        result.offsets[i + 1] += result.offsets[i];
+
+    result.columns.resize(columns.size());
+    result.values.resize(values.size());
+    vector<size_t> positions(result.offsets.begin(), result.offsets.end() - 1);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t k = offsets[i]; k < offsets[i + 1]; k++) {
+            const size_t position = positions[columns[k]]++;
+            result.columns[position] = idx_t(i);
+            result.values[position] = values[k];
+        }
+    }
+    return result;
+}
+
+void SparseMatrix::multiply(const numvec& x, numvec& y) const {
+    const size_t n = size();
+    y.resize(n);
+#pragma omp parallel for
+    for (auto i = 0l; i < (long)n; i++) {
+        prec_t sum = 0;
+        for (size_t k = offsets[i]; k < offsets[i + 1]; k++)
+            sum += values[k] * x[columns[k]];
+        y[i] = sum;
+    }
+}
+
+// **************************************************************************************
+//  Vector operations
+// **************************************************************************************
+
+static prec_t dot(const numvec& a, const numvec& b) {
+    prec_t sum = 0;
+#pragma omp parallel for reduction(+ : sum)
+    for (auto i = 0l; i < (long)a.size(); i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static prec_t max_abs(const numvec& a) {
+    prec_t result = 0;
+#pragma omp parallel for reduction(max : result)
+    for (auto i = 0l; i < (long)a.size(); i++)
+        result = max(result, std::abs(a[i]));
+    return result;
+}
+
+// **************************************************************************************
+//  Preconditioners
+// **************************************************************************************
+
+/** Applies the inverse of an approximation of a matrix */
+class LinearPreconditioner {
+public:
+    LinearPreconditioner(const SparseMatrix& A, Preconditioner type) : A(A), type(type) {
+        const size_t n = A.size();
+        if (type == Preconditioner::None)
+            return;
+
+        // find the diagonal entries
+        diagonal.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            const auto first = A.columns.begin() + A.offsets[i], last = A.columns.begin() + A.offsets[i + 1];
+            const auto it = lower_bound(first, last, idx_t(i));
+            if (it == last || *it != idx_t(i))
+                throw invalid_argument("Missing diagonal entry in row " + to_string(i) + ".");
+            diagonal[i] = size_t(it - A.columns.begin());
+        }
+
+        if (type == Preconditioner::Jacobi) {
+            inverse.resize(n);
+            for (size_t i = 0; i < n; i++) {
+                if (A.values[diagonal[i]] == 0)
+                    throw invalid_argument("Zero on the diagonal in row " + to_string(i) + ".");
+                inverse[i] = 1.0 / A.values[diagonal[i]];
+            }
+        } else {
+            factorize();
+        }
+    }
+
+    /** Computes z = M^{-1} r */
+    void apply(const numvec& r, numvec& z) const {
+        const size_t n = A.size();
+        z.resize(n);
+        switch (type) {
+        case Preconditioner::None:
+            z = r;
+            break;
+        case Preconditioner::Jacobi:
+#pragma omp parallel for
+            for (auto i = 0l; i < (long)n; i++)
+                z[i] = inverse[i] * r[i];
+            break;
+        case Preconditioner::ILU0:
+            // forward substitution with the unit lower triangle
+            for (size_t i = 0; i < n; i++) {
+                prec_t sum = r[i];
+                for (size_t k = A.offsets[i]; k < diagonal[i]; k++)
+                    sum -= factors[k] * z[A.columns[k]];
+                z[i] = sum;
+            }
+            // backward substitution with the upper triangle
+            for (size_t i = n; i-- > 0;) {
+                prec_t sum = z[i];
+                for (size_t k = diagonal[i] + 1; k < A.offsets[i + 1]; k++)
+                    sum -= factors[k] * z[A.columns[k]];
+                z[i] = sum / factors[diagonal[i]];
+            }
+            break;
+        }
+    }
+
+protected:
+    const SparseMatrix& A;
+    Preconditioner type;
+    /// Positions of the diagonal entries
+    vector<size_t> diagonal;
+    /// Inverse of the diagonal for the Jacobi preconditioner
+    numvec inverse;
+    /// Incomplete LU factors stored in the sparsity pattern of A
+    numvec factors;
+
+    /** Computes the incomplete LU factorization with no fill-in */
+    void factorize() {
+        const size_t n = A.size();
+        factors = A.values;
+        // position of each column in the current row, or none
+        const size_t none = numeric_limits<size_t>::max();
+        vector<size_t> position(n, none);
+
+        for (size_t i = 0; i < n; i++) {
+            for (size_t k = A.offsets[i]; k < A.offsets[i + 1]; k++)
+                position[A.columns[k]] = k;
+
+            for (size_t k = A.offsets[i]; k < diagonal[i]; k++) {
+                const size_t row = A.columns[k];
+                factors[k] /= factors[diagonal[row]];
+                for (size_t j = diagonal[row] + 1; j < A.offsets[row + 1]; j++) {
+                    if (position[A.columns[j]] != none)
+                        factors[position[A.columns[j]]] -= factors[k] * factors[j];
+                }
+            }
+            if (factors[diagonal[i]] == 0)
+                throw invalid_argument("Zero pivot in the incomplete LU factorization in row " + to_string(i) + ".");
+
+            for (size_t k = A.offsets[i]; k < A.offsets[i + 1]; k++)
+                position[A.columns[k]] = none;
+        }
+    }
+};
+
+// **************************************************************************************
+//  BiCGSTAB
+// **************************************************************************************
+
+LinearSolution bicgstab(const SparseMatrix& A,
+        const numvec& b,
+        numvec x,
+        Preconditioner preconditioner,
+        unsigned long iterations,
+        prec_t tolerance) {
+    const size_t n = A.size();
+    if (b.size() != n)
+        throw invalid_argument("Size of the right-hand side does not match the matrix.");
+    if (x.empty())
+        x.assign(n, 0.0);
+    else if (x.size() != n)
+        throw invalid_argument("Size of the initial solution does not match the matrix.");
+
+    const LinearPreconditioner M(A, preconditioner);
+
+    numvec r(n), rhat, p(n, 0.0), v(n, 0.0), phat, s(n), shat, t;
+
+    // initial residual
+    A.multiply(x, r);
+#pragma omp parallel for
+    for (auto i = 0l; i < (long)n; i++)
+        r[i] = b[i] - r[i];
+    rhat = r;
+
+    prec_t residual = max_abs(r);
+    prec_t rho = 1, alpha = 1, omega = 1;
+
+    unsigned long i;
+    for (i = 0; i < iterations && residual > tolerance; i++) {
+        prec_t rhonew = dot(rhat, r);
+        // breakdown: restart with the current residual as the shadow residual
+        if (omega == 0 ||
+                std::abs(rhonew) <= numeric_limits<prec_t>::epsilon() * sqrt(dot(rhat, rhat) * dot(r, r))) {
+            rhat = r;
+            rhonew = dot(rhat, r);
+            rho = alpha = omega = 1;
+            fill(p.begin(), p.end(), 0.0);
+            fill(v.begin(), v.end(), 0.0);
+        }
+
+        const prec_t beta = (rhonew / rho) * (alpha / omega);
+        rho = rhonew;
+#pragma omp parallel for
+        for (auto j = 0l; j < (long)n; j++)
+            p[j] = r[j] + beta * (p[j] - omega * v[j]);
+
+        M.apply(p, phat);
+        A.multiply(phat, v);
+        const prec_t rhatv = dot(rhat, v);
+        // the shadow residual is orthogonal to the search space; restart in the next iteration
+        if (rhatv == 0) {
+            omega = 0;
+            continue;
+        }
+        alpha = rho / rhatv;
+
+#pragma omp parallel for
+        for (auto j = 0l; j < (long)n; j++)
+            s[j] = r[j] - alpha * v[j];
+
+        // the half step may already be sufficient
+        if (max_abs(s) <= tolerance) {
+#pragma omp parallel for
+            for (auto j = 0l; j < (long)n; j++)
+                x[j] += alpha * phat[j];
+            r = s;
+            residual = max_abs(r);
+            i++;
+            break;
+        }
+
+        M.apply(s, shat);
+        A.multiply(shat, t);
+        const prec_t tt = dot(t, t);
+        omega = tt > 0 ? dot(t, s) / tt : 0;
+
+#pragma omp parallel for
+        for (auto j = 0l; j < (long)n; j++) {
+            x[j] += alpha * phat[j] + omega * shat[j];
+            r[j] = s[j] - omega * t[j];
+        }
+        residual = max_abs(r);
+    }
+
+    // the recursively updated residual may drift from the true one
+    A.multiply(x, r);
+#pragma omp parallel for
+    for (auto j = 0l; j < (long)n; j++)
+        r[j] = b[j] - r[j];
+    residual = max_abs(r);
+
+    return LinearSolution(x, residual, i);
+}
+}
@@ -1,7 +1,12 @@
 #include "modeltools.hpp"
 
+#include "MappedFile.hpp"
+#include "ModelBuilder.hpp"
 #include "RMDP.hpp"
 
+#include <cstdint>
+#include <cstdlib>
+
 namespace craam {
 
 using namespace util::lang;
@@ -38,9 +43,18 @@ template void add_transition<RMDP_L1>(RMDP_L1& mdp,
         long toid,
         prec_t probability,
         prec_t reward);
+template void add_transition<RMDP_SL1>(RMDP_SL1& mdp,
+        long fromid,
+        long actionid,
+        long outcomeid,
+        long toid,
+        prec_t probability,
+        prec_t reward);
 
 template <class Model>
 Model& from_csv(Model& mdp, istream& input, bool header) {
+    // transitions are collected first and added to the model at once
+    ModelBuilder builder;
     string line;
     // skip the first row if so instructed
     if (header)
@@ -66,20 +80,272 @@ Model& from_csv(Model& mdp, istream& input, bool header) {
         idstateto = stoi(cellstring);
         // read probability
         getline(linestream, cellstring, ',');
-        probability = stof(cellstring);
+        probability = stod(cellstring);
         // read reward
         getline(linestream, cellstring, ',');
-        reward = stof(cellstring);
+        reward = stod(cellstring);
         // add transition
-        add_transition<Model>(mdp, idstatefrom, idaction, idoutcome, idstateto, probability, reward);
+        builder.add_transition(idstatefrom, idaction, idoutcome, idstateto, probability, reward);
         input >> line;
     }
-    return mdp;
+    return builder.build(mdp);
 }
 
 template MDP& from_csv(MDP& mdp, istream& input, bool header);
 template RMDP_D& from_csv(RMDP_D& mdp, istream& input, bool header);
 template RMDP_L1& from_csv(RMDP_L1& mdp, istream& input, bool header);
+template RMDP_SL1& from_csv(RMDP_SL1& mdp, istream& input, bool header);
+
+// **************************************************************************************
+//  Parallel CSV parsing
+// **************************************************************************************
+
+/// Size of a chunk of the CSV data that is parsed by a single thread
+static const size_t csv_chunk_size = size_t(1) << 22;
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/**
+Parses a non-negative or negative integer.
+\returns Pointer past the number, or nullptr if there is no valid number
+*/
+static const char* parse_long(const char* p, const char* end, long& value) {
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+    if (p == end || !is_digit(*p))
+        return nullptr;
+
+    unsigned long result = 0;
+    for (; p != end && is_digit(*p); ++p) {
+        result = result * 10 + unsigned(*p - '0');
+        if (result > static_cast<unsigned long>(numeric_limits<long>::max()))
+            return nullptr;
+    }
+    value = negative ? -long(result) : long(result);
+    return p;
+}
+
+/**
+Parses a floating point number with full double precision. Numbers with at most
+15 significant digits and small exponents are converted exactly without any
+allocation; other numbers (and special values such as inf) are converted by strtod.
+\returns Pointer past the number, or nullptr if there is no valid number
+*/
+static const char* parse_double(const char* p, const char* end, prec_t& value) {
+    // exactly representable powers of 10
+    static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    const char* start = p;
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+
+    uint64_t mantissa = 0;
+    int digits = 0; // number of significant digits in the mantissa
+    long exponent = 0;
+    bool any = false, exact = true;
+
+    for (; p != end && is_digit(*p); ++p) {
+        any = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + uint64_t(*p - '0');
+            digits += (mantissa > 0);
+        } else {
+            exponent++;
+            exact = exact && (*p == '0');
+        }
+    }
+    if (p != end && *p == '.') {
+        ++p;
+        for (; p != end && is_digit(*p); ++p) {
+            any = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + uint64_t(*p - '0');
+                digits += (mantissa > 0);
+                exponent--;
+            } else {
+                exact = exact && (*p == '0');
+            }
+        }
+    }
+    if (any && p != end && (*p == 'e' || *p == 'E')) {
+        long e;
+        const char* next = parse_long(p + 1, end, e);
+        if (next == nullptr)
+            return nullptr;
+        // very large exponents are handled by strtod
+        if (e > 10000 || e < -10000)
+            exact = false;
+        else
+            exponent += e;
+        p = next;
+    }
+
+    // fast path: the mantissa and the power of 10 are both exact doubles
+    if (any && exact && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+        double result = double(mantissa);
+        result = exponent < 0 ? result / powers[-exponent] : result * powers[exponent];
+        value = negative ? -result : result;
+        return p;
+    }
+
+    // slow path: copy the token to a terminated buffer and use strtod
+    const char* tokenend = any ? p : start;
+    while (tokenend != end && *tokenend != ',' && *tokenend != '\n' && !is_blank(*tokenend))
+        ++tokenend;
+    const size_t length = size_t(tokenend - start);
+    if (length == 0 || length >= 128)
+        return nullptr;
+    char token[128];
+    copy(start, tokenend, token);
+    token[length] = '\0';
+    // values out of range are returned as infinity or a denormal number
+    char* parsed;
+    value = strtod(token, &parsed);
+    if (parsed != token + length)
+        return nullptr;
+    return tokenend;
+}
+
+/** Skips blanks and expects a comma */
+static const char* parse_separator(const char* p, const char* end) {
+    if (p == nullptr)
+        return nullptr;
+    while (p != end && is_blank(*p))
+        ++p;
+    if (p == end || *p != ',')
+        return nullptr;
+    ++p;
+    while (p != end && is_blank(*p))
+        ++p;
+    return p;
+}
+
+/**
+Parses all lines of CSV data between begin and end.
+\param errorpos Set to the position of the first error (or nullptr if there is no error)
+*/
+static void parse_csv_chunk(const char* begin, const char* end, ModelBuilder& builder, const char*& errorpos) {
+    const char* p = begin;
+    errorpos = nullptr;
+    while (p != end) {
+        // skip empty lines and blanks
+        if (*p == '\n' || is_blank(*p)) {
+            ++p;
+            continue;
+        }
+        const char* line = p;
+        long idstatefrom, idaction, idoutcome, idstateto;
+        prec_t probability, reward;
+
+        p = parse_long(p, end, idstatefrom);
+        p = parse_separator(p, end);
+        p = p ? parse_long(p, end, idaction) : nullptr;
+        p = parse_separator(p, end);
+        p = p ? parse_long(p, end, idoutcome) : nullptr;
+        p = parse_separator(p, end);
+        p = p ? parse_long(p, end, idstateto) : nullptr;
+        p = parse_separator(p, end);
+        p = p ? parse_double(p, end, probability) : nullptr;
+        p = parse_separator(p, end);
+        p = p ? parse_double(p, end, reward) : nullptr;
+
+        if (p == nullptr || (p != end && *p != ',' && *p != '\n' && !is_blank(*p))) {
+            errorpos = line;
+            return;
+        }
+        try {
+            builder.add_transition(idstatefrom, idaction, idoutcome, idstateto, probability, reward);
+        } catch (const exception&) {
+            errorpos = line;
+            return;
+        }
+        // ignore any additional columns
+        while (p != end && *p != '\n')
+            ++p;
+    }
+}
+
+/** Parses CSV data in parallel and returns the transitions */
+static ModelBuilder parse_csv(const char* begin, const char* end, bool header) {
+    // skip the first row if so instructed
+    if (header) {
+        while (begin != end && *begin != '\n')
+            ++begin;
+    }
+
+    // split the data into chunks at line boundaries
+    vector<const char*> bounds{begin};
+    while (bounds.back() != end) {
+        const char* next = size_t(end - bounds.back()) > csv_chunk_size ? bounds.back() + csv_chunk_size : end;
+        while (next != end && *next != '\n')
+            ++next;
+        bounds.push_back(next);
+    }
+    const long chunks = long(bounds.size()) - 1;
+
+    vector<ModelBuilder> builders(chunks);
+    vector<const char*> errors(chunks, nullptr);
+
+#pragma omp parallel for schedule(dynamic)
+    for (long i = 0; i < chunks; i++) {
+        // each chunk has about one transition per 20 characters
+        builders[i].reserve(size_t(bounds[i + 1] - bounds[i]) / 20);
+        parse_csv_chunk(bounds[i], bounds[i + 1], builders[i], errors[i]);
+    }
+
+    for (const char* error : errors) {
+        if (error != nullptr) {
+            const char* lineend = error;
+            while (lineend != end && *lineend != '\n' && lineend - error < 100)
+                ++lineend;
+            throw invalid_argument("Invalid CSV line at byte " + to_string(error - begin) + ": " +
+                                   string(error, lineend));
+        }
+    }
+
+    if (chunks == 1)
+        return move(builders.front());
+    ModelBuilder result;
+    size_t total = 0;
+    for (const auto& b : builders)
+        total += b.size();
+    result.reserve(total);
+    for (auto& b : builders) {
+        result.append(b);
+        b.clear();
+    }
+    return result;
+}
+
+template <class Model>
+Model& from_csv_buffer(Model& mdp, const char* begin, const char* end, bool header) {
+    return parse_csv(begin, end, header).build(mdp);
+}
+
+template MDP& from_csv_buffer(MDP& mdp, const char* begin, const char* end, bool header);
+template RMDP_D& from_csv_buffer(RMDP_D& mdp, const char* begin, const char* end, bool header);
+template RMDP_L1& from_csv_buffer(RMDP_L1& mdp, const char* begin, const char* end, bool header);
+template RMDP_SL1& from_csv_buffer(RMDP_SL1& mdp, const char* begin, const char* end, bool header);
+
+template <class Model>
+Model& from_csv_file(Model& mdp, const string& filename, bool header) {
+    MappedFile file(filename);
+    return from_csv_buffer(mdp, file.data(), file.end(), header);
+}
+
+template MDP& from_csv_file(MDP& mdp, const string& filename, bool header);
+template RMDP_D& from_csv_file(RMDP_D& mdp, const string& filename, bool header);
+template RMDP_L1& from_csv_file(RMDP_L1& mdp, const string& filename, bool header);
+template RMDP_SL1& from_csv_file(RMDP_SL1& mdp, const string& filename, bool header);
 
 template <class Model>
 void set_outcome_thresholds(Model& mdp, prec_t threshold) {
@@ -92,6 +358,26 @@ void set_outcome_thresholds(Model& mdp, prec_t threshold) {
 
 template void set_outcome_thresholds(RMDP_L1& mdp, prec_t threshold);
 
+template <class Model>
+void set_state_thresholds(Model& mdp, prec_t threshold) {
+    for (const auto si : indices(mdp))
+        mdp.get_state(si).set_threshold(threshold);
+}
+
+template void set_state_thresholds(RMDP_SL1& mdp, prec_t threshold);
+
+template <class Model>
+void set_outcome_order_cache(Model& mdp, bool enable) {
+    for (const auto si : indices(mdp)) {
+        auto& state = mdp.get_state(si);
+        for (auto ai : indices(state))
+            state.get_action(ai).set_order_cache(enable);
+    }
+}
+
+template void set_outcome_order_cache(RMDP_L1& mdp, bool enable);
+template void set_outcome_order_cache(RMDP_SL1& mdp, bool enable);
+
 template <class Model>
 void set_uniform_outcome_dst(Model& mdp) {
     for (const auto si : indices(mdp)) {
@@ -106,6 +392,7 @@ void set_uniform_outcome_dst(Model& mdp) {
 }
 
 template void set_uniform_outcome_dst(RMDP_L1& mdp);
+template void set_uniform_outcome_dst(RMDP_SL1& mdp);
 
 template <class Model>
 void set_outcome_dst(Model& mdp, size_t stateid, size_t actionid, const numvec& dist) {
@@ -116,6 +403,7 @@ void set_outcome_dst(Model& mdp, size_t stateid, size_t actionid, const numvec&
 }
 
 template void set_outcome_dst(RMDP_L1& mdp, size_t stateid, size_t actionid, const numvec& dist);
+template void set_outcome_dst(RMDP_SL1& mdp, size_t stateid, size_t actionid, const numvec& dist);
 
 template <class Model>
 bool is_outcome_dst_normalized(const Model& mdp) {
@@ -130,6 +418,7 @@ bool is_outcome_dst_normalized(const Model& mdp) {
 }
 
 template bool is_outcome_dst_normalized(const RMDP_L1& mdp);
+template bool is_outcome_dst_normalized(const RMDP_SL1& mdp);
 
 template <class Model>
 void normalize_outcome_dst(Model& mdp) {
@@ -141,36 +430,50 @@ void normalize_outcome_dst(Model& mdp) {
 }
 
 template void normalize_outcome_dst(RMDP_L1& mdp);
+template void normalize_outcome_dst(RMDP_SL1& mdp);
 
 template <class SType>
 GRMDP<SType> robustify(const MDP& mdp, bool allowzeros) {
     // construct the result first
     GRMDP<SType> rmdp;
+    // the outcomes are collected by the builder and the weights are set once they exist
+    ModelBuilder builder;
     // iterate over all starting states (at t)
     for (size_t si : indices(mdp)) {
         const auto& s = mdp[si];
         auto& newstate = rmdp.create_state(si);
         for (size_t ai : indices(s)) {
-            auto& newaction = newstate.create_action(ai);
+            // make sure that actions with no transitions are created too
+            newstate.create_action(ai);
             const Transition& t = s[ai].get_outcome();
             // iterate over transitions next states (at t+1) and add samples
             if (allowzeros) {
-                numvec probabilities = t.probabilities_vector(mdp.state_count());
                 numvec rewards = t.rewards_vector(mdp.state_count());
-                for (size_t nsi : indices(probabilities)) {
-                    // create the outcome with the appropriate weight
-                    Transition& newoutcome = newaction.create_outcome(newaction.size(), probabilities[nsi]);
-                    // adds the single sample for each outcome
-                    newoutcome.add_sample(nsi, 1.0, rewards[nsi]);
-                }
+                // adds the single sample for each outcome
+                for (size_t nsi : indices(rewards))
+                    builder.add_transition(si, ai, nsi, nsi, 1.0, rewards[nsi]);
             } else {
                 // only consider non-zero probabilities unless allowzeros is used
-                for (size_t nsi : indices(t)) {
-                    // create the outcome with the appropriate weight
-                    Transition& newoutcome = newaction.create_outcome(newaction.size(), t.get_probabilities()[nsi]);
-                    // adds the single sample for each outcome
-                    newoutcome.add_sample(t.get_indices()[nsi], 1.0, t.get_rewards()[nsi]);
-                }
+                for (size_t nsi : indices(t))
+                    builder.add_transition(si, ai, nsi, t.get_indices()[nsi], 1.0, t.get_rewards()[nsi]);
+            }
+        }
+    }
+    builder.build(rmdp);
+
+    // set the nominal weights of the outcomes
+    for (size_t si : indices(mdp)) {
+        const auto& s = mdp[si];
+        for (size_t ai : indices(s)) {
+            auto& newaction = rmdp[si][ai];
+            const Transition& t = s[ai].get_outcome();
+            if (allowzeros) {
+                numvec probabilities = t.probabilities_vector(mdp.state_count());
+                for (size_t nsi : indices(probabilities))
+                    newaction.set_distribution(nsi, probabilities[nsi]);
+            } else {
+                for (size_t nsi : indices(t))
+                    newaction.set_distribution(nsi, t.get_probabilities()[nsi]);
             }
         }
     }
@@ -185,4 +488,5 @@ RMDP_L1 robustify_l1(const MDP& mdp, bool allowzeros) {
 // -----------------------------------
 
 template RMDP_L1 robustify<L1RobustState>(const MDP&, bool);
+template RMDP_SL1 robustify<L1SRobustState>(const MDP&, bool);
 }
@@ -1,13 +1,21 @@
 #include "Action.hpp"
+#include "CompiledRMDP.hpp"
+#include "ModelBuilder.hpp"
 #include "RMDP.hpp"
 #include "State.hpp"
 #include "Transition.hpp"
+#include "batch.hpp"
 #include "definitions.hpp"
+#include "kernels.hpp"
 #include "modeltools.hpp"
 
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <numeric>
+#include <random>
 #include <sstream>
 
 using namespace std;
@@ -93,6 +101,165 @@ BOOST_AUTO_TEST_CASE(test_l1_worst_case) {
     BOOST_CHECK_CLOSE(w, 2.0, 1e-3);
 }
 
+/// Nature that does not deviate from the nominal distribution
+pair<numvec, prec_t> nominal_nature(numvec const& z, numvec const& q, prec_t) {
+    return make_pair(q, inner_product(z.begin(), z.end(), q.begin(), 0.0));
+}
+
+BOOST_AUTO_TEST_CASE(test_l1_worst_case_span) {
+    default_random_engine generator(19);
+    uniform_real_distribution<prec_t> value(-1.0, 1.0);
+    NatureWorkspace workspace;
+
+    for (size_t n : {1, 2, 5, 40}) {
+        numvec z(n), q(n, 1.0 / prec_t(n)), p(n);
+        for (auto& zi : z)
+            zi = value(generator);
+        for (prec_t t : {0.0, 0.3, 1.0, 2.0}) {
+            const auto expected = worstcase_l1(z, q, t);
+            const prec_t w = NatureSpan<worstcase_l1>::compute(z.data(), q.data(), n, t, p.data(), workspace);
+            BOOST_CHECK_CLOSE(w, expected.second, 1e-10);
+            CHECK_CLOSE_COLLECTION(p, expected.first, 1e-10);
+        }
+    }
+
+    // the workspace is reused once it is large enough
+    const size_t* indices = workspace.indices.data();
+    numvec z{3.0, 1.0, 2.0}, q{0.2, 0.3, 0.5}, p(3);
+    worstcase_l1(z.data(), q.data(), z.size(), 0.5, p.data(), workspace);
+    BOOST_CHECK_EQUAL(workspace.indices.data(), indices);
+
+    // other constraints are called through the generic version
+    const prec_t w = NatureSpan<nominal_nature>::compute(z.data(), q.data(), z.size(), 0.5, p.data(), workspace);
+    BOOST_CHECK_CLOSE(w, 0.6 + 0.3 + 1.0, 1e-10);
+    CHECK_CLOSE_COLLECTION(p, q, 1e-10);
+}
+
+/// Worst case with an L1 constraint computed by sorting all the values
+pair<numvec, prec_t> l1_sorted_reference(const numvec& z, const numvec& q, prec_t t) {
+    vector<size_t> smallest(z.size());
+    iota(smallest.begin(), smallest.end(), 0);
+    sort(smallest.begin(), smallest.end(), [&z](size_t i, size_t j) { return z[i] < z[j]; });
+    numvec p(q);
+    auto epsilon = min(t / 2, 1 - q[smallest[0]]);
+    p[smallest[0]] += epsilon;
+    for (size_t i = z.size() - 1; epsilon > 0; i--) {
+        auto diff = min(epsilon, p[smallest[i]]);
+        p[smallest[i]] -= diff;
+        epsilon -= diff;
+    }
+    return make_pair(p, inner_product(p.begin(), p.end(), z.begin(), 0.0));
+}
+
+/// Compares distributions with an absolute tolerance, since rounding leaves tiny masses
+void check_distribution_close(const numvec& p, const numvec& expected) {
+    BOOST_REQUIRE_EQUAL(p.size(), expected.size());
+    for (size_t i = 0; i < p.size(); i++)
+        BOOST_CHECK_SMALL(p[i] - expected[i], 1e-12);
+}
+
+BOOST_AUTO_TEST_CASE(test_l1_worst_case_paths) {
+    default_random_engine generator(23);
+    uniform_real_distribution<prec_t> value(-1.0, 1.0);
+    uniform_real_distribution<prec_t> weight(0.0, 1.0);
+    NatureWorkspace workspace;
+
+    // sizes for the small, sorting, and selection computations
+    for (size_t n : {1, 3, 8, 9, 30, 48, 200, 1000}) {
+        numvec z(n), q(n), p(n);
+        for (size_t i = 0; i < n; i++) {
+            z[i] = value(generator);
+            // some outcomes have no weight
+            q[i] = i % 3 == 1 ? 0.0 : weight(generator);
+        }
+        q[0] += 0.1;
+        const prec_t sum = accumulate(q.begin(), q.end(), 0.0);
+        for (auto& qi : q)
+            qi /= sum;
+
+        vector<size_t> order;
+        for (prec_t t : {0.0, 0.05, 0.3, 1.0, 2.0}) {
+            const auto expected = l1_sorted_reference(z, q, t);
+            prec_t w = worstcase_l1(z.data(), q.data(), n, t, p.data(), workspace);
+            BOOST_CHECK_CLOSE(w, expected.second, 1e-8);
+            check_distribution_close(p, expected.first);
+
+            w = worstcase_l1_warm(z.data(), q.data(), n, t, p.data(), order);
+            BOOST_CHECK_CLOSE(w, expected.second, 1e-8);
+            check_distribution_close(p, expected.first);
+            BOOST_CHECK_EQUAL(order.size(), n);
+        }
+
+        // the cached order is restored after small and large changes of the values
+        for (prec_t noise : {0.01, 2.0}) {
+            uniform_real_distribution<prec_t> change(-noise, noise);
+            for (auto& zi : z)
+                zi += change(generator);
+            const auto expected = l1_sorted_reference(z, q, 0.5);
+            const prec_t w = worstcase_l1_warm(z.data(), q.data(), n, 0.5, p.data(), order);
+            BOOST_CHECK_CLOSE(w, expected.second, 1e-8);
+            check_distribution_close(p, expected.first);
+            BOOST_CHECK(is_sorted(order.begin(), order.end(), [&z](size_t i, size_t j) { return z[i] < z[j]; }));
+        }
+
+        // reversing the order exceeds the budget of the insertion sort
+        for (auto& zi : z)
+            zi = -zi;
+        const auto expected = l1_sorted_reference(z, q, 0.5);
+        BOOST_CHECK_CLOSE(
+                worstcase_l1_warm(z.data(), q.data(), n, 0.5, p.data(), order), expected.second, 1e-8);
+        BOOST_CHECK(is_sorted(order.begin(), order.end(), [&z](size_t i, size_t j) { return z[i] < z[j]; }));
+    }
+
+    // ties among the values give up the mass in some order, with the same objective
+    numvec z(100, 1.0), q(100, 0.01), p(100);
+    z[7] = 0.0;
+    const prec_t w = worstcase_l1(z.data(), q.data(), z.size(), 0.5, p.data(), workspace);
+    BOOST_CHECK_CLOSE(w, 0.74, 1e-8);
+    BOOST_CHECK_CLOSE(p[7], 0.26, 1e-8);
+    BOOST_CHECK_CLOSE(accumulate(p.begin(), p.end(), 0.0), 1.0, 1e-8);
+    BOOST_CHECK_GE(*min_element(p.begin(), p.end()), 0.0);
+
+    // sorted and reversed values, which choose the pivots by the ninther
+    for (prec_t direction : {1.0, -1.0}) {
+        numvec zs(1000), qs(1000, 0.001), ps(1000);
+        for (size_t i = 0; i < zs.size(); i++)
+            zs[i] = direction * prec_t(i);
+        const auto expected = l1_sorted_reference(zs, qs, 1.5);
+        BOOST_CHECK_CLOSE(
+                worstcase_l1(zs.data(), qs.data(), zs.size(), 1.5, ps.data(), workspace), expected.second, 1e-8);
+        check_distribution_close(ps, expected.first);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(l1_order_cache_solution) {
+    const long n = 50;
+    RMDP_L1 rmdp(n);
+    default_random_engine generator(11);
+    uniform_int_distribution<long> target(0, n - 1);
+    uniform_real_distribution<prec_t> value(0.0, 1.0);
+    for (long s = 0; s < n; s++) {
+        for (long a = 0; a < 2; a++) {
+            for (long o = 0; o < 20; o++)
+                add_transition(rmdp, s, a, o, target(generator), value(generator), value(generator));
+        }
+    }
+    rmdp.normalize();
+    set_outcome_thresholds(rmdp, 0.5);
+
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic}) {
+        set_outcome_order_cache(rmdp, false);
+        auto sol = rmdp.vi_jac(uncert, 0.9, numvec(0), 10000, 1e-10);
+        set_outcome_order_cache(rmdp, true);
+        BOOST_CHECK(rmdp.get_state(0).get_action(0).get_order_cache());
+        auto csol = rmdp.vi_jac(uncert, 0.9, numvec(0), 10000, 1e-10);
+        auto gsol = rmdp.vi_gs(uncert, 0.9, numvec(0), 10000, 1e-10);
+        CHECK_CLOSE_COLLECTION(sol.valuefunction, csol.valuefunction, 1e-10);
+        CHECK_CLOSE_COLLECTION(sol.valuefunction, gsol.valuefunction, 1e-7);
+        BOOST_CHECK_EQUAL_COLLECTIONS(sol.policy.begin(), sol.policy.end(), csol.policy.begin(), csol.policy.end());
+    }
+}
+
 // ********************************************************************************
 // ***** Basic solution tests **********************************************************
 // ********************************************************************************
@@ -204,6 +371,8 @@ void test_simple_vi(typename Model::OutcomePolicy natpol_rob) {
     // occupancy frequencies
     auto&& occupancy_freq = rmdp.ofreq_mat(init_d, 0.9, re.policy, re.outcomes);
     CHECK_CLOSE_COLLECTION(occupancy_freq, occ_freq3, 1e-3);
+    auto&& occupancy_sparse = rmdp.ofreq_sparse(init_d, 0.9, re.policy, re.outcomes);
+    CHECK_CLOSE_COLLECTION(occupancy_sparse, occupancy_freq, 1e-6);
 
     auto&& rewards = rmdp.rewards_state(re3.policy, re3.outcomes);
     auto cmp_tr = inner_product(rewards.begin(), rewards.end(), occupancy_freq.begin(), 0.0);
@@ -222,6 +391,156 @@ BOOST_AUTO_TEST_CASE(simple_rmdpl1_vi_of_nonrobust) {
     test_simple_vi<RMDP_L1>(vector<numvec>{numvec{1}, numvec{1}, numvec{1}});
 }
 
+template <class Model>
+void test_vi_gs_par(const Model& rmdp) {
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic, Uncertainty::Average}) {
+        auto sol = rmdp.vi_gs(uncert, 0.9, numvec(0), 10000, 1e-10);
+        for (auto partition : {BlockPartition::Coloring, BlockPartition::Ranges}) {
+            for (size_t block_size : {0, 1, 3}) {
+                auto psol = rmdp.vi_gs_par(uncert, 0.9, numvec(0), 10000, 1e-10, partition, block_size);
+                CHECK_CLOSE_COLLECTION(sol.valuefunction, psol.valuefunction, 1e-6);
+                BOOST_CHECK_EQUAL_COLLECTIONS(
+                        sol.policy.begin(), sol.policy.end(), psol.policy.begin(), psol.policy.end());
+                BOOST_CHECK_LE(psol.residual, 1e-10);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(simple_vi_gs_par) {
+    test_vi_gs_par(create_test_mdp<MDP>());
+    test_vi_gs_par(create_test_mdp<RMDP_D>());
+    test_vi_gs_par(create_test_mdp<RMDP_L1>());
+}
+
+BOOST_AUTO_TEST_CASE(chain_vi_gs_par) {
+    // states move towards the terminal state 0, which is the order of the Gauss-Seidel sweep
+    const long n = 1000;
+    MDP mdp(n);
+    for (long s = 1; s < n; s++) {
+        add_transition(mdp, s, 0, s - 1, 1.0, 1.0);
+    }
+
+    auto sol = mdp.vi_gs(Uncertainty::Average, 0.95, numvec(0), 100000, 1e-8);
+    auto jsol = mdp.vi_jac(Uncertainty::Average, 0.95, numvec(0), 100000, 1e-8);
+    auto rsol = mdp.vi_gs_par(Uncertainty::Average, 0.95, numvec(0), 100000, 1e-8, BlockPartition::Ranges, 100);
+    auto csol = mdp.vi_gs_par(Uncertainty::Average, 0.95, numvec(0), 100000, 1e-8, BlockPartition::Coloring);
+
+    CHECK_CLOSE_COLLECTION(sol.valuefunction, rsol.valuefunction, 1e-5);
+    CHECK_CLOSE_COLLECTION(sol.valuefunction, csol.valuefunction, 1e-5);
+    // contiguous blocks keep most of the benefit of the Gauss-Seidel ordering
+    BOOST_CHECK_LT(rsol.iterations, jsol.iterations / 10);
+    BOOST_CHECK_LE(csol.iterations, jsol.iterations);
+}
+
+template <class Model>
+void test_vi_prioritized(const Model& rmdp) {
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic, Uncertainty::Average}) {
+        auto sol = rmdp.vi_gs(uncert, 0.9, numvec(0), 10000, 1e-10);
+        auto psol = rmdp.vi_prioritized(uncert, 0.9, numvec(0), 100000, 1e-10);
+        CHECK_CLOSE_COLLECTION(sol.valuefunction, psol.valuefunction, 1e-6);
+        BOOST_CHECK_EQUAL_COLLECTIONS(sol.policy.begin(), sol.policy.end(), psol.policy.begin(), psol.policy.end());
+        BOOST_CHECK_LE(psol.residual, 1e-10);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(simple_vi_prioritized) {
+    test_vi_prioritized(create_test_mdp<MDP>());
+    test_vi_prioritized(create_test_mdp<RMDP_D>());
+    test_vi_prioritized(create_test_mdp<RMDP_L1>());
+}
+
+BOOST_AUTO_TEST_CASE(sparse_reward_vi_prioritized) {
+    // a short chain leads to the only rewarding state, the remaining states stay in place
+    const long n = 2000, chain = 50;
+    MDP mdp(n);
+    add_transition(mdp, 0, 0, 0, 1.0, 1.0);
+    for (long s = 1; s < chain; s++)
+        add_transition(mdp, s, 0, s - 1, 1.0, 0.0);
+    for (long s = chain; s < n; s++)
+        add_transition(mdp, s, 0, s, 1.0, 0.0);
+
+    auto pred = mdp.predecessors();
+    BOOST_CHECK_EQUAL(pred.state_count(), n);
+    BOOST_CHECK_EQUAL(pred.indices.size(), n);
+    BOOST_CHECK_EQUAL(*pred.begin(0), 0);
+    BOOST_CHECK_EQUAL(*(pred.begin(0) + 1), 1);
+
+    auto sol = mdp.vi_jac(Uncertainty::Average, 0.9, numvec(0), 10000, 1e-10);
+    auto psol = mdp.vi_prioritized(Uncertainty::Average, 0.9, numvec(0), 1000000, 1e-8);
+    numvec expected(n, 0.0);
+    for (long s = 0; s < chain; s++)
+        expected[s] = 10.0 * pow(0.9, s);
+    for (long s = 0; s < n; s++)
+        BOOST_CHECK_SMALL(psol.valuefunction[s] - expected[s], 1e-6);
+    BOOST_CHECK_LE(psol.residual, 1e-8);
+    // only the states in the chain are backed up repeatedly
+    BOOST_CHECK_LT(psol.iterations, sol.iterations * n / 100);
+}
+
+BOOST_AUTO_TEST_CASE(strong_components_order) {
+    // 0 -> 1 <-> 2 -> 3, 4 -> 4
+    StateAdjacency graph;
+    graph.offsets = {0, 1, 2, 4, 4, 5};
+    graph.indices = {1, 2, 1, 3, 4};
+    auto component = strong_components(graph);
+
+    BOOST_CHECK_EQUAL(component[1], component[2]);
+    BOOST_CHECK_NE(component[0], component[1]);
+    BOOST_CHECK_NE(component[3], component[1]);
+    // successors have smaller numbers
+    BOOST_CHECK_GT(component[0], component[1]);
+    BOOST_CHECK_GT(component[1], component[3]);
+    BOOST_CHECK_EQUAL(*max_element(component.begin(), component.end()), 3);
+}
+
+template <class Model>
+void test_vi_scc(const Model& rmdp) {
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic, Uncertainty::Average}) {
+        auto sol = rmdp.vi_gs(uncert, 0.9, numvec(0), 10000, 1e-10);
+        auto ssol = rmdp.vi_scc(uncert, 0.9, numvec(0), 10000, 1e-10);
+        CHECK_CLOSE_COLLECTION(sol.valuefunction, ssol.valuefunction, 1e-6);
+        BOOST_CHECK_EQUAL_COLLECTIONS(sol.policy.begin(), sol.policy.end(), ssol.policy.begin(), ssol.policy.end());
+        BOOST_CHECK_LE(ssol.residual, 1e-10);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(simple_vi_scc) {
+    test_vi_scc(create_test_mdp<MDP>());
+    test_vi_scc(create_test_mdp<RMDP_D>());
+    test_vi_scc(create_test_mdp<RMDP_L1>());
+}
+
+BOOST_AUTO_TEST_CASE(staged_vi_scc) {
+    // stages of two states with a loop each, the last stage is absorbing
+    const long stages = 200;
+    MDP mdp(2 * stages);
+    for (long k = 0; k < stages - 1; k++) {
+        const long s = 2 * k;
+        add_transition(mdp, s, 0, s + 1, 0.5, 1.0);
+        add_transition(mdp, s, 0, s + 2, 0.5, 1.0);
+        add_transition(mdp, s + 1, 0, s, 0.5, 2.0);
+        add_transition(mdp, s + 1, 0, s + 3, 0.5, 0.0);
+        add_transition(mdp, s + 1, 1, s + 2, 1.0, 1.5);
+    }
+    add_transition(mdp, 2 * stages - 2, 0, 2 * stages - 2, 1.0, 1.0);
+    add_transition(mdp, 2 * stages - 1, 0, 2 * stages - 2, 1.0, 0.0);
+
+    auto sol = mdp.vi_gs(Uncertainty::Average, 0.95, numvec(0), 100000, 1e-10);
+    auto ssol = mdp.vi_scc(Uncertainty::Average, 0.95, numvec(0), 100000, 1e-10);
+    CHECK_CLOSE_COLLECTION(sol.valuefunction, ssol.valuefunction, 1e-6);
+    BOOST_CHECK_EQUAL_COLLECTIONS(sol.policy.begin(), sol.policy.end(), ssol.policy.begin(), ssol.policy.end());
+
+    // an acyclic chain is solved with a single backup per state
+    MDP chain(100);
+    for (long s = 1; s < 100; s++)
+        add_transition(chain, s, 0, s - 1, 1.0, 1.0);
+    auto csol = chain.vi_scc(Uncertainty::Average, 0.9);
+    BOOST_CHECK_EQUAL(csol.iterations, 1);
+    BOOST_CHECK_EQUAL(csol.residual, 0.0);
+    BOOST_CHECK_CLOSE(csol.valuefunction[99], (1 - pow(0.9, 99)) / (1 - 0.9), 1e-8);
+}
+
 // ********************************************************************************
 // ***** MDP modified policy iteration ********************************************
 // ********************************************************************************
@@ -291,6 +610,917 @@ BOOST_AUTO_TEST_CASE(simple_mdp_mpi_like_vi_rmdpl1) {
     test_simple_mdp_mpi_like_vi<RMDP_L1>();
 }
 
+// ********************************************************************************
+// ***** Krylov policy evaluation *************************************************
+// ********************************************************************************
+
+BOOST_AUTO_TEST_CASE(bicgstab_small_system) {
+    // nonsymmetric system with a known solution
+    SparseMatrix A;
+    A.add_row(indvec{0, 1}, numvec{4.0, -1.0});
+    A.add_row(indvec{0, 1, 2}, numvec{-2.0, 5.0, 1.0});
+    A.add_row(indvec{1, 2}, numvec{-1.0, 3.0});
+    const numvec x{1.0, -2.0, 0.5};
+    numvec b;
+    A.multiply(x, b);
+
+    for (auto preconditioner : {Preconditioner::None, Preconditioner::Jacobi, Preconditioner::ILU0}) {
+        auto sol = bicgstab(A, b, numvec(0), preconditioner, 100, 1e-12);
+        CHECK_CLOSE_COLLECTION(sol.solution, x, 1e-8);
+        BOOST_CHECK_LE(sol.residual, 1e-12);
+    }
+
+    // ILU0 is exact for a tridiagonal matrix
+    auto sol = bicgstab(A, b, numvec(0), Preconditioner::ILU0, 100, 1e-12);
+    BOOST_CHECK_LE(sol.iterations, 1);
+
+    SparseMatrix singular;
+    singular.add_row(indvec{1}, numvec{1.0});
+    singular.add_row(indvec{0}, numvec{1.0});
+    BOOST_CHECK_THROW(bicgstab(singular, numvec{1.0, 1.0}, numvec(0), Preconditioner::ILU0), invalid_argument);
+}
+
+template <class Model>
+void test_krylov_evaluation() {
+    auto rmdp = create_test_mdp<Model>();
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic, Uncertainty::Average}) {
+        auto sol = rmdp.mpi_jac(uncert, 0.9, numvec(0), 1000, 1e-10, 10000, 1e-12);
+        for (auto evaluation : {PolicyEvaluation::KrylovJacobi, PolicyEvaluation::KrylovILU0}) {
+            auto ksol = rmdp.mpi_jac(uncert, 0.9, numvec(0), 1000, 1e-10, 1000, 1e-12, false, evaluation);
+            CHECK_CLOSE_COLLECTION(sol.valuefunction, ksol.valuefunction, 1e-6);
+            BOOST_CHECK_EQUAL_COLLECTIONS(
+                    sol.policy.begin(), sol.policy.end(), ksol.policy.begin(), ksol.policy.end());
+        }
+
+        // the fixed evaluation needs the nature's policy
+        if (uncert == Uncertainty::Average)
+            continue;
+        auto jac = rmdp.vi_jac_fix(0.9, sol.policy, sol.outcomes, numvec(0), 100000, 1e-12);
+        for (auto preconditioner : {Preconditioner::None, Preconditioner::Jacobi, Preconditioner::ILU0}) {
+            auto kry = rmdp.krylov_fix(0.9, sol.policy, sol.outcomes, numvec(0), 1000, 1e-12, preconditioner);
+            CHECK_CLOSE_COLLECTION(jac.valuefunction, kry.valuefunction, 1e-6);
+            BOOST_CHECK_LE(kry.residual, 1e-12);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(krylov_evaluation_mdp) {
+    test_krylov_evaluation<MDP>();
+}
+
+BOOST_AUTO_TEST_CASE(krylov_evaluation_rmdpd) {
+    test_krylov_evaluation<RMDP_D>();
+}
+
+BOOST_AUTO_TEST_CASE(krylov_evaluation_rmdpl1) {
+    test_krylov_evaluation<RMDP_L1>();
+}
+
+BOOST_AUTO_TEST_CASE(krylov_evaluation_high_discount) {
+    // random sparse MDP with a discount close to 1
+    const long n = 300;
+    MDP mdp(n);
+    default_random_engine generator(7);
+    uniform_int_distribution<long> target(0, n - 1);
+    uniform_real_distribution<prec_t> value(0.0, 1.0);
+    for (long s = 0; s < n; s++) {
+        for (long a = 0; a < 2; a++) {
+            for (int k = 0; k < 3; k++)
+                add_transition(mdp, s, a, target(generator), value(generator), value(generator));
+        }
+    }
+    mdp.normalize();
+
+    const indvec policy(n, 0), nature(n, 0);
+    auto jac = mdp.vi_jac_fix(0.999, policy, nature, numvec(0), 1000000, 1e-9);
+    auto kry = mdp.krylov_fix(0.999, policy, nature, numvec(0), 1000, 1e-9);
+    CHECK_CLOSE_COLLECTION(jac.valuefunction, kry.valuefunction, 1e-3);
+    BOOST_CHECK_LT(kry.iterations * 100, jac.iterations);
+
+    auto sol = mdp.mpi_jac(Uncertainty::Average, 0.999, numvec(0), 1000, 1e-6, 1000000, 1e-8);
+    auto ksol = mdp.mpi_jac(
+            Uncertainty::Average, 0.999, numvec(0), 1000, 1e-6, 1000, 1e-8, false, PolicyEvaluation::KrylovILU0);
+    CHECK_CLOSE_COLLECTION(sol.valuefunction, ksol.valuefunction, 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(ofreq_sparse_random) {
+    // random sparse MDP with terminal states
+    const long n = 200;
+    MDP mdp(n);
+    default_random_engine generator(11);
+    uniform_int_distribution<long> target(0, n - 1);
+    uniform_real_distribution<prec_t> value(0.0, 1.0);
+    for (long s = 0; s < n - 10; s++) {
+        for (int k = 0; k < 4; k++)
+            add_transition(mdp, s, 0, target(generator), value(generator), value(generator));
+    }
+    mdp.normalize();
+
+    const indvec policy(n, 0), nature(n, 0);
+    Transition init;
+    for (long s = 0; s < n; s += 7)
+        init.add_sample(s, 1.0, 0.0);
+    init.normalize();
+
+    auto dense = mdp.ofreq_mat(init, 0.95, policy, nature);
+    auto sparse = mdp.ofreq_sparse(init, 0.95, policy, nature);
+    CHECK_CLOSE_COLLECTION(dense, sparse, 1e-6);
+
+    // the return computed from the frequencies matches the value function
+    auto rewards = mdp.rewards_state(policy, nature);
+    auto sol = mdp.krylov_fix(0.95, policy, nature, numvec(0), 1000, 1e-12);
+    BOOST_CHECK_CLOSE(inner_product(rewards.begin(), rewards.end(), sparse.begin(), 0.0), sol.total_return(init), 1e-6);
+}
+
+// ********************************************************************************
+// ***** Anderson acceleration ****************************************************
+// ********************************************************************************
+
+template <class Model>
+void test_vi_anderson() {
+    auto rmdp = create_test_mdp<Model>();
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic, Uncertainty::Average}) {
+        auto sol = rmdp.vi_jac(uncert, 0.9, numvec(0), 10000, 1e-10);
+        for (unsigned int memory : {0, 1, 5}) {
+            auto asol = rmdp.vi_anderson(uncert, 0.9, numvec(0), 10000, 1e-10, memory);
+            CHECK_CLOSE_COLLECTION(sol.valuefunction, asol.valuefunction, 1e-6);
+            BOOST_CHECK_EQUAL_COLLECTIONS(
+                    sol.policy.begin(), sol.policy.end(), asol.policy.begin(), asol.policy.end());
+            BOOST_CHECK_LE(asol.residual, 1e-10);
+        }
+        // without memory, the method is plain value iteration
+        auto psol = rmdp.vi_anderson(uncert, 0.9, numvec(0), 10000, 1e-10, 0);
+        BOOST_CHECK_EQUAL(psol.iterations, sol.iterations);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(simple_vi_anderson_mdp) {
+    test_vi_anderson<MDP>();
+}
+
+BOOST_AUTO_TEST_CASE(simple_vi_anderson_rmdpd) {
+    test_vi_anderson<RMDP_D>();
+}
+
+BOOST_AUTO_TEST_CASE(simple_vi_anderson_rmdpl1) {
+    test_vi_anderson<RMDP_L1>();
+}
+
+BOOST_AUTO_TEST_CASE(high_discount_vi_anderson) {
+    // random sparse model with a discount close to 1
+    const long n = 300;
+    RMDP_L1 rmdp(n);
+    default_random_engine generator(5);
+    uniform_int_distribution<long> target(0, n - 1);
+    uniform_real_distribution<prec_t> value(0.0, 1.0);
+    for (long s = 0; s < n; s++) {
+        for (long a = 0; a < 2; a++) {
+            for (long o = 0; o < 2; o++) {
+                for (int k = 0; k < 3; k++)
+                    add_transition(rmdp, s, a, o, target(generator), value(generator), value(generator));
+            }
+        }
+    }
+    rmdp.normalize();
+    set_outcome_thresholds(rmdp, 0.5);
+
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Average}) {
+        auto sol = rmdp.vi_jac(uncert, 0.999, numvec(0), 100000, 1e-6);
+        auto asol = rmdp.vi_anderson(uncert, 0.999, numvec(0), 100000, 1e-6, 5);
+        CHECK_CLOSE_COLLECTION(sol.valuefunction, asol.valuefunction, 1e-3);
+        BOOST_CHECK_LE(asol.residual, 1e-6);
+        BOOST_CHECK_LT(asol.iterations * 3, sol.iterations);
+    }
+}
+
+// ********************************************************************************
+// ***** Value-only sweeps ********************************************************
+// ********************************************************************************
+
+BOOST_AUTO_TEST_CASE(value_only_sweeps) {
+    const long n = 40;
+    RMDP_L1 rmdp(n);
+    default_random_engine generator(17);
+    uniform_int_distribution<long> target(0, n - 1);
+    uniform_real_distribution<prec_t> value(0.0, 1.0);
+    for (long s = 0; s < n - 1; s++) {
+        for (long a = 0; a < 3; a++) {
+            for (long o = 0; o < 4; o++)
+                add_transition(rmdp, s, a, o, target(generator), value(generator), value(generator));
+        }
+    }
+    rmdp.normalize();
+    set_outcome_thresholds(rmdp, 0.4);
+
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic}) {
+        // the values without the responses match the full computation
+        for (long s = 0; s < n; s++) {
+            const auto& state = rmdp.get_state(s);
+            const auto full = uncert == Uncertainty::Robust ? state.max_min(numvec(n, 1.0), 0.9)
+                                                            : state.max_max(numvec(n, 1.0), 0.9);
+            const auto values = uncert == Uncertainty::Robust ? state.max_min_value(numvec(n, 1.0), 0.9)
+                                                              : state.max_max_value(numvec(n, 1.0), 0.9);
+            BOOST_CHECK_EQUAL(get<0>(full), values.first);
+            BOOST_CHECK_CLOSE(get<2>(full), values.second, 1e-10);
+        }
+
+        // the outcomes of the solution are the responses to the final values
+        for (auto sol : {rmdp.vi_jac(uncert, 0.9, numvec(0), 10000, 1e-10),
+                     rmdp.vi_gs(uncert, 0.9, numvec(0), 10000, 1e-10),
+                     rmdp.vi_scc(uncert, 0.9, numvec(0), 10000, 1e-10),
+                     rmdp.vi_prioritized(uncert, 0.9, numvec(0), 1000000, 1e-10),
+                     rmdp.vi_jac_sweep(uncert, numvec{0.9}, numvec(0), 10000, 1e-10)[0]}) {
+            BOOST_CHECK(sol.outcomes[n - 1].empty());
+            for (long s = 0; s < n - 1; s++) {
+                const auto& action = rmdp.get_state(s).get_action(sol.policy[s]);
+                const auto response = uncert == Uncertainty::Robust ? action.minimal(sol.valuefunction, 0.9)
+                                                                    : action.maximal(sol.valuefunction, 0.9);
+                CHECK_CLOSE_COLLECTION(sol.outcomes[s], response.first, 1e-10);
+                BOOST_CHECK_CLOSE(rmdp.get_state(s).fixed_fixed(sol.valuefunction, 0.9, sol.policy[s], sol.outcomes[s]),
+                        sol.valuefunction[s],
+                        1e-6);
+            }
+        }
+    }
+
+    // no sweeps and no responses
+    auto sol = rmdp.vi_jac(Uncertainty::Robust, 0.9, numvec(0), 0);
+    BOOST_CHECK(sol.outcomes[0].empty());
+
+    // the incremental solve recomputes the responses in the modified states and keeps
+    // the others, including their sizes
+    auto previous = rmdp.vi_jac(Uncertainty::Robust, 0.9, numvec(0), 10000, 1e-10);
+    rmdp.clear_dirty();
+    add_transition(rmdp, 0, 0, 4, 1, 1.0, 2.0);
+    add_transition(rmdp, 0, 1, 4, 1, 1.0, 2.0);
+    add_transition(rmdp, 0, 2, 4, 1, 1.0, 2.0);
+    auto isol = rmdp.vi_incremental(Uncertainty::Robust, 0.9, previous, 1000000, 1e-10);
+    BOOST_CHECK_EQUAL(isol.outcomes.size(), n);
+    BOOST_CHECK_EQUAL(isol.outcomes[0].size(), 5);
+    BOOST_CHECK(isol.outcomes[n - 1].empty());
+    const auto response = rmdp.get_state(0).get_action(isol.policy[0]).minimal(isol.valuefunction, 0.9);
+    CHECK_CLOSE_COLLECTION(isol.outcomes[0], response.first, 1e-10);
+    for (long s = 1; s < n - 1; s++)
+        BOOST_CHECK_EQUAL(isol.outcomes[s].size(), 4);
+}
+
+// ********************************************************************************
+// ***** Distribution array *******************************************************
+// ********************************************************************************
+
+BOOST_AUTO_TEST_CASE(distribution_array) {
+    const vector<numvec> distributions{numvec{0.5, 0.5}, numvec{}, numvec{0.2, 0.3, 0.5}};
+    DistributionArray array(distributions);
+
+    BOOST_CHECK_EQUAL(array.size(), 3);
+    BOOST_CHECK(array[1].empty());
+    BOOST_CHECK_EQUAL(array[2].size(), 3);
+    BOOST_CHECK_CLOSE(array[2][1], 0.3, 1e-10);
+    CHECK_CLOSE_COLLECTION(array[0], distributions[0], 1e-10);
+
+    const vector<size_t> offsets{0, 2, 2, 5};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            array.get_offsets().begin(), array.get_offsets().end(), offsets.begin(), offsets.end());
+    BOOST_CHECK_EQUAL(array.get_values().size(), 5);
+
+    const vector<numvec> copied = array.to_vectors();
+    BOOST_REQUIRE_EQUAL(copied.size(), distributions.size());
+    for (size_t i = 0; i < copied.size(); i++)
+        CHECK_CLOSE_COLLECTION(copied[i], distributions[i], 1e-10);
+
+    DistributionArray same(offsets, array.get_values());
+    CHECK_CLOSE_COLLECTION(same[2], distributions[2], 1e-10);
+    BOOST_CHECK_EQUAL(DistributionArray(4).size(), 4);
+    BOOST_CHECK(DistributionArray().empty());
+
+    BOOST_CHECK_THROW(DistributionArray(vector<size_t>{1, 2}, numvec(2)), invalid_argument);
+    BOOST_CHECK_THROW(DistributionArray(vector<size_t>{0, 2, 1}, numvec(1)), invalid_argument);
+    BOOST_CHECK_THROW(DistributionArray(vector<size_t>{0, 2}, numvec(3)), invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(distribution_array_solution) {
+    auto rmdp = create_test_mdp<RMDP_L1>();
+    set_outcome_thresholds(rmdp, 0.5);
+
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic}) {
+        // the responses of all states are stored in a single array
+        auto sol = rmdp.vi_jac(uncert, 0.9, numvec(0), 10000, 1e-10);
+        BOOST_REQUIRE_EQUAL(sol.outcomes.size(), rmdp.state_count());
+        BOOST_CHECK_EQUAL(sol.outcomes.get_offsets().back(), sol.outcomes.get_values().size());
+
+        // the flat outcomes are accepted by the methods with fixed policies
+        BOOST_CHECK_EQUAL(rmdp.is_policy_correct(sol.policy, sol.outcomes), -1);
+        auto fixed = rmdp.vi_jac_fix(0.9, sol.policy, sol.outcomes, numvec(0), 10000, 1e-12);
+        CHECK_CLOSE_COLLECTION(fixed.valuefunction, sol.valuefunction, 1e-6);
+        auto transitions = rmdp.transition_mat(sol.policy, sol.outcomes);
+        BOOST_CHECK_EQUAL(transitions->size1(), rmdp.state_count());
+
+        // solutions that assign the outcomes state by state are converted
+        auto mpi = rmdp.mpi_jac(uncert, 0.9, numvec(0), 1000, 1e-10, 1000, 1e-10);
+        BOOST_REQUIRE_EQUAL(mpi.outcomes.size(), rmdp.state_count());
+        for (size_t s = 0; s < rmdp.state_count(); s++)
+            CHECK_CLOSE_COLLECTION(mpi.outcomes[s], sol.outcomes[s], 1e-6);
+    }
+}
+
+// ********************************************************************************
+// ***** S-rectangular ************************************************************
+// ********************************************************************************
+
+BOOST_AUTO_TEST_CASE(srect_l1_worst_case) {
+    default_random_engine generator(29);
+    uniform_real_distribution<prec_t> value(-1.0, 1.0);
+    uniform_real_distribution<prec_t> weight(0.0, 1.0);
+
+    for (size_t actions : {1, 2, 3, 6}) {
+        for (size_t n : {1, 2, 5, 12}) {
+            vector<numvec> z(actions, numvec(n)), q(actions, numvec(n));
+            for (size_t a = 0; a < actions; a++) {
+                for (size_t i = 0; i < n; i++) {
+                    z[a][i] = value(generator);
+                    q[a][i] = weight(generator) + 0.01;
+                }
+                const prec_t sum = accumulate(q[a].begin(), q[a].end(), 0.0);
+                for (auto& qi : q[a])
+                    qi /= sum;
+            }
+
+            for (prec_t t : {0.0, 0.1, 0.5, 1.5, 10.0}) {
+                const auto worstcase = worstcase_srect_l1(z, q, t);
+                const numvec& decision = get<0>(worstcase);
+                const numvec& thresholds = get<1>(worstcase);
+                const prec_t u = get<2>(worstcase);
+
+                BOOST_CHECK_CLOSE(accumulate(decision.begin(), decision.end(), 0.0), 1.0, 1e-8);
+                BOOST_CHECK_LE(accumulate(thresholds.begin(), thresholds.end(), 0.0), t + 1e-8);
+                if (actions == 1)
+                    BOOST_CHECK_CLOSE(u, worstcase_l1(z[0], q[0], min(t, 2.0)).second, 1e-8);
+                if (t == 0) {
+                    prec_t nominal = -numeric_limits<prec_t>::infinity();
+                    for (size_t a = 0; a < actions; a++)
+                        nominal = max(nominal, inner_product(z[a].begin(), z[a].end(), q[a].begin(), 0.0));
+                    BOOST_CHECK_CLOSE(u, nominal, 1e-8);
+                }
+
+                // nature reduces all actions to at most u, and the randomized ones exactly to u
+                for (size_t a = 0; a < actions; a++) {
+                    const prec_t actionvalue = worstcase_l1(z[a], q[a], thresholds[a]).second;
+                    BOOST_CHECK_LE(actionvalue, u + 1e-8);
+                    if (decision[a] > 0)
+                        BOOST_CHECK_SMALL(actionvalue - u, 1e-8);
+                }
+
+                // nature's response to the optimal decision attains the value
+                const auto response = response_srect_l1(z, q, t, decision);
+                BOOST_CHECK_SMALL(response.second - u, 1e-8);
+
+                // other decisions are not better, and the response is optimal for nature
+                for (int k = 0; k < 5; k++) {
+                    numvec other(actions), allocation(actions);
+                    for (size_t a = 0; a < actions; a++) {
+                        other[a] = weight(generator);
+                        allocation[a] = weight(generator);
+                    }
+                    const prec_t othersum = accumulate(other.begin(), other.end(), 0.0);
+                    const prec_t allocationsum = accumulate(allocation.begin(), allocation.end(), 0.0);
+                    for (size_t a = 0; a < actions; a++) {
+                        other[a] /= othersum;
+                        // thresholds above 2 do not reduce the values further
+                        allocation[a] = min(2.0, allocation[a] * t / allocationsum);
+                    }
+
+                    const auto otherresponse = response_srect_l1(z, q, t, other);
+                    BOOST_CHECK_LE(otherresponse.second, u + 1e-8);
+                    prec_t responsevalue = 0, allocationvalue = 0;
+                    for (size_t a = 0; a < actions; a++) {
+                        responsevalue += other[a] * worstcase_l1(z[a], q[a], otherresponse.first[a]).second;
+                        allocationvalue += other[a] * worstcase_l1(z[a], q[a], allocation[a]).second;
+                    }
+                    BOOST_CHECK_SMALL(responsevalue - otherresponse.second, 1e-8);
+                    BOOST_CHECK_GE(allocationvalue, otherresponse.second - 1e-8);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(srect_l1_solution) {
+    const long n = 30, actions = 3;
+    const prec_t threshold = 0.6;
+    RMDP_SL1 srmdp(n);
+    RMDP_L1 rmdp(n), lrmdp(n);
+    default_random_engine generator(31);
+    uniform_int_distribution<long> target(0, n - 1);
+    uniform_real_distribution<prec_t> value(0.0, 1.0);
+    // the last state is terminal
+    for (long s = 0; s < n - 1; s++) {
+        for (long a = 0; a < actions; a++) {
+            for (long o = 0; o < 4; o++) {
+                const long t = target(generator);
+                const prec_t probability = value(generator), reward = value(generator);
+                add_transition(srmdp, s, a, o, t, probability, reward);
+                add_transition(rmdp, s, a, o, t, probability, reward);
+                add_transition(lrmdp, s, a, o, t, probability, reward);
+            }
+        }
+    }
+    srmdp.normalize();
+    rmdp.normalize();
+    lrmdp.normalize();
+    set_state_thresholds(srmdp, threshold);
+    set_outcome_thresholds(rmdp, threshold);
+    set_outcome_thresholds(lrmdp, threshold / actions);
+
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic, Uncertainty::Average}) {
+        auto sol = srmdp.vi_jac(uncert, 0.9, numvec(0), 10000, 1e-12);
+        auto gsol = srmdp.vi_gs(uncert, 0.9, numvec(0), 10000, 1e-12);
+        auto msol = srmdp.mpi_jac(uncert, 0.9, numvec(0), 1000, 1e-12, 1000, 1e-12);
+        auto ksol = srmdp.mpi_jac(
+                uncert, 0.9, numvec(0), 1000, 1e-12, 1000, 1e-12, false, PolicyEvaluation::KrylovILU0);
+        CHECK_CLOSE_COLLECTION(gsol.valuefunction, sol.valuefunction, 1e-6);
+        CHECK_CLOSE_COLLECTION(msol.valuefunction, sol.valuefunction, 1e-6);
+        CHECK_CLOSE_COLLECTION(ksol.valuefunction, sol.valuefunction, 1e-6);
+
+        auto sasol = rmdp.vi_jac(uncert, 0.9, numvec(0), 10000, 1e-12);
+        if (uncert == Uncertainty::Robust) {
+            // sharing the threshold weakens nature, but not below splitting it evenly
+            auto lsol = lrmdp.vi_jac(uncert, 0.9, numvec(0), 10000, 1e-12);
+            for (long s = 0; s < n; s++) {
+                BOOST_CHECK_GE(sol.valuefunction[s], sasol.valuefunction[s] - 1e-8);
+                BOOST_CHECK_LE(sol.valuefunction[s], lsol.valuefunction[s] + 1e-8);
+            }
+        } else {
+            // the best case spends the whole threshold on a single action
+            CHECK_CLOSE_COLLECTION(sol.valuefunction, sasol.valuefunction, 1e-6);
+        }
+
+        BOOST_CHECK(sol.policy[n - 1].empty());
+        for (long s = 0; s < n - 1; s++) {
+            BOOST_REQUIRE_EQUAL(sol.policy[s].size(), actions);
+            BOOST_CHECK_CLOSE(accumulate(sol.policy[s].begin(), sol.policy[s].end(), 0.0), 1.0, 1e-8);
+        }
+        if (uncert == Uncertainty::Average)
+            continue;
+
+        // the policies and the outcomes reproduce the values
+        BOOST_CHECK_EQUAL(srmdp.is_policy_correct(sol.policy, sol.outcomes), -1);
+        auto fixed = srmdp.vi_jac_fix(0.9, sol.policy, sol.outcomes, numvec(0), 10000, 1e-12);
+        CHECK_CLOSE_COLLECTION(fixed.valuefunction, sol.valuefunction, 1e-6);
+        auto krylov = srmdp.krylov_fix(0.9, sol.policy, sol.outcomes, numvec(0), 1000, 1e-12);
+        CHECK_CLOSE_COLLECTION(krylov.valuefunction, sol.valuefunction, 1e-6);
+
+        // the backups with the outcomes match the values alone
+        for (long s = 0; s < n; s++) {
+            const auto& state = srmdp.get_state(s);
+            const auto full = uncert == Uncertainty::Robust ? state.max_min(sol.valuefunction, 0.9)
+                                                            : state.max_max(sol.valuefunction, 0.9);
+            const auto values = uncert == Uncertainty::Robust ? state.max_min_value(sol.valuefunction, 0.9)
+                                                              : state.max_max_value(sol.valuefunction, 0.9);
+            CHECK_CLOSE_COLLECTION(get<0>(full), values.first, 1e-10);
+            BOOST_CHECK_CLOSE(get<2>(full), values.second, 1e-10);
+            BOOST_CHECK_SMALL(state.fixed_fixed(sol.valuefunction, 0.9, get<0>(full), get<1>(full)) - get<2>(full),
+                    1e-8);
+        }
+    }
+
+    BOOST_CHECK_THROW(srmdp.compile(), invalid_argument);
+    BOOST_CHECK_THROW(srmdp.vi_jac_sweep(Uncertainty::Robust, numvec{0.9}), invalid_argument);
+    BOOST_CHECK_THROW(srmdp.get_state(0).fixed_average(numvec(n, 0.0), 0.9, numvec(1, 1.0)), invalid_argument);
+}
+
+// ********************************************************************************
+// ***** Action elimination *******************************************************
+// ********************************************************************************
+
+template <class Model>
+void test_action_elimination() {
+    auto rmdp = create_test_mdp<Model>();
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic, Uncertainty::Average}) {
+        auto sol = rmdp.vi_jac(uncert, 0.9, numvec(0), 10000, 1e-10);
+
+        ActionMask jacmask, gsmask, mpimask;
+        auto jsol = rmdp.vi_jac(uncert, 0.9, numvec(0), 10000, 1e-10, &jacmask);
+        auto gsol = rmdp.vi_gs(uncert, 0.9, numvec(0), 10000, 1e-10, &gsmask);
+        auto msol = rmdp.mpi_jac(uncert, 0.9, numvec(0), 1000, 1e-10, 1000, 1e-11, false,
+                PolicyEvaluation::ValueIteration, &mpimask);
+        for (const auto& esol : {jsol, gsol, msol}) {
+            CHECK_CLOSE_COLLECTION(sol.valuefunction, esol.valuefunction, 1e-8);
+            BOOST_CHECK_EQUAL_COLLECTIONS(
+                    sol.policy.begin(), sol.policy.end(), esol.policy.begin(), esol.policy.end());
+        }
+        BOOST_CHECK_EQUAL(jacmask.state_count(), rmdp.state_count());
+        BOOST_CHECK_EQUAL(gsmask.state_count(), rmdp.state_count());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(simple_action_elimination_mdp) {
+    test_action_elimination<MDP>();
+}
+
+BOOST_AUTO_TEST_CASE(simple_action_elimination_rmdpd) {
+    test_action_elimination<RMDP_D>();
+}
+
+BOOST_AUTO_TEST_CASE(simple_action_elimination_rmdpl1) {
+    test_action_elimination<RMDP_L1>();
+}
+
+BOOST_AUTO_TEST_CASE(many_actions_elimination) {
+    // random model with many actions, most of which are clearly suboptimal
+    const long n = 100, actions = 70;
+    MDP mdp(n);
+    default_random_engine generator(7);
+    uniform_int_distribution<long> target(0, n - 1);
+    uniform_real_distribution<prec_t> value(0.0, 1.0);
+    for (long s = 0; s < n; s++) {
+        for (long a = 0; a < actions; a++) {
+            for (int k = 0; k < 3; k++)
+                add_transition(mdp, s, a, target(generator), value(generator), value(generator) * a / actions);
+        }
+    }
+    mdp.normalize();
+
+    auto sol = mdp.vi_jac(Uncertainty::Average, 0.9, numvec(0), 10000, 1e-10);
+    ActionMask mask;
+    auto esol = mdp.vi_jac(Uncertainty::Average, 0.9, numvec(0), 10000, 1e-10, &mask);
+    CHECK_CLOSE_COLLECTION(sol.valuefunction, esol.valuefunction, 1e-8);
+    BOOST_CHECK_EQUAL_COLLECTIONS(sol.policy.begin(), sol.policy.end(), esol.policy.begin(), esol.policy.end());
+    BOOST_CHECK_GT(mask.eliminated_count(), size_t(n * actions / 2));
+    // the optimal actions are never eliminated
+    for (long s = 0; s < n; s++)
+        BOOST_CHECK(!mask.is_eliminated(s, sol.policy[s]));
+
+    // the mask can be reused for the same model
+    auto rsol = mdp.vi_gs(Uncertainty::Average, 0.9, numvec(0), 10000, 1e-10, &mask);
+    CHECK_CLOSE_COLLECTION(sol.valuefunction, rsol.valuefunction, 1e-6);
+}
+
+// ********************************************************************************
+// ***** Span stopping rule *******************************************************
+// ********************************************************************************
+
+template <class Model>
+void test_span_stopping() {
+    auto rmdp = create_test_mdp<Model>();
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic, Uncertainty::Average}) {
+        auto sol = rmdp.vi_jac(uncert, 0.9, numvec(0), 10000, 1e-12);
+
+        auto jsol = rmdp.vi_jac(uncert, 0.9, numvec(0), 10000, 1e-4, nullptr, StoppingRule::Span);
+        auto gsol = rmdp.vi_gs(uncert, 0.9, numvec(0), 10000, 1e-4, nullptr, StoppingRule::Span);
+        auto msol = rmdp.mpi_jac(uncert, 0.9, numvec(0), 1000, 1e-4, 1000, 1e-5, false,
+                PolicyEvaluation::ValueIteration, nullptr, StoppingRule::Span);
+        for (const auto& ssol : {jsol, gsol, msol}) {
+            BOOST_CHECK_GE(ssol.gap, 0);
+            BOOST_CHECK_EQUAL(ssol.lowerbound.size(), rmdp.state_count());
+            for (size_t s = 0; s < rmdp.state_count(); s++) {
+                BOOST_CHECK_LE(ssol.lowerbound[s], sol.valuefunction[s] + 1e-9);
+                BOOST_CHECK_GE(ssol.upperbound[s], sol.valuefunction[s] - 1e-9);
+                BOOST_CHECK_SMALL(ssol.upperbound[s] - ssol.lowerbound[s] - ssol.gap, 1e-9);
+            }
+            BOOST_CHECK_EQUAL_COLLECTIONS(
+                    sol.policy.begin(), sol.policy.end(), ssol.policy.begin(), ssol.policy.end());
+        }
+    }
+    BOOST_CHECK_THROW(rmdp.vi_jac(Uncertainty::Robust, 1.0, numvec(0), 100, 1e-4, nullptr, StoppingRule::Span),
+            invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(simple_span_stopping_mdp) {
+    test_span_stopping<MDP>();
+}
+
+BOOST_AUTO_TEST_CASE(simple_span_stopping_rmdpd) {
+    test_span_stopping<RMDP_D>();
+}
+
+BOOST_AUTO_TEST_CASE(simple_span_stopping_rmdpl1) {
+    test_span_stopping<RMDP_L1>();
+}
+
+BOOST_AUTO_TEST_CASE(high_discount_span_stopping) {
+    // random model without terminal states; the span of the change converges much faster
+    const long n = 200;
+    MDP mdp(n);
+    default_random_engine generator(11);
+    uniform_int_distribution<long> target(0, n - 1);
+    uniform_real_distribution<prec_t> value(0.0, 1.0);
+    for (long s = 0; s < n; s++) {
+        for (long a = 0; a < 3; a++) {
+            for (int k = 0; k < 4; k++)
+                add_transition(mdp, s, a, target(generator), value(generator), value(generator));
+        }
+    }
+    mdp.normalize();
+
+    auto sol = mdp.vi_jac(Uncertainty::Average, 0.99, numvec(0), 100000, 1e-4);
+    auto ssol = mdp.vi_jac(Uncertainty::Average, 0.99, numvec(0), 100000, 1e-4, nullptr, StoppingRule::Span);
+    BOOST_CHECK_LT(ssol.iterations * 5, sol.iterations);
+    BOOST_CHECK_LE(ssol.gap, 0.99 / 0.01 * 1e-4 + 1e-12);
+    BOOST_CHECK_EQUAL_COLLECTIONS(sol.policy.begin(), sol.policy.end(), ssol.policy.begin(), ssol.policy.end());
+    CHECK_CLOSE_COLLECTION(sol.valuefunction, ssol.valuefunction, 0.1);
+
+    // the Gauss-Seidel span includes 0 and does not stop earlier than the residual
+    auto gsol = mdp.vi_gs(Uncertainty::Average, 0.99, numvec(0), 100000, 1e-4);
+    auto gssol = mdp.vi_gs(Uncertainty::Average, 0.99, numvec(0), 100000, 1e-4, nullptr, StoppingRule::Span);
+    BOOST_CHECK_GE(gssol.iterations, gsol.iterations);
+    BOOST_CHECK_LE(gssol.gap, 0.99 / 0.01 * 1e-4 + 1e-12);
+}
+
+// ********************************************************************************
+// ***** Incremental solve ********************************************************
+// ********************************************************************************
+
+BOOST_AUTO_TEST_CASE(dirty_states_tracking) {
+    MDP mdp;
+    add_transition(mdp, 0, 0, 1, 1.0, 1.0);
+    add_transition(mdp, 1, 0, 2, 1.0, 1.0);
+    add_transition(mdp, 2, 0, 2, 1.0, 0.0);
+    BOOST_CHECK_EQUAL(mdp.dirty_states().size(), 3);
+
+    mdp.clear_dirty();
+    BOOST_CHECK(mdp.dirty_states().empty());
+
+    // const access does not mark states
+    const MDP& cmdp = mdp;
+    BOOST_CHECK_EQUAL(cmdp.get_state(1).action_count(), 1);
+    BOOST_CHECK(mdp.dirty_states().empty());
+
+    mdp.get_state(1).get_action(0).get_outcome().set_reward(0, 2.0);
+    add_transition(mdp, 4, 0, 0, 1.0, 1.0);
+    const indvec expected{0, 1, 3, 4};
+    const indvec dirty = mdp.dirty_states();
+    BOOST_CHECK_EQUAL_COLLECTIONS(dirty.begin(), dirty.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(incremental_resolve) {
+    const long n = 500;
+    MDP mdp(n);
+    default_random_engine generator(13);
+    uniform_int_distribution<long> target(0, n - 1);
+    uniform_real_distribution<prec_t> value(0.0, 1.0);
+    // a local structure, so that changes propagate to few states
+    for (long s = 0; s < n; s++) {
+        for (long a = 0; a < 2; a++) {
+            add_transition(mdp, s, a, max(0l, s - 1 - a), 0.9, value(generator));
+            add_transition(mdp, s, a, target(generator) % 10, 0.1, value(generator));
+        }
+    }
+
+    auto sol = mdp.mpi_jac(Uncertainty::Average, 0.9, numvec(0), 1000, 1e-10, 1000, 1e-11);
+    mdp.clear_dirty();
+
+    // the unchanged model requires no backups
+    auto same = mdp.vi_incremental(Uncertainty::Average, 0.9, sol, numeric_limits<unsigned long>::max(), 1e-8);
+    BOOST_CHECK_EQUAL(same.iterations, 0);
+    CHECK_CLOSE_COLLECTION(sol.valuefunction, same.valuefunction, 1e-10);
+
+    // change rewards in a few states and add a new state
+    for (long s : {100, 300, 450})
+        mdp.get_state(s).get_action(1).get_outcome().set_reward(0, 5.0);
+    add_transition(mdp, n, 0, 20, 1.0, 1.0);
+    BOOST_CHECK_EQUAL(mdp.dirty_states().size(), 5);
+
+    auto inc = mdp.vi_incremental(Uncertainty::Average, 0.9, sol, numeric_limits<unsigned long>::max(), 1e-8);
+    BOOST_CHECK(mdp.dirty_states().empty());
+    auto full = mdp.mpi_jac(Uncertainty::Average, 0.9, numvec(0), 1000, 1e-10, 1000, 1e-11);
+
+    BOOST_CHECK_EQUAL(inc.valuefunction.size(), size_t(n + 1));
+    CHECK_CLOSE_COLLECTION(full.valuefunction, inc.valuefunction, 1e-5);
+    BOOST_CHECK_EQUAL_COLLECTIONS(full.policy.begin(), full.policy.end(), inc.policy.begin(), inc.policy.end());
+    BOOST_CHECK_LE(inc.residual, 1e-8);
+    // fewer backups than a single sweep over all states
+    BOOST_CHECK_LT(inc.iterations, n);
+}
+
+// ********************************************************************************
+// ***** Parameter sweep **********************************************************
+// ********************************************************************************
+
+template <class Model>
+void test_vi_jac_sweep() {
+    auto rmdp = create_test_mdp<Model>();
+    const numvec discounts{0.5, 0.9, 0.0, 0.99};
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic, Uncertainty::Average}) {
+        auto solutions = rmdp.vi_jac_sweep(uncert, discounts, numvec(0), 10000, 1e-10);
+        BOOST_CHECK_EQUAL(solutions.size(), discounts.size());
+        for (size_t k = 0; k < discounts.size(); k++) {
+            auto sol = rmdp.vi_jac(uncert, discounts[k], numvec(0), 10000, 1e-10);
+            CHECK_CLOSE_COLLECTION(sol.valuefunction, solutions[k].valuefunction, 1e-8);
+            BOOST_CHECK_EQUAL_COLLECTIONS(sol.policy.begin(), sol.policy.end(), solutions[k].policy.begin(),
+                    solutions[k].policy.end());
+            // each configuration stops on its own
+            BOOST_CHECK_EQUAL(sol.iterations, solutions[k].iterations);
+            BOOST_CHECK_LE(solutions[k].residual, 1e-10);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(vi_jac_sweep_mdp) {
+    test_vi_jac_sweep<MDP>();
+}
+
+BOOST_AUTO_TEST_CASE(vi_jac_sweep_rmdpd) {
+    test_vi_jac_sweep<RMDP_D>();
+}
+
+BOOST_AUTO_TEST_CASE(vi_jac_sweep_rmdpl1) {
+    test_vi_jac_sweep<RMDP_L1>();
+}
+
+BOOST_AUTO_TEST_CASE(vi_jac_sweep_stopping) {
+    const long n = 50;
+    MDP mdp(n);
+    default_random_engine generator(37);
+    uniform_int_distribution<long> target(0, n - 1);
+    uniform_real_distribution<prec_t> value(0.0, 1.0);
+    for (long s = 0; s < n; s++) {
+        for (long a = 0; a < 3; a++) {
+            for (long k = 0; k < 4; k++)
+                add_transition(mdp, s, a, target(generator), value(generator), value(generator));
+        }
+    }
+    mdp.normalize();
+
+    // the configurations stop after different numbers of sweeps, some of them odd numbers apart
+    const numvec discounts{0.5, 0.6, 0.7, 0.97, 0.99};
+    auto solutions = mdp.vi_jac_sweep(Uncertainty::Average, discounts, numvec(0), 100000, 1e-6);
+    bool odd = false;
+    for (size_t k = 0; k < discounts.size(); k++) {
+        auto sol = mdp.vi_jac(Uncertainty::Average, discounts[k], numvec(0), 100000, 1e-6);
+        BOOST_CHECK_EQUAL(sol.iterations, solutions[k].iterations);
+        CHECK_CLOSE_COLLECTION(sol.valuefunction, solutions[k].valuefunction, 1e-12);
+        odd = odd || (solutions.back().iterations - solutions[k].iterations) % 2 == 1;
+    }
+    BOOST_CHECK(odd);
+}
+
+BOOST_AUTO_TEST_CASE(vi_jac_sweep_thresholds) {
+    RMDP_L1 rmdp = create_test_mdp<RMDP_L1>();
+    const numvec discounts{0.9, 0.9, 0.8, 0.95};
+    const numvec thresholds{0.0, 0.5, 1.0, 2.0};
+
+    auto solutions = rmdp.vi_jac_sweep(Uncertainty::Robust, discounts, thresholds, 10000, 1e-10);
+    for (size_t k = 0; k < discounts.size(); k++) {
+        set_outcome_thresholds(rmdp, thresholds[k]);
+        auto sol = rmdp.vi_jac(Uncertainty::Robust, discounts[k], numvec(0), 10000, 1e-10);
+        CHECK_CLOSE_COLLECTION(sol.valuefunction, solutions[k].valuefunction, 1e-8);
+        BOOST_CHECK_EQUAL_COLLECTIONS(
+                sol.policy.begin(), sol.policy.end(), solutions[k].policy.begin(), solutions[k].policy.end());
+        for (size_t s = 0; s < rmdp.state_count(); s++)
+            CHECK_CLOSE_COLLECTION(sol.outcomes[s], solutions[k].outcomes[s], 1e-8);
+    }
+
+    BOOST_CHECK_THROW(rmdp.vi_jac_sweep(Uncertainty::Robust, discounts, numvec(2, 0.5)), invalid_argument);
+    MDP mdp = create_test_mdp<MDP>();
+    BOOST_CHECK_THROW(mdp.vi_jac_sweep(Uncertainty::Robust, discounts, thresholds), invalid_argument);
+}
+
+// ********************************************************************************
+// ***** Finite horizon ***********************************************************
+// ********************************************************************************
+
+template <class Model>
+void test_finite_horizon() {
+    auto rmdp = create_test_mdp<Model>();
+    const size_t horizon = 6;
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic, Uncertainty::Average}) {
+        auto fsol = rmdp.finite_horizon(uncert, 0.9, horizon, numvec(0), true);
+        BOOST_CHECK_EQUAL(fsol.policy.size(), horizon * rmdp.state_count());
+        BOOST_CHECK_EQUAL(fsol.stagevalues.size(), (horizon + 1) * rmdp.state_count());
+        BOOST_CHECK_EQUAL(fsol.outcomes.size(), horizon * rmdp.state_count());
+
+        // the values at time t are the result of horizon - t Bellman updates
+        for (size_t t = 0; t < horizon; t++) {
+            auto sol = rmdp.vi_jac(uncert, 0.9, numvec(0), horizon - t, 0.0);
+            for (size_t s = 0; s < rmdp.state_count(); s++) {
+                BOOST_CHECK_CLOSE(fsol.value(t, s), sol.valuefunction[s], 1e-8);
+                BOOST_CHECK_EQUAL(fsol.action(t, s), sol.policy[s]);
+            }
+        }
+        auto sol = rmdp.vi_jac(uncert, 0.9, numvec(0), horizon, 0.0);
+        CHECK_CLOSE_COLLECTION(fsol.valuefunction, sol.valuefunction, 1e-8);
+
+        // values of the stages are not stored by default
+        auto csol = rmdp.finite_horizon(uncert, 0.9, horizon);
+        BOOST_CHECK(csol.stagevalues.empty());
+        BOOST_CHECK_THROW(csol.value(0, 0), invalid_argument);
+        CHECK_CLOSE_COLLECTION(fsol.valuefunction, csol.valuefunction, 1e-10);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(finite_horizon_mdp) {
+    test_finite_horizon<MDP>();
+}
+
+BOOST_AUTO_TEST_CASE(finite_horizon_rmdpd) {
+    test_finite_horizon<RMDP_D>();
+}
+
+BOOST_AUTO_TEST_CASE(finite_horizon_rmdpl1) {
+    test_finite_horizon<RMDP_L1>();
+
+    // the outcomes at time t are the responses to the values at time t + 1
+    auto rmdp = create_test_mdp<RMDP_L1>();
+    const size_t n = rmdp.state_count(), horizon = 4;
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic}) {
+        auto fsol = rmdp.finite_horizon(uncert, 0.9, horizon, numvec(0), true);
+        for (size_t t = 0; t < horizon; t++) {
+            const numvec next(fsol.stagevalues.begin() + (t + 1) * n, fsol.stagevalues.begin() + (t + 2) * n);
+            for (size_t s = 0; s < n; s++) {
+                if (fsol.action(t, s) < 0) {
+                    BOOST_CHECK(fsol.outcome(t, s).empty());
+                    continue;
+                }
+                const auto& action = rmdp.get_state(s).get_action(fsol.action(t, s));
+                const auto response = uncert == Uncertainty::Robust ? action.minimal(next, 0.9)
+                                                                    : action.maximal(next, 0.9);
+                CHECK_CLOSE_COLLECTION(fsol.outcome(t, s), response.first, 1e-10);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(finite_horizon_deadline) {
+    // waiting in state 0 pays 1 per step; moving to state 1 pays 5 once and ends
+    MDP mdp;
+    add_transition(mdp, 0, 0, 0, 1.0, 1.0);
+    add_transition(mdp, 0, 1, 1, 1.0, 5.0);
+    add_transition(mdp, 1, 0, 1, 1.0, 0.0);
+    const numvec terminal{0.0, 0.0};
+
+    auto sol = mdp.finite_horizon(Uncertainty::Average, 1.0, 10, terminal);
+    // wait until the last step, then move
+    for (size_t t = 0; t < 10; t++)
+        BOOST_CHECK_EQUAL(sol.action(t, 0), t < 9 ? 0 : 1);
+    BOOST_CHECK_CLOSE(sol.valuefunction[0], 14.0, 1e-10);
+    // with discounting, moving earlier is better
+    auto dsol = mdp.finite_horizon(Uncertainty::Average, 0.5, 10, terminal);
+    BOOST_CHECK_EQUAL(dsol.action(0, 0), 1);
+
+    BOOST_CHECK_THROW(mdp.finite_horizon(Uncertainty::Average, 1.0, 10, numvec(3, 0.0)), invalid_argument);
+}
+
+// ********************************************************************************
+// ***** Batch solve **************************************************************
+// ********************************************************************************
+
+template <class Model>
+void test_solve_batch() {
+    vector<Model> models;
+    vector<BatchParameters> parameters;
+    default_random_engine generator(17);
+    uniform_real_distribution<prec_t> value(0.0, 1.0);
+    // models of different sizes; the last two are solved as large models
+    for (long size : {5, 20, 3, 50, 10, 200, 300}) {
+        Model model(size);
+        uniform_int_distribution<long> target(0, size - 1);
+        for (long s = 0; s < size; s++) {
+            for (long a = 0; a < 2; a++) {
+                for (long o = 0; o < 2; o++) {
+                    for (int k = 0; k < 2; k++)
+                        add_transition(model, s, a, o, target(generator), value(generator), value(generator));
+                }
+            }
+        }
+        model.normalize();
+        models.push_back(model);
+        parameters.emplace_back(size % 2 == 0 ? Uncertainty::Robust : Uncertainty::Optimistic,
+                0.8 + 0.01 * (models.size() % 5), 1000, 1e-8, 1000, 1e-9);
+    }
+
+    auto solutions = solve_batch(models, parameters, 100);
+    BOOST_CHECK_EQUAL(solutions.size(), models.size());
+    for (size_t m = 0; m < models.size(); m++) {
+        const auto& p = parameters[m];
+        auto sol = models[m].mpi_jac(p.uncertainty, p.discount, numvec(0), 1000, 1e-8, 1000, 1e-9);
+        CHECK_CLOSE_COLLECTION(sol.valuefunction, solutions[m].valuefunction, 1e-10);
+        BOOST_CHECK_EQUAL_COLLECTIONS(sol.policy.begin(), sol.policy.end(), solutions[m].policy.begin(),
+                solutions[m].policy.end());
+    }
+
+    // the same parameters for all models
+    auto same = solve_batch(models, BatchParameters(Uncertainty::Average, 0.9));
+    for (size_t m = 0; m < models.size(); m++)
+        BOOST_CHECK_LE(same[m].residual, SOLPREC);
+
+    BOOST_CHECK_THROW(solve_batch(models, vector<BatchParameters>(1)), invalid_argument);
+    // exceptions are rethrown from the parallel solutions
+    parameters[2].valuefunction = numvec(1000, 0.0);
+    BOOST_CHECK_THROW(solve_batch(models, parameters), invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(solve_batch_mdp) {
+    test_solve_batch<MDP>();
+}
+
+BOOST_AUTO_TEST_CASE(solve_batch_rmdpd) {
+    test_solve_batch<RMDP_D>();
+}
+
+BOOST_AUTO_TEST_CASE(solve_batch_rmdpl1) {
+    test_solve_batch<RMDP_L1>();
+}
+
 // ********************************************************************************
 // ***** Model resize *************************************************************
 // ********************************************************************************
@@ -368,6 +1598,107 @@ BOOST_AUTO_TEST_CASE(check_add_transition_rmdpl1) {
     test_check_add_transition<RMDP_L1>(numvec{1.0});
 }
 
+BOOST_AUTO_TEST_CASE(check_index_overflow) {
+    BOOST_CHECK_EQUAL(checked_index(10l), 10);
+    BOOST_CHECK_EQUAL(checked_index(size_t(numeric_limits<idx_t>::max())), numeric_limits<idx_t>::max());
+
+    // the check only matters when indices are narrower than the sizes; with 64-bit
+    // indices, the index one past the maximum would overflow already in the test
+#ifndef CRAAM_INDEX_64
+    const long toolarge = long(numeric_limits<idx_t>::max()) + 1;
+    BOOST_CHECK_THROW(checked_index(toolarge), overflow_error);
+
+    Transition t;
+    BOOST_CHECK_THROW(t.add_sample(toolarge, 1.0, 0.0), overflow_error);
+    MDP mdp;
+    BOOST_CHECK_THROW(mdp.create_state(toolarge), overflow_error);
+    BOOST_CHECK_THROW(mdp.create_state(0).create_action(toolarge), overflow_error);
+    BOOST_CHECK_EQUAL(mdp.state_count(), 1);
+#endif
+}
+
+// ********************************************************************************
+// ***** Model builder ************************************************************
+// ********************************************************************************
+
+template <class Model>
+void check_same_model(const Model& expected, const Model& actual) {
+    BOOST_REQUIRE_EQUAL(expected.state_count(), actual.state_count());
+    for (size_t si : indices(expected)) {
+        BOOST_REQUIRE_EQUAL(expected[si].action_count(), actual[si].action_count());
+        for (size_t ai : indices(expected[si])) {
+            const auto& eoutcomes = expected[si][ai].get_outcomes();
+            const auto& aoutcomes = actual[si][ai].get_outcomes();
+            BOOST_REQUIRE_EQUAL(eoutcomes.size(), aoutcomes.size());
+            for (size_t oi : indices(eoutcomes)) {
+                const auto& eindices = eoutcomes[oi].get_indices();
+                const auto& aindices = aoutcomes[oi].get_indices();
+                BOOST_CHECK_EQUAL_COLLECTIONS(eindices.begin(), eindices.end(), aindices.begin(), aindices.end());
+                CHECK_CLOSE_COLLECTION(
+                        eoutcomes[oi].get_probabilities(), aoutcomes[oi].get_probabilities(), 1e-8);
+                CHECK_CLOSE_COLLECTION(eoutcomes[oi].get_rewards(), aoutcomes[oi].get_rewards(), 1e-8);
+            }
+        }
+    }
+}
+
+template <class Model>
+void test_builder_random(bool outcomes) {
+    default_random_engine gen(2016);
+    uniform_int_distribution<long> state(0, 20), action(0, 3), outcome(0, outcomes ? 2 : 0);
+    uniform_real_distribution<prec_t> value(0.0, 1.0);
+
+    Model expected;
+    ModelBuilder builder;
+    for (size_t i = 0; i < 2000; i++) {
+        long from = state(gen), a = action(gen), o = outcome(gen), to = state(gen);
+        // include some zero probabilities which must be skipped
+        prec_t p = (i % 50 == 0) ? 0.0 : value(gen), r = value(gen);
+        add_transition(expected, from, a, o, to, p, r);
+        builder.add_transition(from, a, o, to, p, r);
+    }
+    BOOST_CHECK_EQUAL(builder.size(), 2000);
+
+    auto actual = builder.build<Model>();
+    check_same_model(expected, actual);
+}
+
+BOOST_AUTO_TEST_CASE(builder_random_mdp) {
+    test_builder_random<MDP>(false);
+}
+
+BOOST_AUTO_TEST_CASE(builder_random_rmdpd) {
+    test_builder_random<RMDP_D>(true);
+}
+
+BOOST_AUTO_TEST_CASE(builder_random_rmdpl1) {
+    test_builder_random<RMDP_L1>(true);
+}
+
+BOOST_AUTO_TEST_CASE(builder_existing_model) {
+    MDP expected, actual;
+    add_transition(expected, 0, 0, 2, 0.5, 1.0);
+    add_transition(actual, 0, 0, 2, 0.5, 1.0);
+
+    ModelBuilder builder;
+    builder.add_transition(0, 0, 1, 0.2, 3.0);
+    builder.add_transition(0, 0, 2, 0.5, 2.0);
+    builder.add_transition(3, 1, 0, 0.0, 2.0);
+    builder.build(actual);
+
+    add_transition(expected, 0, 0, 1, 0.2, 3.0);
+    add_transition(expected, 0, 0, 2, 0.5, 2.0);
+    add_transition(expected, 3, 1, 0, 0.0, 2.0);
+
+    check_same_model(expected, actual);
+    BOOST_CHECK_EQUAL(actual.state_count(), 4);
+    BOOST_CHECK_EQUAL(actual[3].action_count(), 2);
+    BOOST_CHECK(actual[3][1].get_outcome().empty());
+
+    BOOST_CHECK_THROW(builder.add_transition(0, 0, 1, -0.5, 0.0), invalid_argument);
+    BOOST_CHECK_THROW(builder.add_transition(-1, 0, 1, 0.5, 0.0), invalid_argument);
+}
+
 // ********************************************************************************
 // ***** Save and load ************************************************************
 // ********************************************************************************
@@ -434,6 +1765,95 @@ BOOST_AUTO_TEST_CASE(simple_mdp_save_load_save_load) {
     test_simple_mdp_save_load_save_load<MDP>();
 }
 
+template <class Model>
+void test_simple_mdp_load_buffer() {
+    Model rmdp1 = create_test_mdp<Model>();
+
+    stringstream store;
+    rmdp1.to_csv(store);
+    auto string1 = store.str();
+
+    Model rmdp2;
+    from_csv_buffer(rmdp2, string1.data(), string1.data() + string1.size());
+
+    stringstream store2;
+    rmdp2.to_csv(store2);
+    BOOST_CHECK_EQUAL(string1, store2.str());
+}
+
+BOOST_AUTO_TEST_CASE(simple_mdp_load_buffer) {
+    test_simple_mdp_load_buffer<MDP>();
+    test_simple_mdp_load_buffer<RMDP_D>();
+    test_simple_mdp_load_buffer<RMDP_L1>();
+}
+
+BOOST_AUTO_TEST_CASE(csv_buffer_precision) {
+    const vector<string> numbers{"0.1", "0.30000000000000004", "1e-3", "-2.5E+2", "123456789012345678901",
+            "0.12345678901234567890123", "4.9e-324", "1.7976931348623157e308", "7", ".5", "5."};
+
+    for (const auto& number : numbers) {
+        const string csv = "0,0,0,0,1.0," + number + "\n";
+        MDP mdp;
+        from_csv_buffer(mdp, csv.data(), csv.data() + csv.size(), false);
+        BOOST_CHECK_EQUAL(mdp[0][0].get_outcome().get_rewards()[0], strtod(number.c_str(), nullptr));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(csv_buffer_format) {
+    // windows line endings, blanks, extra columns, no final new line
+    const string csv{"idstatefrom,idaction,idoutcome,idstateto,probability,reward\r\n"
+                     "0,0,0,1,0.5,1.0\r\n"
+                     "\n"
+                     " 0 , 0 , 0 , 2 , 0.5 , 2.0 ,comment\n"
+                     "1,0,0,1,1.0,0.0"};
+
+    MDP mdp;
+    from_csv_buffer(mdp, csv.data(), csv.data() + csv.size());
+    BOOST_CHECK_EQUAL(mdp.state_count(), 3);
+    numvec probabilities{0.5, 0.5}, rewards{1.0, 2.0};
+    CHECK_CLOSE_COLLECTION(mdp[0][0].get_outcome().get_probabilities(), probabilities, 1e-10);
+    CHECK_CLOSE_COLLECTION(mdp[0][0].get_outcome().get_rewards(), rewards, 1e-10);
+    BOOST_CHECK_EQUAL(mdp[1][0].get_outcome().size(), 1);
+
+    const string invalid{"0,0,0,1,0.5,1.0\n0,0,x,1,0.5,1.0\n"};
+    MDP mdp2;
+    BOOST_CHECK_THROW(from_csv_buffer(mdp2, invalid.data(), invalid.data() + invalid.size(), false),
+            invalid_argument);
+    const string negative{"0,0,0,1,-0.5,1.0\n"};
+    BOOST_CHECK_THROW(from_csv_buffer(mdp2, negative.data(), negative.data() + negative.size(), false),
+            invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(csv_file_large) {
+    // large enough to be split into several chunks
+    default_random_engine gen(42);
+    uniform_int_distribution<long> state(0, 999), action(0, 4);
+    uniform_real_distribution<prec_t> value(0.0, 1.0);
+
+    const string filename = "craam_test_large.csv";
+    stringstream expected;
+    {
+        ofstream output(filename);
+        output << "idstatefrom,idaction,idoutcome,idstateto,probability,reward\n";
+        output.precision(17);
+        for (long i = 0; i < 300000; i++) {
+            output << state(gen) << "," << action(gen) << ",0," << state(gen) << "," << value(gen) << ","
+                   << value(gen) << "\n";
+        }
+    }
+
+    MDP fast;
+    from_csv_file(fast, filename);
+    MDP slow;
+    ifstream input(filename);
+    from_csv(slow, input);
+    input.close();
+    remove(filename.c_str());
+
+    check_same_model(slow, fast);
+    BOOST_CHECK_THROW(from_csv_file(fast, filename), invalid_argument);
+}
+
 // ********************************************************************************
 // ***** Value function ***********************************************************
 // ********************************************************************************
@@ -1031,3 +2451,375 @@ BOOST_AUTO_TEST_CASE(test_robustification) {
     // cout << "RMDP Solution, no zeros " << rmdp_nz.mpi_jac(Uncertainty::Robust, 0.9).valuefunction << endl;
     // cout << "MDP Solution, zeros " << rmdp_z.mpi_jac(Uncertainty::Robust, 0.9).valuefunction << endl;
 }
+
+// ********************************************************************************
+// ***** Compiled model ***********************************************************
+// ********************************************************************************
+
+template <class Model>
+void test_compiled_simple(typename Model::OutcomePolicy natpol) {
+    auto rmdp = create_test_mdp<Model>();
+    auto cmdp = rmdp.compile();
+
+    BOOST_CHECK_EQUAL(cmdp.state_count(), 3);
+    BOOST_CHECK_EQUAL(cmdp.action_count(), 6);
+    BOOST_CHECK_EQUAL(cmdp.outcome_count(), 6);
+    BOOST_CHECK_EQUAL(cmdp.transition_count(), 6);
+
+    numvec initial{0, 0, 0};
+    indvec pol{1, 1, 1};
+
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic, Uncertainty::Average}) {
+        auto re1 = rmdp.vi_gs(uncert, 0.9, initial, 20, 0);
+        auto cre1 = cmdp.vi_gs(uncert, 0.9, initial, 20, 0);
+        CHECK_CLOSE_COLLECTION(re1.valuefunction, cre1.valuefunction, 1e-6);
+        BOOST_CHECK_EQUAL_COLLECTIONS(re1.policy.begin(), re1.policy.end(), cre1.policy.begin(), cre1.policy.end());
+        BOOST_CHECK_EQUAL(re1.iterations, cre1.iterations);
+
+        auto re2 = rmdp.vi_jac(uncert, 0.9, initial, 20, 0);
+        auto cre2 = cmdp.vi_jac(uncert, 0.9, initial, 20, 0);
+        CHECK_CLOSE_COLLECTION(re2.valuefunction, cre2.valuefunction, 1e-6);
+        BOOST_CHECK_EQUAL_COLLECTIONS(re2.policy.begin(), re2.policy.end(), cre2.policy.begin(), cre2.policy.end());
+
+        auto re3 = rmdp.mpi_jac(uncert, 0.9, initial, 1000, 1e-6, 1000, 1e-7);
+        auto cre3 = cmdp.mpi_jac(uncert, 0.9, initial, 1000, 1e-6, 1000, 1e-7);
+        CHECK_CLOSE_COLLECTION(re3.valuefunction, cre3.valuefunction, 1e-6);
+        BOOST_CHECK_EQUAL_COLLECTIONS(re3.policy.begin(), re3.policy.end(), cre3.policy.begin(), cre3.policy.end());
+        BOOST_CHECK_EQUAL(re3.iterations, cre3.iterations);
+    }
+
+    auto re4 = rmdp.vi_jac_fix(0.9, pol, natpol, initial, 10000, 0.0);
+    auto cre4 = cmdp.vi_jac_fix(0.9, pol, natpol, initial, 10000, 0.0);
+    CHECK_CLOSE_COLLECTION(re4.valuefunction, cre4.valuefunction, 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE(compiled_simple_mdp) {
+    test_compiled_simple<MDP>(indvec{0, 0, 0});
+}
+
+BOOST_AUTO_TEST_CASE(compiled_simple_rmdpd) {
+    test_compiled_simple<RMDP_D>(indvec{0, 0, 0});
+}
+
+BOOST_AUTO_TEST_CASE(compiled_simple_rmdpl1) {
+    test_compiled_simple<RMDP_L1>(vector<numvec>{numvec{1}, numvec{1}, numvec{1}});
+}
+
+BOOST_AUTO_TEST_CASE(compiled_randomized_rmdpl1) {
+    RMDP_L1 rmdp;
+
+    // format: idstatefrom, idaction, idoutcome, idstateto, probability, reward
+    string string_representation{"1,0,0,1,1.0,2.0 \
+         2,0,0,2,1.0,3.0 \
+         3,0,0,3,1.0,1.0 \
+         4,0,0,4,1.0,4.0 \
+         0,0,0,1,1.0,0.0 \
+         0,0,1,2,1.0,0.0 \
+         0,1,0,3,1.0,0.0 \
+         0,1,1,4,1.0,0.0\n"};
+    stringstream store(string_representation);
+    from_csv(rmdp, store, false);
+
+    numvec value(5, 0.0);
+    const prec_t gamma = 0.9;
+
+    for (prec_t threshold : {0.0, 0.5, 1.0, 2.0}) {
+        set_outcome_thresholds(rmdp, threshold);
+        auto cmdp = rmdp.compile();
+
+        for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic, Uncertainty::Average}) {
+            auto sol1 = rmdp.vi_jac(uncert, gamma, value, 1000, 1e-5);
+            auto csol1 = cmdp.vi_jac(uncert, gamma, value, 1000, 1e-5);
+            CHECK_CLOSE_COLLECTION(sol1.valuefunction, csol1.valuefunction, 1e-6);
+
+            auto sol2 = rmdp.vi_gs(uncert, gamma, value, 1000, 1e-5);
+            auto csol2 = cmdp.vi_gs(uncert, gamma, value, 1000, 1e-5);
+            CHECK_CLOSE_COLLECTION(sol2.valuefunction, csol2.valuefunction, 1e-6);
+
+            auto sol3 = rmdp.mpi_jac(uncert, gamma, value, 1000, 1e-5, 1000, 1e-5);
+            auto csol3 = cmdp.mpi_jac(uncert, gamma, value, 1000, 1e-5, 1000, 1e-5);
+            CHECK_CLOSE_COLLECTION(sol3.valuefunction, csol3.valuefunction, 1e-6);
+            BOOST_REQUIRE_EQUAL(sol3.outcomes.size(), csol3.outcomes.size());
+            for (size_t s = 0; s < sol3.outcomes.size(); s++)
+                CHECK_CLOSE_COLLECTION(sol3.outcomes[s], csol3.outcomes[s], 1e-6);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compiled_drop_rewards) {
+    RMDP_D rmdp(3);
+    // transitions with different rewards to the same outcome
+    add_transition(rmdp, 0, 0, 0, 0, 0.5, 1.0);
+    add_transition(rmdp, 0, 0, 0, 1, 0.5, 3.0);
+    add_transition(rmdp, 0, 0, 1, 2, 1.0, -1.0);
+    add_transition(rmdp, 1, 0, 0, 2, 0.2, 2.0);
+    add_transition(rmdp, 1, 0, 0, 1, 0.8, 0.5);
+    add_transition(rmdp, 2, 0, 0, 2, 1.0, 1.0);
+
+    auto full = rmdp.compile();
+    auto light = rmdp.compile(false);
+
+    BOOST_CHECK(full.has_rewards());
+    BOOST_CHECK(!light.has_rewards());
+    BOOST_CHECK_EQUAL(full.get_rewards().size(), full.transition_count());
+    BOOST_CHECK(light.get_rewards().empty());
+
+    numvec expected{2.0, -1.0, 0.8, 1.0};
+    CHECK_CLOSE_COLLECTION(full.get_outcome_rewards(), expected, 1e-10);
+    CHECK_CLOSE_COLLECTION(light.get_outcome_rewards(), expected, 1e-10);
+
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic, Uncertainty::Average}) {
+        auto sol = rmdp.vi_gs(uncert, 0.9, numvec(0), 1000, 1e-8);
+        auto lsol = light.vi_gs(uncert, 0.9, numvec(0), 1000, 1e-8);
+        CHECK_CLOSE_COLLECTION(sol.valuefunction, lsol.valuefunction, 1e-6);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compiled_single_precision) {
+    RMDP_L1 rmdp;
+    const string string_representation{"1,0,0,1,1.0,2.0 \n\
+         2,0,0,2,1.0,3.0 \n\
+         3,0,0,3,1.0,1.0 \n\
+         4,0,0,4,1.0,4.0 \n\
+         0,0,0,1,0.3,0.1 \n\
+         0,0,0,2,0.7,0.3 \n\
+         0,0,1,3,0.1,-0.2 \n\
+         0,0,1,4,0.9,0.0 \n\
+         0,1,0,1,1.0,0.0 \n\
+         0,1,1,4,1.0,0.0\n"};
+    stringstream store(string_representation);
+    from_csv(rmdp, store, false);
+    set_outcome_thresholds(rmdp, 0.5);
+
+    CompiledRMDP_L1 cmdp(rmdp);
+    CompiledRMDP_L1_F fmdp(rmdp, false);
+
+    BOOST_CHECK_EQUAL(fmdp.transition_count(), cmdp.transition_count());
+    BOOST_CHECK_EQUAL(fmdp.get_probabilities().size(), cmdp.get_probabilities().size());
+    BOOST_CHECK(!fmdp.has_rewards());
+
+    for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic, Uncertainty::Average}) {
+        auto sol = cmdp.vi_gs(uncert, 0.9, numvec(0), 1000, 1e-8);
+        auto fsol = fmdp.vi_gs(uncert, 0.9, numvec(0), 1000, 1e-8);
+        CHECK_CLOSE_COLLECTION(sol.valuefunction, fsol.valuefunction, 1e-3);
+        BOOST_CHECK_EQUAL_COLLECTIONS(sol.policy.begin(), sol.policy.end(), fsol.policy.begin(), fsol.policy.end());
+
+        auto sol2 = cmdp.mpi_jac(uncert, 0.9, numvec(0), 1000, 1e-8, 1000, 1e-8);
+        auto fsol2 = fmdp.mpi_jac(uncert, 0.9, numvec(0), 1000, 1e-8, 1000, 1e-8);
+        CHECK_CLOSE_COLLECTION(sol2.valuefunction, fsol2.valuefunction, 1e-3);
+    }
+}
+
+// ********************************************************************************
+// ***** Binary compiled model ****************************************************
+// ********************************************************************************
+
+template <class Compiled, class Model>
+void test_binary_roundtrip(const Model& rmdp, bool keep_rewards) {
+    const string filename = "craam_test_model.bin";
+    Compiled cmdp(rmdp, keep_rewards);
+    cmdp.save(filename);
+
+    {
+        auto loaded = Compiled::load(filename, true);
+        BOOST_CHECK_EQUAL(loaded.state_count(), cmdp.state_count());
+        BOOST_CHECK_EQUAL(loaded.action_count(), cmdp.action_count());
+        BOOST_CHECK_EQUAL(loaded.outcome_count(), cmdp.outcome_count());
+        BOOST_CHECK_EQUAL(loaded.transition_count(), cmdp.transition_count());
+        BOOST_CHECK_EQUAL(loaded.has_rewards(), cmdp.has_rewards());
+        BOOST_CHECK_EQUAL_COLLECTIONS(loaded.get_indices().begin(),
+                loaded.get_indices().end(),
+                cmdp.get_indices().begin(),
+                cmdp.get_indices().end());
+        BOOST_CHECK_EQUAL_COLLECTIONS(loaded.get_thresholds().begin(),
+                loaded.get_thresholds().end(),
+                cmdp.get_thresholds().begin(),
+                cmdp.get_thresholds().end());
+        BOOST_CHECK_EQUAL_COLLECTIONS(loaded.get_weights().begin(),
+                loaded.get_weights().end(),
+                cmdp.get_weights().begin(),
+                cmdp.get_weights().end());
+
+        // the same arrays must produce the same solutions
+        for (auto uncert : {Uncertainty::Robust, Uncertainty::Optimistic, Uncertainty::Average}) {
+            auto sol = cmdp.vi_gs(uncert, 0.9, numvec(0), 1000, 1e-8);
+            auto lsol = loaded.vi_gs(uncert, 0.9, numvec(0), 1000, 1e-8);
+            BOOST_CHECK_EQUAL_COLLECTIONS(sol.valuefunction.begin(),
+                    sol.valuefunction.end(),
+                    lsol.valuefunction.begin(),
+                    lsol.valuefunction.end());
+            BOOST_CHECK_EQUAL_COLLECTIONS(
+                    sol.policy.begin(), sol.policy.end(), lsol.policy.begin(), lsol.policy.end());
+
+            auto sol2 = cmdp.mpi_jac(uncert, 0.9, numvec(0), 1000, 1e-8, 1000, 1e-8);
+            auto lsol2 = loaded.mpi_jac(uncert, 0.9, numvec(0), 1000, 1e-8, 1000, 1e-8);
+            BOOST_CHECK_EQUAL_COLLECTIONS(sol2.valuefunction.begin(),
+                    sol2.valuefunction.end(),
+                    lsol2.valuefunction.begin(),
+                    lsol2.valuefunction.end());
+        }
+    }
+    remove(filename.c_str());
+}
+
+RMDP_L1 binary_test_model() {
+    RMDP_L1 rmdp;
+    const string string_representation{"1,0,0,1,1.0,2.0 \n\
+         2,0,0,2,1.0,3.0 \n\
+         3,0,0,3,1.0,1.0 \n\
+         4,0,0,4,1.0,4.0 \n\
+         0,0,0,1,0.3,0.1 \n\
+         0,0,0,2,0.7,0.3 \n\
+         0,0,1,3,0.1,-0.2 \n\
+         0,0,1,4,0.9,0.0 \n\
+         0,1,0,1,1.0,0.0 \n\
+         0,1,1,4,1.0,0.0\n"};
+    stringstream store(string_representation);
+    from_csv(rmdp, store, false);
+    set_outcome_thresholds(rmdp, 0.5);
+    set_outcome_dst(rmdp, 0, 0, numvec{0.2, 0.8});
+    return rmdp;
+}
+
+BOOST_AUTO_TEST_CASE(binary_roundtrip_mdp) {
+    MDP mdp;
+    const string string_representation{"0,0,0,1,0.5,1.0\n0,0,0,2,0.5,2.0\n0,1,0,2,1.0,1.5\n"
+                                       "1,0,0,0,1.0,-1.0\n2,0,0,2,1.0,0.5\n"};
+    stringstream store(string_representation);
+    from_csv(mdp, store, false);
+    test_binary_roundtrip<CompiledMDP>(mdp, true);
+    test_binary_roundtrip<CompiledMDP>(mdp, false);
+    test_binary_roundtrip<CompiledMDP_F>(mdp, true);
+}
+
+BOOST_AUTO_TEST_CASE(binary_roundtrip_rmdpd) {
+    RMDP_D rmdp;
+    const string string_representation{"0,0,0,1,1.0,1.0\n0,0,1,2,1.0,2.0\n1,0,0,0,1.0,-1.0\n"
+                                       "2,0,0,2,0.5,0.5\n2,0,0,1,0.5,0.0\n"};
+    stringstream store(string_representation);
+    from_csv(rmdp, store, false);
+    test_binary_roundtrip<CompiledRMDP_D>(rmdp, true);
+    test_binary_roundtrip<CompiledRMDP_D_F>(rmdp, false);
+}
+
+BOOST_AUTO_TEST_CASE(binary_roundtrip_rmdpl1) {
+    const RMDP_L1 rmdp = binary_test_model();
+    test_binary_roundtrip<CompiledRMDP_L1>(rmdp, true);
+    test_binary_roundtrip<CompiledRMDP_L1>(rmdp, false);
+    test_binary_roundtrip<CompiledRMDP_L1_F>(rmdp, true);
+}
+
+BOOST_AUTO_TEST_CASE(binary_invalid_files) {
+    const string filename = "craam_test_invalid.bin";
+    const RMDP_L1 rmdp = binary_test_model();
+    CompiledRMDP_L1(rmdp).save(filename);
+
+    // wrong state type or precision
+    BOOST_CHECK_THROW(CompiledMDP::load(filename), invalid_argument);
+    BOOST_CHECK_THROW(CompiledRMDP_L1_F::load(filename), invalid_argument);
+
+    string content;
+    {
+        ifstream input(filename, ios::binary);
+        content.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    }
+    auto write = [&](const string& data) {
+        ofstream output(filename, ios::binary);
+        output.write(data.data(), data.size());
+    };
+
+    // truncated file
+    write(content.substr(0, content.size() / 2));
+    BOOST_CHECK_THROW(CompiledRMDP_L1::load(filename), invalid_argument);
+
+    // wrong magic
+    string corrupted = content;
+    corrupted[0] = 'X';
+    write(corrupted);
+    BOOST_CHECK_THROW(CompiledRMDP_L1::load(filename), invalid_argument);
+
+    // target state out of range: only detected when indices are checked
+    CompiledRMDP_L1 cmdp(rmdp);
+    const size_t indices_bytes = cmdp.get_indices().size() * sizeof(idx_t);
+    corrupted = content;
+    for (size_t i = 0; i + indices_bytes <= content.size(); i += 64) {
+        // find the aligned array with the indices
+        if (equal(reinterpret_cast<const char*>(cmdp.get_indices().data()),
+                    reinterpret_cast<const char*>(cmdp.get_indices().data() + cmdp.get_indices().size()),
+                    content.begin() + i)) {
+            const idx_t invalid = 1000;
+            copy(reinterpret_cast<const char*>(&invalid),
+                    reinterpret_cast<const char*>(&invalid) + sizeof(idx_t),
+                    corrupted.begin() + i);
+            break;
+        }
+    }
+    BOOST_REQUIRE(corrupted != content);
+    write(corrupted);
+    BOOST_CHECK_NO_THROW(CompiledRMDP_L1::load(filename));
+    BOOST_CHECK_THROW(CompiledRMDP_L1::load(filename, true), invalid_argument);
+
+    remove(filename.c_str());
+    BOOST_CHECK_THROW(CompiledRMDP_L1::load(filename), invalid_argument);
+}
+
+// ********************************************************************************
+// ***** SIMD kernels *************************************************************
+// ********************************************************************************
+
+BOOST_AUTO_TEST_CASE(simd_kernels_match_portable) {
+    using namespace craam::kernels;
+
+    default_random_engine gen(1987);
+    uniform_real_distribution<prec_t> dist(-1.0, 1.0);
+
+    const long statecount = 100;
+    numvec valuefunction(statecount);
+    for (auto& v : valuefunction)
+        v = dist(gen);
+
+    const SimdIsa selected = active_isa();
+    BOOST_CHECK(select_isa(SimdIsa::Portable));
+
+    for (auto isa : {SimdIsa::AVX2, SimdIsa::AVX512}) {
+        if (!is_isa_supported(isa)) {
+            BOOST_TEST_MESSAGE("Skipping unsupported kernels: " << isa_name(isa));
+            continue;
+        }
+        // lengths that test the vector bodies and all remainders
+        for (size_t n = 0; n < 40; n++) {
+            indvec indices(n);
+            numvec probabilities(n), rewards(n);
+            for (size_t i = 0; i < n; i++) {
+                indices[i] = (i * 37) % statecount;
+                probabilities[i] = dist(gen);
+                rewards[i] = dist(gen);
+            }
+
+            BOOST_CHECK(select_isa(SimdIsa::Portable));
+            auto value = transition_value(
+                    indices.data(), probabilities.data(), rewards.data(), n, valuefunction.data(), 0.9);
+            auto product = dot(probabilities.data(), rewards.data(), n);
+            auto sparse_product = sparse_dot(indices.data(), probabilities.data(), n, valuefunction.data());
+            vector<float> fprobabilities(probabilities.begin(), probabilities.end());
+            auto fsparse_product = sparse_dot(indices.data(), fprobabilities.data(), n, valuefunction.data());
+
+            BOOST_CHECK(select_isa(isa));
+            BOOST_CHECK_SMALL(value - transition_value(indices.data(),
+                                              probabilities.data(),
+                                              rewards.data(),
+                                              n,
+                                              valuefunction.data(),
+                                              0.9),
+                    1e-12);
+            BOOST_CHECK_SMALL(product - dot(probabilities.data(), rewards.data(), n), 1e-12);
+            BOOST_CHECK_SMALL(
+                    sparse_product - sparse_dot(indices.data(), probabilities.data(), n, valuefunction.data()), 1e-12);
+            BOOST_CHECK_SMALL(
+                    fsparse_product - sparse_dot(indices.data(), fprobabilities.data(), n, valuefunction.data()), 1e-12);
+        }
+    }
+
+    BOOST_CHECK(select_isa(selected));
+    BOOST_CHECK(active_isa() == best_isa());
+}
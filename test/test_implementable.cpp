@@ -59,8 +59,8 @@ MDP make_chain1() {
 
 BOOST_AUTO_TEST_CASE(simple_construct_mdpi) {
     auto mdp = make_shared<MDP>();
-    vector<long> observations({0, 0});
-    Transition initial(vector<long>{0, 1}, vector<prec_t>{0.5, 0.5}, vector<prec_t>{0, 0});
+    indvec observations({0, 0});
+    Transition initial(indvec{0, 1}, vector<prec_t>{0.5, 0.5}, vector<prec_t>{0, 0});
 
     add_transition(*mdp, 0, 0, 1, 1.0, 1.0);
     add_transition(*mdp, 1, 0, 0, 1.0, 1.0);
@@ -80,8 +80,8 @@ BOOST_AUTO_TEST_CASE(simple_construct_mdpi) {
 
 BOOST_AUTO_TEST_CASE(simple_construct_mdpi_r) {
     auto mdp = make_shared<MDP>();
-    vector<long> observations({0, 0});
-    Transition initial(vector<long>{0, 1}, vector<prec_t>{0.5, 0.5}, vector<prec_t>{0, 0});
+    indvec observations({0, 0});
+    Transition initial(indvec{0, 1}, vector<prec_t>{0.5, 0.5}, vector<prec_t>{0, 0});
 
     add_transition(*mdp, 0, 0, 1, 1.0, 1.0);
     add_transition(*mdp, 1, 0, 0, 1.0, 2.0);
@@ -107,9 +107,9 @@ BOOST_AUTO_TEST_CASE(simple_construct_mdpi_r) {
 
 BOOST_AUTO_TEST_CASE(small_construct_mdpi_r) {
     auto mdp = make_shared<MDP>();
-    vector<long> observations{0, 0, 1};
+    indvec observations{0, 0, 1};
 
-    Transition initial(vector<long>{0, 1, 2}, vector<prec_t>{1.0 / 3.0, 1.0 / 3.0, 1.0 / 3.0}, vector<prec_t>{0, 0, 0});
+    Transition initial(indvec{0, 1, 2}, vector<prec_t>{1.0 / 3.0, 1.0 / 3.0, 1.0 / 3.0}, vector<prec_t>{0, 0, 0});
 
     // action 0
     add_transition(*mdp, 0, 0, 0, 0.5, 1.0);
@@ -154,8 +154,8 @@ BOOST_AUTO_TEST_CASE(small_construct_mdpi_r) {
 
 BOOST_AUTO_TEST_CASE(small_reweighted_solution) {
     auto mdp = make_shared<MDP>();
-    vector<long> observations({0, 0, 1});
-    Transition initial(vector<long>{0, 1, 2}, vector<prec_t>{1.0 / 3.0, 1.0 / 3.0, 1.0 / 3.0}, vector<prec_t>{0, 0, 0});
+    indvec observations({0, 0, 1});
+    Transition initial(indvec{0, 1, 2}, vector<prec_t>{1.0 / 3.0, 1.0 / 3.0, 1.0 / 3.0}, vector<prec_t>{0, 0, 0});
 
     // action 0
     add_transition(*mdp, 0, 0, 0, 0.5, 1.0);